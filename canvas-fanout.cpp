@@ -0,0 +1,229 @@
+/*
+ * Copyright 2023 Google LLC
+ * SPDX-License-Identifier: MIT
+ */
+
+#include "include/core/SkPicture.h"
+#include "include/core/SkPictureRecorder.h"
+#include "include/docs/SkPDFDocument.h"
+#include "include/svg/SkSVGCanvas.h"
+#include "include/utils/SkNWayCanvas.h"
+#include "skutil.h"
+#include "skutil_scene.h"
+
+struct canvas_fanout_test {
+    uint32_t width;
+    uint32_t height;
+    enum sk_scene_type scene_type;
+    uint32_t frame_count;
+
+    struct sk sk;
+    struct sk_scene scene;
+    std::vector<sk_sp<SkPicture>> pics;
+
+    /* the raster, pdf and svg targets */
+    sk_sp<SkSurface> surf;
+    std::unique_ptr<SkFILEWStream> pdf_writer;
+    sk_sp<SkDocument> doc;
+    std::unique_ptr<SkFILEWStream> svg_writer;
+    std::unique_ptr<SkCanvas> svg_canvas;
+};
+
+static void
+canvas_fanout_test_init(struct canvas_fanout_test *test)
+{
+    struct sk *sk = &test->sk;
+
+    const struct sk_init_params params = {
+        .thread_count = sk_get_cpu_count(),
+    };
+    sk_init(sk, &params);
+    sk_scene_init(sk, &test->scene, test->scene_type, test->width, test->height);
+}
+
+static void
+canvas_fanout_test_cleanup(struct canvas_fanout_test *test)
+{
+    struct sk *sk = &test->sk;
+
+    test->pics.clear();
+    sk_scene_cleanup(sk, &test->scene);
+    sk_cleanup(sk);
+}
+
+static void
+canvas_fanout_test_begin_targets(struct canvas_fanout_test *test)
+{
+    struct sk *sk = &test->sk;
+
+    test->surf = sk_create_surface_raster(sk, test->width, test->height);
+
+    test->pdf_writer = std::make_unique<SkFILEWStream>("rt.pdf");
+    if (!test->pdf_writer->isValid())
+        sk_die("failed to open file");
+    SkPDF::Metadata metadata;
+    metadata.fExecutor = sk->executor.get();
+    test->doc = SkPDF::MakeDocument(test->pdf_writer.get(), metadata);
+
+    test->svg_writer = std::make_unique<SkFILEWStream>("rt.svg");
+    if (!test->svg_writer->isValid())
+        sk_die("failed to open file");
+    test->svg_canvas =
+        SkSVGCanvas::Make(SkRect::MakeIWH(test->width, test->height), test->svg_writer.get());
+}
+
+static void
+canvas_fanout_test_end_targets(struct canvas_fanout_test *test)
+{
+    struct sk *sk = &test->sk;
+
+    test->doc->close();
+    test->doc.reset();
+    test->pdf_writer.reset();
+
+    /* the svg is finalized when the canvas is destroyed */
+    test->svg_canvas.reset();
+    test->svg_writer.reset();
+
+    sk_dump_surface(sk, test->surf, "rt.png");
+    test->surf.reset();
+}
+
+static SkCanvas *
+canvas_fanout_test_begin_page(struct canvas_fanout_test *test)
+{
+    return test->doc->beginPage(SkIntToScalar(test->width), SkIntToScalar(test->height));
+}
+
+/* draws the scene once per target, like running canvas-raster, canvas-pdf and canvas-svg */
+static void
+canvas_fanout_test_draw_serial(struct canvas_fanout_test *test)
+{
+    struct sk *sk = &test->sk;
+
+    for (uint32_t i = 0; i < test->frame_count; i++) {
+        sk_scene_draw(sk, &test->scene, test->surf->getCanvas(), i);
+        sk_report_first_pixel(sk);
+    }
+
+    for (uint32_t i = 0; i < test->frame_count; i++) {
+        sk_scene_draw(sk, &test->scene, canvas_fanout_test_begin_page(test), i);
+        test->doc->endPage();
+    }
+
+    for (uint32_t i = 0; i < test->frame_count; i++)
+        sk_scene_draw(sk, &test->scene, test->svg_canvas.get(), i);
+}
+
+/* draws the scene once into all targets in one pass */
+static void
+canvas_fanout_test_draw_nway(struct canvas_fanout_test *test)
+{
+    struct sk *sk = &test->sk;
+
+    for (uint32_t i = 0; i < test->frame_count; i++) {
+        SkNWayCanvas canvas(test->width, test->height);
+        canvas.addCanvas(test->surf->getCanvas());
+        canvas.addCanvas(canvas_fanout_test_begin_page(test));
+        canvas.addCanvas(test->svg_canvas.get());
+
+        sk_scene_draw(sk, &test->scene, &canvas, i);
+        test->doc->endPage();
+        sk_report_first_pixel(sk);
+    }
+}
+
+/* records the scene once and plays it back into each target on its own thread */
+static void
+canvas_fanout_test_draw_record(struct canvas_fanout_test *test)
+{
+    struct sk *sk = &test->sk;
+
+    test->pics.clear();
+    for (uint32_t i = 0; i < test->frame_count; i++) {
+        SkPictureRecorder rec;
+        SkCanvas *canvas =
+            rec.beginRecording(SkIntToScalar(test->width), SkIntToScalar(test->height));
+        sk_scene_draw(sk, &test->scene, canvas, i);
+        test->pics.push_back(rec.finishRecordingAsPicture());
+    }
+
+    /* pictures are immutable and safe to play back concurrently */
+    std::thread raster([test, sk] {
+        for (const sk_sp<SkPicture> &pic : test->pics) {
+            pic->playback(test->surf->getCanvas());
+            sk_report_first_pixel(sk);
+        }
+    });
+    std::thread pdf([test] {
+        for (const sk_sp<SkPicture> &pic : test->pics) {
+            pic->playback(canvas_fanout_test_begin_page(test));
+            test->doc->endPage();
+        }
+    });
+    std::thread svg([test] {
+        for (const sk_sp<SkPicture> &pic : test->pics)
+            pic->playback(test->svg_canvas.get());
+    });
+
+    raster.join();
+    pdf.join();
+    svg.join();
+}
+
+static uint64_t
+canvas_fanout_test_run(struct canvas_fanout_test *test,
+                       void (*draw)(struct canvas_fanout_test *test))
+{
+    const uint64_t begin = sk_now_ns();
+    canvas_fanout_test_begin_targets(test);
+    draw(test);
+    canvas_fanout_test_end_targets(test);
+    return sk_now_ns() - begin;
+}
+
+int
+main(int argc, const char **argv)
+{
+    struct canvas_fanout_test test = {
+        .width = 300,
+        .height = 300,
+        .scene_type = SK_SCENE_CIRCLE,
+        .frame_count = 1,
+    };
+
+    int opt;
+    while ((opt = getopt(argc, (char *const *)argv, "s:n:")) != -1) {
+        switch (opt) {
+        case 's':
+            test.scene_type = sk_scene_parse_type(optarg);
+            break;
+        case 'n':
+            test.frame_count = atoi(optarg);
+            break;
+        default:
+            sk_die("usage: %s [-s <scene>] [-n <frame-count>]", argv[0]);
+        }
+    }
+    if (!test.frame_count)
+        sk_die("frame count must be positive");
+
+    canvas_fanout_test_init(&test);
+    sk_alloc_set_phase(SK_ALLOC_PHASE_DRAW);
+
+    /* every run writes the same rt.png, rt.pdf and rt.svg */
+    const uint64_t serial_ns = canvas_fanout_test_run(&test, canvas_fanout_test_draw_serial);
+    const uint64_t nway_ns = canvas_fanout_test_run(&test, canvas_fanout_test_draw_nway);
+    const uint64_t record_ns = canvas_fanout_test_run(&test, canvas_fanout_test_draw_record);
+
+    sk_log("%s: %u frames to png, pdf and svg", sk_scene_get_name(test.scene_type),
+           test.frame_count);
+    sk_log("serial: %.3f ms", serial_ns / 1e6);
+    sk_log("nway: %.3f ms, %.2fx", nway_ns / 1e6, (double)serial_ns / nway_ns);
+    sk_log("record + threads: %.3f ms, %.2fx", record_ns / 1e6, (double)serial_ns / record_ns);
+
+    sk_alloc_set_phase(SK_ALLOC_PHASE_CLEANUP);
+    canvas_fanout_test_cleanup(&test);
+
+    return 0;
+}
@@ -5,15 +5,29 @@
 
 #include "skutil.h"
 #include "skutil_egl.h"
+#include "skutil_scene.h"
 
 struct canvas_ganesh_gl_test {
     uint32_t width;
     uint32_t height;
+    struct sk_egl_init_params egl_params;
+    enum sk_scene_type scene_type;
+    uint32_t frame_count;
+    const char *gpu_path_renderers;
+    uint32_t frames_in_flight;
+    bool sequence;
+    bool warmup;
+    bool compare_raster;
 
     struct sk sk;
     struct sk_egl egl;
     sk_sp<GrDirectContext> ctx;
     sk_sp<SkSurface> surf;
+    struct sk_scene scene;
+
+    uint64_t egl_ns;
+    uint64_t ctx_ns;
+    uint64_t first_frame_ns;
 };
 
 static void
@@ -22,11 +36,24 @@ canvas_ganesh_gl_test_init(struct canvas_ganesh_gl_test *test)
     struct sk *sk = &test->sk;
     struct sk_egl *egl = &test->egl;
 
-    sk_init(sk, NULL);
-    sk_egl_init(egl);
+    const struct sk_init_params params = {
+        .thread_count = sk_get_cpu_count(),
+        .warm_init = true,
+        .gpu_path_renderers = test->gpu_path_renderers,
+    };
+    sk_init(sk, &params);
 
+    const uint64_t egl_begin = sk_now_ns();
+    sk_egl_init(egl, &test->egl_params);
+    const uint64_t ctx_begin = sk_now_ns();
     test->ctx = sk_create_context_ganesh_gl(sk);
     test->surf = sk_create_surface_ganesh(sk, test->ctx, test->width, test->height);
+    const uint64_t ctx_end = sk_now_ns();
+
+    test->egl_ns = ctx_begin - egl_begin;
+    test->ctx_ns = ctx_end - ctx_begin;
+
+    sk_scene_init(sk, &test->scene, test->scene_type, test->width, test->height);
 }
 
 static void
@@ -35,6 +62,7 @@ canvas_ganesh_gl_test_cleanup(struct canvas_ganesh_gl_test *test)
     struct sk *sk = &test->sk;
     struct sk_egl *egl = &test->egl;
 
+    sk_scene_cleanup(sk, &test->scene);
     test->surf.reset();
     test->ctx.reset();
     sk_egl_cleanup(egl);
@@ -47,28 +75,295 @@ canvas_ganesh_gl_test_draw(struct canvas_ganesh_gl_test *test)
     struct sk *sk = &test->sk;
 
     SkCanvas *canvas = test->surf->getCanvas();
-    canvas->clear(SK_ColorWHITE);
 
-    SkPaint paint;
-    paint.setColor(SK_ColorRED);
-    paint.setAntiAlias(true);
-    canvas->drawCircle(test->width / 2, test->height / 2, 30, paint);
+    std::vector<uint64_t> samples;
+    samples.reserve(test->frame_count);
+
+    /* per-frame results need each frame's gpu time, so frames are serialized for them */
+    const bool sync = sk->params.results_path;
+
+    const uint64_t begin = sk_now_ns();
+    uint64_t prev = begin;
+    for (uint32_t i = 0; i < test->frame_count; i++) {
+        sk_scene_draw(sk, &test->scene, canvas, i);
+
+        sk_alloc_set_phase(SK_ALLOC_PHASE_FLUSH);
+        if (!i) {
+            test->ctx->flushAndSubmit(test->surf.get(), GrSyncCpu::kYes);
+            test->first_frame_ns = sk_now_ns() - begin;
+            sk_report_first_pixel(sk);
+        } else {
+            test->ctx->flushAndSubmit(test->surf.get(), sync ? GrSyncCpu::kYes : GrSyncCpu::kNo);
+        }
+        sk_alloc_set_phase(SK_ALLOC_PHASE_DRAW);
+
+        const uint64_t now = sk_now_ns();
+        samples.push_back(now - prev);
+        prev = now;
+    }
+    sk_alloc_set_phase(SK_ALLOC_PHASE_FLUSH);
+    test->ctx->submit(GrSyncCpu::kYes);
+    sk_alloc_set_phase(SK_ALLOC_PHASE_DRAW);
+    const uint64_t end = sk_now_ns();
+    /* the last frame pays for draining the queue */
+    samples.back() += end - prev;
 
-    test->ctx->flushAndSubmit(test->surf.get());
+    sk_scene_report(sk, &test->scene, "ganesh-gl", test->frame_count, end - begin);
+    sk_scene_report_first_frame(sk, &test->scene, "ganesh-gl", test->frame_count,
+                                test->first_frame_ns, end - begin);
+    sk_write_result(sk, "ganesh-gl", sk_scene_get_name(test->scene.type),
+                    test->surf->imageInfo(), samples);
+
+    if (test->compare_raster) {
+        const uint64_t steady_ns = end - begin - test->first_frame_ns;
+        const double gpu_ns = test->frame_count > 1
+                                  ? (double)steady_ns / (test->frame_count - 1)
+                                  : (double)(end - begin);
+        const double raster_ns = sk_scene_time_raster(sk, &test->scene, test->frame_count);
+        sk_log("ganesh-gl/%s: %.3f ms/frame, raster pipeline %.3f ms/frame, %.2fx",
+               sk_scene_get_name(test->scene.type), gpu_ns / 1e6, raster_ns / 1e6,
+               raster_ns / gpu_ns);
+    }
 
     sk_dump_surface(sk, test->surf, "rt.png");
 }
 
+static void
+canvas_ganesh_gl_test_warmup(struct canvas_ganesh_gl_test *test)
+{
+    struct sk *sk = &test->sk;
+
+    const uint64_t begin = sk_now_ns();
+    sk_scene_warmup(sk, &test->scene, test->surf->getCanvas());
+    sk_log("warmup: %.3f ms", (sk_now_ns() - begin) / 1e6);
+}
+
+/* renders with up to frames_in_flight frames queued, each to its own surface */
+static void
+canvas_ganesh_gl_test_draw_pipelined(struct canvas_ganesh_gl_test *test,
+                                     uint32_t frames_in_flight)
+{
+    struct sk *sk = &test->sk;
+    struct sk_egl *egl = &test->egl;
+
+    struct sk_frame_slot slots[SK_MAX_FRAMES_IN_FLIGHT];
+    GLsync syncs[SK_MAX_FRAMES_IN_FLIGHT] = {};
+    sk_frame_slots_init(sk, test->ctx, slots, frames_in_flight, test->width, test->height);
+
+    /* without fence support, ganesh signals no semaphore and we wait for everything */
+    struct sk_frame_stats stats = {};
+    auto retire = [&](uint32_t idx) {
+        struct sk_frame_slot *slot = &slots[idx];
+        if (syncs[idx]) {
+            sk_egl_wait_sync(egl, syncs[idx]);
+            syncs[idx] = NULL;
+        } else {
+            test->ctx->submit(GrSyncCpu::kYes);
+        }
+        while (slot->pending)
+            test->ctx->checkAsyncWorkCompletion();
+        sk_frame_stats_add(&stats, slot);
+    };
+
+    const uint64_t begin = sk_now_ns();
+    for (uint32_t i = 0; i < test->frame_count; i++) {
+        const uint32_t idx = i % frames_in_flight;
+        struct sk_frame_slot *slot = &slots[idx];
+        /* run the finished procs of completed frames now rather than when retired */
+        test->ctx->checkAsyncWorkCompletion();
+        if (slot->pending)
+            retire(idx);
+
+        sk_frame_slot_begin(slot, i);
+        sk_scene_draw(sk, &test->scene, slot->surf->getCanvas(), i);
+
+        GrBackendSemaphore sem;
+        const GrFlushInfo info = sk_frame_slot_flush_info(slot, &sem);
+        if (test->ctx->flush(slot->surf.get(), info) == GrSemaphoresSubmitted::kYes)
+            syncs[idx] = (GLsync)sem.glSync();
+        test->ctx->submit();
+        test->ctx->checkAsyncWorkCompletion();
+
+        if (!i) {
+            retire(idx);
+            if (!test->first_frame_ns)
+                test->first_frame_ns = sk_now_ns() - begin;
+            sk_report_first_pixel(sk);
+        }
+    }
+    const uint32_t tail = std::min(test->frame_count, frames_in_flight);
+    for (uint32_t i = test->frame_count - tail; i < test->frame_count; i++) {
+        const uint32_t idx = i % frames_in_flight;
+        if (slots[idx].pending)
+            retire(idx);
+    }
+    const uint64_t end = sk_now_ns();
+
+    sk_frame_stats_report(sk, "ganesh-gl", frames_in_flight, &stats, end - begin);
+
+    sk_dump_surface(sk, slots[(test->frame_count - 1) % frames_in_flight].surf, "rt.png");
+}
+
+static uint64_t
+canvas_ganesh_gl_test_draw_sequence(struct canvas_ganesh_gl_test *test,
+                                    float damage,
+                                    bool partial)
+{
+    struct sk *sk = &test->sk;
+
+    /* ganesh surfaces retain their contents between frames */
+    SkCanvas *canvas = test->surf->getCanvas();
+    sk_scene_reset_anim(&test->scene);
+
+    const uint64_t begin = sk_now_ns();
+    for (uint32_t i = 0; i < test->frame_count; i++) {
+        sk_scene_draw_anim(sk, &test->scene, canvas, i, damage, partial);
+
+        sk_alloc_set_phase(SK_ALLOC_PHASE_FLUSH);
+        if (!i) {
+            test->ctx->flushAndSubmit(test->surf.get(), GrSyncCpu::kYes);
+            if (!test->first_frame_ns)
+                test->first_frame_ns = sk_now_ns() - begin;
+            sk_report_first_pixel(sk);
+        } else {
+            test->ctx->flushAndSubmit(test->surf.get());
+        }
+        sk_alloc_set_phase(SK_ALLOC_PHASE_DRAW);
+    }
+    sk_alloc_set_phase(SK_ALLOC_PHASE_FLUSH);
+    test->ctx->submit(GrSyncCpu::kYes);
+    sk_alloc_set_phase(SK_ALLOC_PHASE_DRAW);
+    return sk_now_ns() - begin;
+}
+
+static void
+canvas_ganesh_gl_test_draw_sequences(struct canvas_ganesh_gl_test *test)
+{
+    struct sk *sk = &test->sk;
+
+    for (uint32_t i = 0; i < ARRAY_SIZE(sk_scene_anim_damages); i++) {
+        const float damage = sk_scene_anim_damages[i];
+        const uint64_t full_ns = canvas_ganesh_gl_test_draw_sequence(test, damage, false);
+        SkBitmap full;
+        sk_copy_surface(sk, test->surf, &full);
+        const uint64_t partial_ns = canvas_ganesh_gl_test_draw_sequence(test, damage, true);
+        SkBitmap partial;
+        sk_copy_surface(sk, test->surf, &partial);
+        sk_scene_report_anim(sk, &test->scene, "ganesh-gl", damage, test->frame_count,
+                             full_ns, partial_ns, full.pixmap(), partial.pixmap());
+    }
+
+    sk_dump_surface(sk, test->surf, "rt.png");
+}
+
+static void
+canvas_ganesh_gl_test_report(struct canvas_ganesh_gl_test *test)
+{
+    struct sk *sk = &test->sk;
+
+    sk_log("startup: egl %.3f ms, ganesh %.3f ms, first frame %.3f ms", test->egl_ns / 1e6,
+           test->ctx_ns / 1e6, test->first_frame_ns / 1e6);
+    if (sk->shader_cache) {
+        sk_log("shader cache: %u/%u hits", sk->shader_cache->hit_count(),
+               sk->shader_cache->load_count());
+    }
+}
+
+static void
+canvas_ganesh_gl_parse_device(struct canvas_ganesh_gl_test *test, const char *arg)
+{
+    if (!strcmp(arg, "hw"))
+        test->egl_params.device_type = SK_EGL_DEVICE_HW;
+    else if (!strcmp(arg, "sw"))
+        test->egl_params.device_type = SK_EGL_DEVICE_SW;
+    else
+        test->egl_params.device_name = arg;
+}
+
 int
 main(int argc, const char **argv)
 {
     struct canvas_ganesh_gl_test test = {
         .width = 300,
         .height = 300,
+        .egl_params = {
+            .device_name = NULL,
+            .device_type = SK_EGL_DEVICE_ANY,
+        },
+        .scene_type = SK_SCENE_CIRCLE,
+        .frame_count = 1,
+        .gpu_path_renderers = NULL,
+        .frames_in_flight = 0,
+        .sequence = false,
+        .warmup = false,
+        .compare_raster = false,
     };
 
+    int opt;
+    while ((opt = getopt(argc, (char *const *)argv, "d:s:n:p:f:ag:wr")) != -1) {
+        switch (opt) {
+        case 'd':
+            canvas_ganesh_gl_parse_device(&test, optarg);
+            break;
+        case 's':
+            test.scene_type = sk_scene_parse_type(optarg);
+            break;
+        case 'g':
+            if (sscanf(optarg, "%ux%u", &test.width, &test.height) != 2)
+                sk_die("bad geometry %s", optarg);
+            break;
+        case 'n':
+            test.frame_count = atoi(optarg);
+            break;
+        case 'p':
+            test.gpu_path_renderers = optarg;
+            break;
+        case 'f':
+            test.frames_in_flight = atoi(optarg);
+            break;
+        case 'a':
+            test.sequence = true;
+            break;
+        case 'w':
+            test.warmup = true;
+            break;
+        case 'r':
+            test.compare_raster = true;
+            break;
+        default:
+            sk_die("usage: %s [-d hw|sw|<device-name>] [-s <scene>] [-g <width>x<height>] "
+                   "[-n <frame-count>] [-p <path-renderers>] [-f <frames-in-flight>] [-a] "
+                   "[-w] [-r] [hw|sw|<device-name>]",
+                   argv[0]);
+        }
+    }
+    /* the device used to be the only, positional, argument */
+    if (optind < argc) {
+        if (optind != argc - 1)
+            sk_die("usage: %s [options] [hw|sw|<device-name>]", argv[0]);
+        canvas_ganesh_gl_parse_device(&test, argv[optind]);
+    }
+    if (!test.width || !test.height || !test.frame_count)
+        sk_die("geometry and frame count must be positive");
+    if (test.frames_in_flight > SK_MAX_FRAMES_IN_FLIGHT)
+        sk_die("at most %d frames can be in flight", SK_MAX_FRAMES_IN_FLIGHT);
+
     canvas_ganesh_gl_test_init(&test);
-    canvas_ganesh_gl_test_draw(&test);
+    if (test.warmup)
+        canvas_ganesh_gl_test_warmup(&test);
+    sk_alloc_set_phase(SK_ALLOC_PHASE_DRAW);
+    if (test.sequence) {
+        canvas_ganesh_gl_test_draw_sequences(&test);
+    } else if (test.frames_in_flight) {
+        /* compare against the serialized loop */
+        canvas_ganesh_gl_test_draw_pipelined(&test, 1);
+        if (test.frames_in_flight > 1)
+            canvas_ganesh_gl_test_draw_pipelined(&test, test.frames_in_flight);
+    } else {
+        canvas_ganesh_gl_test_draw(&test);
+    }
+    canvas_ganesh_gl_test_report(&test);
+    sk_alloc_set_phase(SK_ALLOC_PHASE_CLEANUP);
     canvas_ganesh_gl_test_cleanup(&test);
 
     return 0;
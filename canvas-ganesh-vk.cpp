@@ -4,16 +4,25 @@
  */
 
 #include "skutil.h"
+#include "skutil_scene.h"
 #include "skutil_vk.h"
 
 struct canvas_ganesh_vk_test {
     uint32_t width;
     uint32_t height;
+    enum sk_scene_type scene_type;
+    uint32_t frame_count;
+    const char *gpu_path_renderers;
+    uint32_t frames_in_flight;
+    bool sequence;
+    bool warmup;
+    bool compare_raster;
 
     struct sk sk;
     struct sk_vk vk;
     sk_sp<GrDirectContext> ctx;
     sk_sp<SkSurface> surf;
+    struct sk_scene scene;
 };
 
 static void
@@ -22,12 +31,18 @@ canvas_ganesh_vk_test_init(struct canvas_ganesh_vk_test *test)
     struct sk *sk = &test->sk;
     struct sk_vk *vk = &test->vk;
 
-    sk_init(sk, NULL);
+    const struct sk_init_params params = {
+        .thread_count = sk_get_cpu_count(),
+        .warm_init = true,
+        .gpu_path_renderers = test->gpu_path_renderers,
+    };
+    sk_init(sk, &params);
     sk_vk_init(vk);
 
     const GrVkBackendContext backend = sk_vk_make_backend_context(vk);
     test->ctx = sk_create_context_ganesh_vk(sk, backend);
     test->surf = sk_create_surface_ganesh(sk, test->ctx, test->width, test->height);
+    sk_scene_init(sk, &test->scene, test->scene_type, test->width, test->height);
 }
 
 static void
@@ -36,6 +51,7 @@ canvas_ganesh_vk_test_cleanup(struct canvas_ganesh_vk_test *test)
     struct sk *sk = &test->sk;
     struct sk_vk *vk = &test->vk;
 
+    sk_scene_cleanup(sk, &test->scene);
     test->surf.reset();
     test->ctx.reset();
     sk_vk_cleanup(vk);
@@ -48,14 +64,190 @@ canvas_ganesh_vk_test_draw(struct canvas_ganesh_vk_test *test)
     struct sk *sk = &test->sk;
 
     SkCanvas *canvas = test->surf->getCanvas();
-    canvas->clear(SK_ColorWHITE);
 
-    SkPaint paint;
-    paint.setColor(SK_ColorRED);
-    paint.setAntiAlias(true);
-    canvas->drawCircle(test->width / 2, test->height / 2, 30, paint);
+    std::vector<uint64_t> samples;
+    samples.reserve(test->frame_count);
+    struct sk_vk_trace_frames trace;
+    sk_vk_trace_frames_init(&trace);
+
+    /* per-frame results need each frame's gpu time, so frames are serialized for them */
+    const bool sync = sk->params.results_path;
+
+    const uint64_t begin = sk_now_ns();
+    uint64_t first_ns = 0;
+    uint64_t prev = begin;
+    for (uint32_t i = 0; i < test->frame_count; i++) {
+        sk_scene_draw(sk, &test->scene, canvas, i);
+
+        sk_alloc_set_phase(SK_ALLOC_PHASE_FLUSH);
+        if (!i) {
+            test->ctx->flushAndSubmit(test->surf.get(), GrSyncCpu::kYes);
+            first_ns = sk_now_ns() - begin;
+            sk_report_first_pixel(sk);
+        } else {
+            test->ctx->flushAndSubmit(test->surf.get(), sync ? GrSyncCpu::kYes : GrSyncCpu::kNo);
+        }
+        sk_alloc_set_phase(SK_ALLOC_PHASE_DRAW);
+
+        const uint64_t now = sk_now_ns();
+        samples.push_back(now - prev);
+        prev = now;
+        sk_vk_trace_frames_add(&trace);
+    }
+    sk_alloc_set_phase(SK_ALLOC_PHASE_FLUSH);
+    test->ctx->submit(GrSyncCpu::kYes);
+    sk_alloc_set_phase(SK_ALLOC_PHASE_DRAW);
+    const uint64_t end = sk_now_ns();
+    /* the last frame pays for draining the queue */
+    samples.back() += end - prev;
+
+    sk_scene_report(sk, &test->scene, "ganesh-vk", test->frame_count, end - begin);
+    sk_scene_report_first_frame(sk, &test->scene, "ganesh-vk", test->frame_count, first_ns,
+                                end - begin);
+    sk_write_result(sk, "ganesh-vk", sk_scene_get_name(test->scene.type),
+                    test->surf->imageInfo(), samples);
+    sk_vk_trace_frames_report(sk, "ganesh-vk", &trace);
 
-    test->ctx->flushAndSubmit(test->surf.get());
+    if (test->compare_raster) {
+        const double gpu_ns = test->frame_count > 1
+                                  ? (double)(end - begin - first_ns) / (test->frame_count - 1)
+                                  : (double)(end - begin);
+        const double raster_ns = sk_scene_time_raster(sk, &test->scene, test->frame_count);
+        sk_log("ganesh-vk/%s: %.3f ms/frame, raster pipeline %.3f ms/frame, %.2fx",
+               sk_scene_get_name(test->scene.type), gpu_ns / 1e6, raster_ns / 1e6,
+               raster_ns / gpu_ns);
+    }
+
+    sk_dump_surface(sk, test->surf, "rt.png");
+}
+
+static void
+canvas_ganesh_vk_test_warmup(struct canvas_ganesh_vk_test *test)
+{
+    struct sk *sk = &test->sk;
+
+    const uint64_t begin = sk_now_ns();
+    sk_scene_warmup(sk, &test->scene, test->surf->getCanvas());
+    sk_log("warmup: %.3f ms", (sk_now_ns() - begin) / 1e6);
+}
+
+/* renders with up to frames_in_flight frames queued, each to its own surface */
+static void
+canvas_ganesh_vk_test_draw_pipelined(struct canvas_ganesh_vk_test *test,
+                                     uint32_t frames_in_flight)
+{
+    struct sk *sk = &test->sk;
+    struct sk_vk *vk = &test->vk;
+
+    struct sk_frame_slot slots[SK_MAX_FRAMES_IN_FLIGHT];
+    VkSemaphore sems[SK_MAX_FRAMES_IN_FLIGHT];
+    sk_frame_slots_init(sk, test->ctx, slots, frames_in_flight, test->width, test->height);
+    for (uint32_t i = 0; i < frames_in_flight; i++)
+        sems[i] = sk_vk_create_semaphore(vk, false);
+    VkSemaphore timeline = sk_vk_create_semaphore(vk, true);
+
+    /* frame i advances the timeline to i + 1 */
+    struct sk_frame_stats stats = {};
+    struct sk_vk_trace_frames trace;
+    sk_vk_trace_frames_init(&trace);
+    auto retire = [&](struct sk_frame_slot *slot) {
+        sk_vk_wait_timeline(vk, timeline, slot->frame + 1);
+        while (slot->pending)
+            test->ctx->checkAsyncWorkCompletion();
+        sk_frame_stats_add(&stats, slot);
+    };
+
+    const uint64_t begin = sk_now_ns();
+    for (uint32_t i = 0; i < test->frame_count; i++) {
+        const uint32_t idx = i % frames_in_flight;
+        struct sk_frame_slot *slot = &slots[idx];
+        /* run the finished procs of completed frames now rather than when retired */
+        test->ctx->checkAsyncWorkCompletion();
+        if (slot->pending)
+            retire(slot);
+
+        sk_frame_slot_begin(slot, i);
+        sk_scene_draw(sk, &test->scene, slot->surf->getCanvas(), i);
+
+        GrBackendSemaphore sem;
+        sem.initVulkan(sems[idx]);
+        const GrFlushInfo info = sk_frame_slot_flush_info(slot, &sem);
+        if (test->ctx->flush(slot->surf.get(), info) != GrSemaphoresSubmitted::kYes)
+            sk_die("failed to submit signal semaphore");
+        test->ctx->submit();
+        test->ctx->checkAsyncWorkCompletion();
+        sk_vk_signal_timeline(vk, sems[idx], timeline, i + 1);
+
+        if (!i) {
+            retire(slot);
+            sk_report_first_pixel(sk);
+        }
+        sk_vk_trace_frames_add(&trace);
+    }
+    const uint32_t tail = std::min(test->frame_count, frames_in_flight);
+    for (uint32_t i = test->frame_count - tail; i < test->frame_count; i++) {
+        struct sk_frame_slot *slot = &slots[i % frames_in_flight];
+        if (slot->pending)
+            retire(slot);
+    }
+    const uint64_t end = sk_now_ns();
+
+    sk_frame_stats_report(sk, "ganesh-vk", frames_in_flight, &stats, end - begin);
+    sk_vk_trace_frames_report(sk, "ganesh-vk", &trace);
+
+    sk_dump_surface(sk, slots[(test->frame_count - 1) % frames_in_flight].surf, "rt.png");
+
+    sk_vk_destroy_semaphore(vk, timeline);
+    for (uint32_t i = 0; i < frames_in_flight; i++)
+        sk_vk_destroy_semaphore(vk, sems[i]);
+}
+
+static uint64_t
+canvas_ganesh_vk_test_draw_sequence(struct canvas_ganesh_vk_test *test,
+                                    float damage,
+                                    bool partial)
+{
+    struct sk *sk = &test->sk;
+
+    /* ganesh surfaces retain their contents between frames */
+    SkCanvas *canvas = test->surf->getCanvas();
+    sk_scene_reset_anim(&test->scene);
+
+    const uint64_t begin = sk_now_ns();
+    for (uint32_t i = 0; i < test->frame_count; i++) {
+        sk_scene_draw_anim(sk, &test->scene, canvas, i, damage, partial);
+
+        sk_alloc_set_phase(SK_ALLOC_PHASE_FLUSH);
+        if (!i) {
+            test->ctx->flushAndSubmit(test->surf.get(), GrSyncCpu::kYes);
+            sk_report_first_pixel(sk);
+        } else {
+            test->ctx->flushAndSubmit(test->surf.get());
+        }
+        sk_alloc_set_phase(SK_ALLOC_PHASE_DRAW);
+    }
+    sk_alloc_set_phase(SK_ALLOC_PHASE_FLUSH);
+    test->ctx->submit(GrSyncCpu::kYes);
+    sk_alloc_set_phase(SK_ALLOC_PHASE_DRAW);
+    return sk_now_ns() - begin;
+}
+
+static void
+canvas_ganesh_vk_test_draw_sequences(struct canvas_ganesh_vk_test *test)
+{
+    struct sk *sk = &test->sk;
+
+    for (uint32_t i = 0; i < ARRAY_SIZE(sk_scene_anim_damages); i++) {
+        const float damage = sk_scene_anim_damages[i];
+        const uint64_t full_ns = canvas_ganesh_vk_test_draw_sequence(test, damage, false);
+        SkBitmap full;
+        sk_copy_surface(sk, test->surf, &full);
+        const uint64_t partial_ns = canvas_ganesh_vk_test_draw_sequence(test, damage, true);
+        SkBitmap partial;
+        sk_copy_surface(sk, test->surf, &partial);
+        sk_scene_report_anim(sk, &test->scene, "ganesh-vk", damage, test->frame_count,
+                             full_ns, partial_ns, full.pixmap(), partial.pixmap());
+    }
 
     sk_dump_surface(sk, test->surf, "rt.png");
 }
@@ -66,10 +258,69 @@ main(int argc, const char **argv)
     struct canvas_ganesh_vk_test test = {
         .width = 300,
         .height = 300,
+        .scene_type = SK_SCENE_CIRCLE,
+        .frame_count = 1,
+        .gpu_path_renderers = NULL,
+        .frames_in_flight = 0,
+        .sequence = false,
+        .warmup = false,
+        .compare_raster = false,
     };
 
+    int opt;
+    while ((opt = getopt(argc, (char *const *)argv, "s:n:p:f:ag:wr")) != -1) {
+        switch (opt) {
+        case 's':
+            test.scene_type = sk_scene_parse_type(optarg);
+            break;
+        case 'g':
+            if (sscanf(optarg, "%ux%u", &test.width, &test.height) != 2)
+                sk_die("bad geometry %s", optarg);
+            break;
+        case 'n':
+            test.frame_count = atoi(optarg);
+            break;
+        case 'p':
+            test.gpu_path_renderers = optarg;
+            break;
+        case 'f':
+            test.frames_in_flight = atoi(optarg);
+            break;
+        case 'a':
+            test.sequence = true;
+            break;
+        case 'w':
+            test.warmup = true;
+            break;
+        case 'r':
+            test.compare_raster = true;
+            break;
+        default:
+            sk_die("usage: %s [-s <scene>] [-g <width>x<height>] [-n <frame-count>] "
+                   "[-p <path-renderers>] [-f <frames-in-flight>] [-a] [-w] [-r]",
+                   argv[0]);
+        }
+    }
+    if (!test.width || !test.height || !test.frame_count)
+        sk_die("geometry and frame count must be positive");
+    if (test.frames_in_flight > SK_MAX_FRAMES_IN_FLIGHT)
+        sk_die("at most %d frames can be in flight", SK_MAX_FRAMES_IN_FLIGHT);
+
     canvas_ganesh_vk_test_init(&test);
-    canvas_ganesh_vk_test_draw(&test);
+    if (test.warmup)
+        canvas_ganesh_vk_test_warmup(&test);
+    sk_alloc_set_phase(SK_ALLOC_PHASE_DRAW);
+    if (test.sequence) {
+        canvas_ganesh_vk_test_draw_sequences(&test);
+    } else if (test.frames_in_flight) {
+        /* compare against the serialized loop */
+        canvas_ganesh_vk_test_draw_pipelined(&test, 1);
+        if (test.frames_in_flight > 1)
+            canvas_ganesh_vk_test_draw_pipelined(&test, test.frames_in_flight);
+    } else {
+        canvas_ganesh_vk_test_draw(&test);
+    }
+    sk_alloc_set_phase(SK_ALLOC_PHASE_CLEANUP);
     canvas_ganesh_vk_test_cleanup(&test);
 
     return 0;
@@ -32,8 +32,12 @@ canvas_null_test_cleanup(struct canvas_null_test *test)
 static void
 canvas_null_test_draw(struct canvas_null_test *test)
 {
+    struct sk *sk = &test->sk;
+
     SkCanvas *canvas = test->canvas.get();
     canvas->clear(SK_ColorWHITE);
+
+    sk_report_first_pixel(sk);
 }
 
 int
@@ -42,7 +46,9 @@ main(int argc, const char **argv)
     struct canvas_null_test test = {};
 
     canvas_null_test_init(&test);
+    sk_alloc_set_phase(SK_ALLOC_PHASE_DRAW);
     canvas_null_test_draw(&test);
+    sk_alloc_set_phase(SK_ALLOC_PHASE_CLEANUP);
     canvas_null_test_cleanup(&test);
 
     return 0;
@@ -5,24 +5,31 @@
 
 #include "include/docs/SkPDFDocument.h"
 #include "skutil.h"
+#include "skutil_scene.h"
 
 struct canvas_pdf_test {
     uint32_t width;
     uint32_t height;
+    enum sk_scene_type scene_type;
+    uint32_t frame_count;
 
     struct sk sk;
     std::unique_ptr<SkFILEWStream> writer;
     sk_sp<SkDocument> doc;
+    struct sk_scene scene;
 };
 
 static void
 canvas_pdf_test_init_doc(struct canvas_pdf_test *test)
 {
+    struct sk *sk = &test->sk;
+
     test->writer = std::make_unique<SkFILEWStream>("rt.pdf");
     if (!test->writer->isValid())
         sk_die("failed to open file");
 
-    const SkPDF::Metadata metadata;
+    SkPDF::Metadata metadata;
+    metadata.fExecutor = sk->executor.get();
     test->doc = SkPDF::MakeDocument(test->writer.get(), metadata);
 }
 
@@ -31,8 +38,12 @@ canvas_pdf_test_init(struct canvas_pdf_test *test)
 {
     struct sk *sk = &test->sk;
 
-    sk_init(sk, NULL);
+    const struct sk_init_params params = {
+        .thread_count = sk_get_cpu_count(),
+    };
+    sk_init(sk, &params);
     canvas_pdf_test_init_doc(test);
+    sk_scene_init(sk, &test->scene, test->scene_type, test->width, test->height);
 }
 
 static void
@@ -40,6 +51,7 @@ canvas_pdf_test_cleanup(struct canvas_pdf_test *test)
 {
     struct sk *sk = &test->sk;
 
+    sk_scene_cleanup(sk, &test->scene);
     test->doc.reset();
     test->writer.reset();
     sk_cleanup(sk);
@@ -48,17 +60,21 @@ canvas_pdf_test_cleanup(struct canvas_pdf_test *test)
 static void
 canvas_pdf_test_draw(struct canvas_pdf_test *test)
 {
-    SkCanvas *canvas =
-        test->doc->beginPage(SkIntToScalar(test->width), SkIntToScalar(test->height));
-    canvas->clear(SK_ColorWHITE);
-
-    SkPaint paint;
-    paint.setColor(SK_ColorRED);
-    paint.setAntiAlias(true);
-    canvas->drawCircle(test->width / 2, test->height / 2, 30, paint);
+    struct sk *sk = &test->sk;
 
-    test->doc->endPage();
+    /* one page per frame */
+    const uint64_t begin = sk_now_ns();
+    for (uint32_t i = 0; i < test->frame_count; i++) {
+        SkCanvas *canvas =
+            test->doc->beginPage(SkIntToScalar(test->width), SkIntToScalar(test->height));
+        sk_scene_draw(sk, &test->scene, canvas, i);
+        test->doc->endPage();
+        sk_report_first_pixel(sk);
+    }
     test->doc->close();
+    const uint64_t end = sk_now_ns();
+
+    sk_scene_report(sk, &test->scene, "pdf", test->frame_count, end - begin);
 }
 
 int
@@ -67,10 +83,30 @@ main(int argc, const char **argv)
     struct canvas_pdf_test test = {
         .width = 300,
         .height = 300,
+        .scene_type = SK_SCENE_CIRCLE,
+        .frame_count = 1,
     };
 
+    int opt;
+    while ((opt = getopt(argc, (char *const *)argv, "s:n:")) != -1) {
+        switch (opt) {
+        case 's':
+            test.scene_type = sk_scene_parse_type(optarg);
+            break;
+        case 'n':
+            test.frame_count = atoi(optarg);
+            break;
+        default:
+            sk_die("usage: %s [-s <scene>] [-n <frame-count>]", argv[0]);
+        }
+    }
+    if (!test.frame_count)
+        sk_die("frame count must be positive");
+
     canvas_pdf_test_init(&test);
+    sk_alloc_set_phase(SK_ALLOC_PHASE_DRAW);
     canvas_pdf_test_draw(&test);
+    sk_alloc_set_phase(SK_ALLOC_PHASE_CLEANUP);
     canvas_pdf_test_cleanup(&test);
 
     return 0;
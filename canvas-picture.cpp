@@ -10,6 +10,8 @@
 struct canvas_picture_test {
     uint32_t width;
     uint32_t height;
+    uint32_t playback_count;
+    bool cpu_levels;
 
     struct sk sk;
     sk_sp<SkSurface> surf;
@@ -60,19 +62,74 @@ canvas_picture_test_draw(struct canvas_picture_test *test)
     SkCanvas *canvas = test->surf->getCanvas();
     test->pic->playback(canvas);
 
+    sk_report_first_pixel(sk);
+
     sk_dump_surface(sk, test->surf, "rt.png");
 }
 
+/* plays the picture back in a child process per cpu level; this runs before init */
+static void
+canvas_picture_test_draw_cpu_levels(struct canvas_picture_test *test)
+{
+    struct sk *sk = &test->sk;
+
+    const auto draw = [&](enum sk_cpu_level_type level) -> uint64_t {
+        canvas_picture_test_init(test);
+        SkCanvas *canvas = test->surf->getCanvas();
+
+        /* the first playback is not timed */
+        test->pic->playback(canvas);
+        const uint64_t begin = sk_now_ns();
+        for (uint32_t i = 0; i < test->playback_count; i++)
+            test->pic->playback(canvas);
+        const uint64_t ns = sk_now_ns() - begin;
+
+        char filename[64];
+        sk_cpu_level_get_filename(level, filename, sizeof(filename));
+        sk_dump_surface(sk, test->surf, filename);
+        canvas_picture_test_cleanup(test);
+
+        return ns;
+    };
+    struct sk_cpu_level_results results;
+    sk_cpu_levels_run("picture", draw, &results);
+
+    sk_init(sk, NULL);
+    sk_cpu_levels_report(sk, "picture", &results, test->playback_count, "playback");
+    sk_cleanup(sk);
+}
+
 int
 main(int argc, const char **argv)
 {
     struct canvas_picture_test test = {
         .width = 300,
         .height = 300,
+        .playback_count = 100,
+        .cpu_levels = false,
     };
 
+    int opt;
+    while ((opt = getopt(argc, (char *const *)argv, "c")) != -1) {
+        switch (opt) {
+        case 'c':
+            test.cpu_levels = true;
+            break;
+        default:
+            sk_die("usage: %s [-c]", argv[0]);
+        }
+    }
+
+    /* every level runs in its own process, before skia is initialized */
+    if (test.cpu_levels) {
+        canvas_picture_test_draw_cpu_levels(&test);
+        return 0;
+    }
+
     canvas_picture_test_init(&test);
+    sk_alloc_set_phase(SK_ALLOC_PHASE_DRAW);
     canvas_picture_test_draw(&test);
+    sk_alloc_set_phase(SK_ALLOC_PHASE_CLEANUP);
     canvas_picture_test_cleanup(&test);
 
     return 0;
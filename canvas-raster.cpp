@@ -4,13 +4,33 @@
  */
 
 #include "skutil.h"
+#include "skutil_scene.h"
+
+#include <sys/resource.h>
+
+/* a thread of the threaded mode, with its own surface and scene */
+struct canvas_raster_worker {
+    sk_sp<SkSurface> surf;
+    struct sk_scene scene;
+
+    uint64_t cpu_ns;
+    uint64_t switch_count;
+};
 
 struct canvas_raster_test {
     uint32_t width;
     uint32_t height;
+    enum sk_scene_type scene_type;
+    uint32_t frame_count;
+    bool sequence;
+    uint32_t thread_count;
+    bool mixed;
+    bool warmup;
+    bool cpu_levels;
 
     struct sk sk;
     sk_sp<SkSurface> surf;
+    struct sk_scene scene;
 };
 
 static void
@@ -20,6 +40,7 @@ canvas_raster_test_init(struct canvas_raster_test *test)
 
     sk_init(sk, NULL);
     test->surf = sk_create_surface_raster(sk, test->width, test->height);
+    sk_scene_init(sk, &test->scene, test->scene_type, test->width, test->height);
 }
 
 static void
@@ -27,6 +48,7 @@ canvas_raster_test_cleanup(struct canvas_raster_test *test)
 {
     struct sk *sk = &test->sk;
 
+    sk_scene_cleanup(sk, &test->scene);
     test->surf.reset();
     sk_cleanup(sk);
 }
@@ -37,26 +59,309 @@ canvas_raster_test_draw(struct canvas_raster_test *test)
     struct sk *sk = &test->sk;
 
     SkCanvas *canvas = test->surf->getCanvas();
-    canvas->clear(SK_ColorWHITE);
 
-    SkPaint paint;
-    paint.setColor(SK_ColorRED);
-    paint.setAntiAlias(true);
-    canvas->drawCircle(test->width / 2, test->height / 2, 30, paint);
+    std::vector<uint64_t> samples;
+    samples.reserve(test->frame_count);
+
+    const uint64_t begin = sk_now_ns();
+    uint64_t prev = begin;
+    for (uint32_t i = 0; i < test->frame_count; i++) {
+        sk_scene_draw(sk, &test->scene, canvas, i);
+        const uint64_t now = sk_now_ns();
+        samples.push_back(now - prev);
+        prev = now;
+        sk_report_first_pixel(sk);
+    }
+    const uint64_t end = sk_now_ns();
+    const uint64_t first_ns = samples[0];
+
+    sk_scene_report(sk, &test->scene, "raster", test->frame_count, end - begin);
+    sk_scene_report_first_frame(sk, &test->scene, "raster", test->frame_count, first_ns,
+                                end - begin);
+    sk_write_result(sk, "raster", sk_scene_get_name(test->scene.type),
+                    test->surf->imageInfo(), samples);
+
+    sk_dump_surface(sk, test->surf, "rt.png");
+}
+
+static void
+canvas_raster_test_warmup(struct canvas_raster_test *test)
+{
+    struct sk *sk = &test->sk;
+
+    const uint64_t begin = sk_now_ns();
+    sk_scene_warmup(sk, &test->scene, test->surf->getCanvas());
+    sk_log("warmup: %.3f ms", (sk_now_ns() - begin) / 1e6);
+}
+
+static uint64_t
+canvas_raster_test_draw_sequence(struct canvas_raster_test *test, float damage, bool partial)
+{
+    struct sk *sk = &test->sk;
+
+    /* raster surfaces retain their contents between frames */
+    SkCanvas *canvas = test->surf->getCanvas();
+    sk_scene_reset_anim(&test->scene);
+
+    const uint64_t begin = sk_now_ns();
+    for (uint32_t i = 0; i < test->frame_count; i++) {
+        sk_scene_draw_anim(sk, &test->scene, canvas, i, damage, partial);
+        sk_report_first_pixel(sk);
+    }
+    return sk_now_ns() - begin;
+}
+
+static void
+canvas_raster_test_draw_sequences(struct canvas_raster_test *test)
+{
+    struct sk *sk = &test->sk;
+
+    for (uint32_t i = 0; i < ARRAY_SIZE(sk_scene_anim_damages); i++) {
+        const float damage = sk_scene_anim_damages[i];
+        const uint64_t full_ns = canvas_raster_test_draw_sequence(test, damage, false);
+        SkBitmap full;
+        sk_copy_surface(sk, test->surf, &full);
+        const uint64_t partial_ns = canvas_raster_test_draw_sequence(test, damage, true);
+        SkBitmap partial;
+        sk_copy_surface(sk, test->surf, &partial);
+        sk_scene_report_anim(sk, &test->scene, "raster", damage, test->frame_count, full_ns,
+                             partial_ns, full.pixmap(), partial.pixmap());
+    }
 
     sk_dump_surface(sk, test->surf, "rt.png");
 }
 
+/* every worker draws frame_count frames; returns the wall time from the common start */
+static uint64_t
+canvas_raster_test_draw_threaded(struct canvas_raster_test *test,
+                                 struct canvas_raster_worker *workers,
+                                 uint32_t count)
+{
+    struct sk *sk = &test->sk;
+
+    std::atomic<uint32_t> ready_count(0);
+    std::atomic<bool> go(false);
+    std::vector<std::thread> threads;
+    for (uint32_t i = 0; i < count; i++) {
+        struct canvas_raster_worker *worker = &workers[i];
+        threads.emplace_back([&, sk, worker] {
+            SkCanvas *canvas = worker->surf->getCanvas();
+            ready_count++;
+            while (!go)
+                sched_yield();
+
+            /* blocking on a contended lock shows up as voluntary switches and idle time */
+            struct timespec cpu_begin, cpu_end;
+            struct rusage usage_begin, usage_end;
+            clock_gettime(CLOCK_THREAD_CPUTIME_ID, &cpu_begin);
+            getrusage(RUSAGE_THREAD, &usage_begin);
+
+            for (uint32_t frame = 0; frame < test->frame_count; frame++)
+                sk_scene_draw(sk, &worker->scene, canvas, frame);
+
+            clock_gettime(CLOCK_THREAD_CPUTIME_ID, &cpu_end);
+            getrusage(RUSAGE_THREAD, &usage_end);
+            worker->cpu_ns = (cpu_end.tv_sec - cpu_begin.tv_sec) * 1000000000ull +
+                             cpu_end.tv_nsec - cpu_begin.tv_nsec;
+            worker->switch_count = usage_end.ru_nvcsw - usage_begin.ru_nvcsw;
+        });
+    }
+
+    while (ready_count < count)
+        sched_yield();
+    const uint64_t begin = sk_now_ns();
+    go = true;
+
+    for (std::thread &thread : threads)
+        thread.join();
+
+    return sk_now_ns() - begin;
+}
+
+/* renders independent frames on 1, 2, 4, ... threads to expose contention in global caches */
+static void
+canvas_raster_test_draw_scaling(struct canvas_raster_test *test)
+{
+    struct sk *sk = &test->sk;
+
+    /* scenes and surfaces are per thread; only skia's global state is shared */
+    std::vector<struct canvas_raster_worker> workers(test->thread_count);
+    for (uint32_t i = 0; i < test->thread_count; i++) {
+        struct canvas_raster_worker *worker = &workers[i];
+        const enum sk_scene_type type =
+            test->mixed ? sk_scene_names[i % ARRAY_SIZE(sk_scene_names)].type : test->scene_type;
+
+        worker->surf = sk_create_surface_raster(sk, test->width, test->height);
+        sk_scene_init(sk, &worker->scene, type, test->width, test->height);
+    }
+
+    /* an untimed round so that no thread count pays for filling the caches */
+    canvas_raster_test_draw_threaded(test, workers.data(), test->thread_count);
+    sk_report_first_pixel(sk);
+
+    /* with mixed scenes, the baseline of n threads is one thread drawing the scenes of all n */
+    std::vector<uint64_t> single_ns(test->thread_count);
+    for (uint32_t i = 0; i < test->thread_count; i++) {
+        single_ns[i] = test->mixed || !i
+                           ? canvas_raster_test_draw_threaded(test, &workers[i], 1)
+                           : single_ns[0];
+    }
+
+    uint32_t count = 1;
+    while (true) {
+        const uint64_t elapsed_ns = canvas_raster_test_draw_threaded(test, workers.data(), count);
+
+        uint64_t serial_ns = 0;
+        uint64_t cpu_ns = 0;
+        uint64_t switch_count = 0;
+        for (uint32_t i = 0; i < count; i++) {
+            serial_ns += single_ns[i];
+            cpu_ns += workers[i].cpu_ns;
+            switch_count += workers[i].switch_count;
+        }
+
+        const uint64_t frame_count = (uint64_t)test->frame_count * count;
+        const double fps = frame_count / (elapsed_ns / 1e9);
+        const double speedup = (double)serial_ns / elapsed_ns;
+        sk_log("raster/%s: %2u threads, %.1f frames/s, %.2fx (%.0f%% efficiency), "
+               "%.0f%% busy, %.2f voluntary switches/frame",
+               test->mixed ? "mixed" : sk_scene_get_name(test->scene_type), count, fps,
+               speedup, 100.0 * speedup / count, 100.0 * cpu_ns / elapsed_ns / count,
+               (double)switch_count / frame_count);
+
+        /* per-scene numbers show which scene is contended */
+        if (test->mixed && count == test->thread_count) {
+            for (uint32_t i = 0; i < count; i++) {
+                const struct canvas_raster_worker *worker = &workers[i];
+                sk_log("  thread %2u %-14s %.3f ms/frame cpu, %.2f voluntary switches/frame", i,
+                       sk_scene_get_name(worker->scene.type),
+                       worker->cpu_ns / 1e6 / test->frame_count,
+                       (double)worker->switch_count / test->frame_count);
+            }
+        }
+
+        if (count == test->thread_count)
+            break;
+        count = std::min(count * 2, test->thread_count);
+    }
+
+    sk_log("shared caches: strike %.1f MiB (%d strikes), resource %.1f MiB",
+           SkGraphics::GetFontCacheUsed() / (double)(1 << 20),
+           SkGraphics::GetFontCacheCountUsed(),
+           SkGraphics::GetResourceCacheTotalBytesUsed() / (double)(1 << 20));
+
+    sk_dump_surface(sk, workers[0].surf, "rt.png");
+
+    for (struct canvas_raster_worker &worker : workers) {
+        sk_scene_cleanup(sk, &worker.scene);
+        worker.surf.reset();
+    }
+}
+
+/* renders in a child process per cpu level; this runs before init */
+static void
+canvas_raster_test_draw_cpu_levels(struct canvas_raster_test *test)
+{
+    struct sk *sk = &test->sk;
+
+    char name[64];
+    snprintf(name, sizeof(name), "raster/%s", sk_scene_get_name(test->scene_type));
+
+    const auto draw = [&](enum sk_cpu_level_type level) -> uint64_t {
+        canvas_raster_test_init(test);
+        SkCanvas *canvas = test->surf->getCanvas();
+
+        /* the first frame is not timed; all levels dump the same last frame */
+        sk_scene_draw(sk, &test->scene, canvas, 0);
+        const uint64_t begin = sk_now_ns();
+        for (uint32_t frame = 1; frame <= test->frame_count; frame++)
+            sk_scene_draw(sk, &test->scene, canvas, frame);
+        const uint64_t ns = sk_now_ns() - begin;
+
+        char filename[64];
+        sk_cpu_level_get_filename(level, filename, sizeof(filename));
+        sk_dump_surface(sk, test->surf, filename);
+        canvas_raster_test_cleanup(test);
+
+        return ns;
+    };
+    struct sk_cpu_level_results results;
+    sk_cpu_levels_run(name, draw, &results);
+
+    sk_init(sk, NULL);
+    sk_cpu_levels_report(sk, name, &results, test->frame_count, "frame");
+    sk_cleanup(sk);
+}
+
 int
 main(int argc, const char **argv)
 {
     struct canvas_raster_test test = {
         .width = 300,
         .height = 300,
+        .scene_type = SK_SCENE_CIRCLE,
+        .frame_count = 1,
+        .sequence = false,
+        .thread_count = 0,
+        .mixed = false,
+        .warmup = false,
+        .cpu_levels = false,
     };
 
+    int opt;
+    while ((opt = getopt(argc, (char *const *)argv, "s:n:at:mg:wc")) != -1) {
+        switch (opt) {
+        case 's':
+            test.scene_type = sk_scene_parse_type(optarg);
+            break;
+        case 'g':
+            if (sscanf(optarg, "%ux%u", &test.width, &test.height) != 2)
+                sk_die("bad geometry %s", optarg);
+            break;
+        case 'n':
+            test.frame_count = atoi(optarg);
+            break;
+        case 'a':
+            test.sequence = true;
+            break;
+        case 't':
+            test.thread_count = atoi(optarg);
+            break;
+        case 'm':
+            test.mixed = true;
+            break;
+        case 'w':
+            test.warmup = true;
+            break;
+        case 'c':
+            test.cpu_levels = true;
+            break;
+        default:
+            sk_die("usage: %s [-s <scene>] [-g <width>x<height>] [-n <frame-count>] [-w] "
+                   "[-a] [-t <thread-count> [-m]] [-c]",
+                   argv[0]);
+        }
+    }
+    if (!test.width || !test.height || !test.frame_count)
+        sk_die("geometry and frame count must be positive");
+
+    /* every level runs in its own process, before skia is initialized */
+    if (test.cpu_levels) {
+        canvas_raster_test_draw_cpu_levels(&test);
+        return 0;
+    }
+
     canvas_raster_test_init(&test);
-    canvas_raster_test_draw(&test);
+    if (test.warmup)
+        canvas_raster_test_warmup(&test);
+    sk_alloc_set_phase(SK_ALLOC_PHASE_DRAW);
+    if (test.sequence)
+        canvas_raster_test_draw_sequences(&test);
+    else if (test.thread_count)
+        canvas_raster_test_draw_scaling(&test);
+    else
+        canvas_raster_test_draw(&test);
+    sk_alloc_set_phase(SK_ALLOC_PHASE_CLEANUP);
     canvas_raster_test_cleanup(&test);
 
     return 0;
@@ -5,14 +5,18 @@
 
 #include "include/svg/SkSVGCanvas.h"
 #include "skutil.h"
+#include "skutil_scene.h"
 
 struct canvas_svg_test {
     uint32_t width;
     uint32_t height;
+    enum sk_scene_type scene_type;
+    uint32_t frame_count;
 
     struct sk sk;
     std::unique_ptr<SkFILEWStream> writer;
     std::unique_ptr<SkCanvas> canvas;
+    struct sk_scene scene;
 };
 
 static void
@@ -33,6 +37,7 @@ canvas_svg_test_init(struct canvas_svg_test *test)
 
     sk_init(sk, NULL);
     canvas_svg_test_init_canvas(test);
+    sk_scene_init(sk, &test->scene, test->scene_type, test->width, test->height);
 }
 
 static void
@@ -40,6 +45,7 @@ canvas_svg_test_cleanup(struct canvas_svg_test *test)
 {
     struct sk *sk = &test->sk;
 
+    sk_scene_cleanup(sk, &test->scene);
     test->canvas.reset();
     test->writer.reset();
     sk_cleanup(sk);
@@ -48,13 +54,19 @@ canvas_svg_test_cleanup(struct canvas_svg_test *test)
 static void
 canvas_svg_test_draw(struct canvas_svg_test *test)
 {
+    struct sk *sk = &test->sk;
+
     SkCanvas *canvas = test->canvas.get();
-    canvas->clear(SK_ColorWHITE);
 
-    SkPaint paint;
-    paint.setColor(SK_ColorRED);
-    paint.setAntiAlias(true);
-    canvas->drawCircle(test->width / 2, test->height / 2, 30, paint);
+    /* every frame is appended to the same document */
+    const uint64_t begin = sk_now_ns();
+    for (uint32_t i = 0; i < test->frame_count; i++) {
+        sk_scene_draw(sk, &test->scene, canvas, i);
+        sk_report_first_pixel(sk);
+    }
+    const uint64_t end = sk_now_ns();
+
+    sk_scene_report(sk, &test->scene, "svg", test->frame_count, end - begin);
 }
 
 int
@@ -63,10 +75,30 @@ main(int argc, const char **argv)
     struct canvas_svg_test test = {
         .width = 300,
         .height = 300,
+        .scene_type = SK_SCENE_CIRCLE,
+        .frame_count = 1,
     };
 
+    int opt;
+    while ((opt = getopt(argc, (char *const *)argv, "s:n:")) != -1) {
+        switch (opt) {
+        case 's':
+            test.scene_type = sk_scene_parse_type(optarg);
+            break;
+        case 'n':
+            test.frame_count = atoi(optarg);
+            break;
+        default:
+            sk_die("usage: %s [-s <scene>] [-n <frame-count>]", argv[0]);
+        }
+    }
+    if (!test.frame_count)
+        sk_die("frame count must be positive");
+
     canvas_svg_test_init(&test);
+    sk_alloc_set_phase(SK_ALLOC_PHASE_DRAW);
     canvas_svg_test_draw(&test);
+    sk_alloc_set_phase(SK_ALLOC_PHASE_CLEANUP);
     canvas_svg_test_cleanup(&test);
 
     return 0;
@@ -0,0 +1,144 @@
+/*
+ * Copyright 2023 Google LLC
+ * SPDX-License-Identifier: MIT
+ */
+
+#include "skutil.h"
+
+struct compare_test {
+    uint32_t width;
+    uint32_t height;
+    const char *golden;
+    struct sk_compare_params params;
+
+    struct sk sk;
+    sk_sp<SkSurface> surf;
+};
+
+static void
+compare_test_init(struct compare_test *test)
+{
+    struct sk *sk = &test->sk;
+
+    sk_init(sk, NULL);
+    test->surf = sk_create_surface_raster(sk, test->width, test->height);
+}
+
+static void
+compare_test_cleanup(struct compare_test *test)
+{
+    struct sk *sk = &test->sk;
+
+    test->surf.reset();
+    sk_cleanup(sk);
+}
+
+static void
+compare_test_draw(struct compare_test *test)
+{
+    struct sk *sk = &test->sk;
+
+    SkCanvas *canvas = test->surf->getCanvas();
+    canvas->clear(SK_ColorWHITE);
+
+    SkPaint paint;
+    paint.setColor(SK_ColorRED);
+    paint.setAntiAlias(true);
+    canvas->drawCircle(test->width / 2, test->height / 2, 30, paint);
+    sk_report_first_pixel(sk);
+
+    const struct sk_compare_result res =
+        sk_compare_surface(sk, test->surf, test->golden, &test->params, "diff.png");
+    sk_log("max diff (%d, %d, %d, %d), %" PRIu64 " pixels differ", res.max_diff[0],
+           res.max_diff[1], res.max_diff[2], res.max_diff[3], res.diff_count);
+}
+
+static void
+compare_test_bench(struct compare_test *test, uint32_t width, uint32_t height)
+{
+    struct sk *sk = &test->sk;
+
+    const SkImageInfo info = sk_make_image_info(sk, width, height);
+    SkBitmap a;
+    SkBitmap b;
+    SkBitmap diff;
+    a.allocPixels(info);
+    b.allocPixels(info);
+    diff.allocPixels(info);
+
+    /* every 64th pixel differs */
+    uint32_t *a_pixels = a.getAddr32(0, 0);
+    uint32_t *b_pixels = b.getAddr32(0, 0);
+    const size_t pixel_count = (size_t)width * height;
+    for (size_t i = 0; i < pixel_count; i++) {
+        a_pixels[i] = (uint32_t)(i * 2654435761u);
+        b_pixels[i] = i % 64 ? a_pixels[i] : a_pixels[i] ^ 0x00ff00ff;
+    }
+
+    const int iter_count = 20;
+    const double gb = (double)a.computeByteSize() * 2 * iter_count / 1e9;
+
+    uint64_t begin = sk_now_ns();
+    for (int i = 0; i < iter_count; i++)
+        sk_compare_pixmaps(sk, a.pixmap(), b.pixmap(), &test->params, NULL);
+    const double diff_off_sec = (double)(sk_now_ns() - begin) / 1e9;
+
+    begin = sk_now_ns();
+    for (int i = 0; i < iter_count; i++)
+        sk_compare_pixmaps(sk, a.pixmap(), b.pixmap(), &test->params, &diff.pixmap());
+    const double diff_on_sec = (double)(sk_now_ns() - begin) / 1e9;
+
+    sk_log("%ux%u: %.2f GB/s, %.2f GB/s with diff image", width, height, gb / diff_off_sec,
+           gb / diff_on_sec);
+}
+
+int
+main(int argc, const char **argv)
+{
+    struct compare_test test = {
+        .width = 300,
+        .height = 300,
+        .golden = NULL,
+        .params = {},
+    };
+
+    int opt;
+    while ((opt = getopt(argc, (char *const *)argv, "t:")) != -1) {
+        switch (opt) {
+        case 't': {
+            /* one value for all channels, or one per channel */
+            unsigned int tol[4];
+            const int count = sscanf(optarg, "%u,%u,%u,%u", &tol[0], &tol[1], &tol[2], &tol[3]);
+            if (count == 1)
+                tol[1] = tol[2] = tol[3] = tol[0];
+            else if (count != 4)
+                sk_die("bad tolerance %s", optarg);
+            for (int i = 0; i < 4; i++) {
+                if (tol[i] > 255)
+                    sk_die("bad tolerance %s", optarg);
+                test.params.tolerance[i] = tol[i];
+            }
+            break;
+        }
+        default:
+            sk_die("usage: %s [-t <tol>|<r>,<g>,<b>,<a>] [<golden-file>]", argv[0]);
+        }
+    }
+    if (optind < argc - 1)
+        sk_die("usage: %s [-t <tol>|<r>,<g>,<b>,<a>] [<golden-file>]", argv[0]);
+
+    test.golden = optind == argc - 1 ? argv[optind] : NULL;
+
+    compare_test_init(&test);
+    sk_alloc_set_phase(SK_ALLOC_PHASE_DRAW);
+    if (test.golden) {
+        compare_test_draw(&test);
+    } else {
+        compare_test_bench(&test, 3840, 2160);
+        compare_test_bench(&test, 7680, 4320);
+    }
+    sk_alloc_set_phase(SK_ALLOC_PHASE_CLEANUP);
+    compare_test_cleanup(&test);
+
+    return 0;
+}
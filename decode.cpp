@@ -0,0 +1,109 @@
+/*
+ * Copyright 2023 Google LLC
+ * SPDX-License-Identifier: MIT
+ */
+
+#include "skutil.h"
+
+struct decode_test {
+    const char *filename;
+    uint32_t max_width;
+    uint32_t max_height;
+    SkIRect subset;
+
+    struct sk sk;
+};
+
+static void
+decode_test_init(struct decode_test *test)
+{
+    struct sk *sk = &test->sk;
+
+    sk_init(sk, NULL);
+}
+
+static void
+decode_test_cleanup(struct decode_test *test)
+{
+    struct sk *sk = &test->sk;
+
+    sk_cleanup(sk);
+}
+
+/* decodes once with params and reports the time and the peak rss of the decode */
+static void
+decode_test_run(struct decode_test *test, const char *name, const struct sk_decode_params *params)
+{
+    struct sk *sk = &test->sk;
+
+    sk_reset_peak_rss();
+    const size_t base_rss = sk_get_peak_rss();
+
+    const uint64_t begin = sk_now_ns();
+    sk_sp<SkImage> img = sk_load_image(sk, test->filename, params);
+    const uint64_t end = sk_now_ns();
+
+    const size_t peak_rss = sk_get_peak_rss();
+    sk_log("%-8s %5dx%-5d %9.3f ms, peak rss +%.1f MiB", name, img->width(), img->height(),
+           (end - begin) / 1e6, (double)(peak_rss - std::min(peak_rss, base_rss)) / (1 << 20));
+}
+
+int
+main(int argc, const char **argv)
+{
+    struct decode_test test = {
+        .filename = NULL,
+        .max_width = 1024,
+        .max_height = 1024,
+        .subset = SkIRect::MakeEmpty(),
+    };
+
+    int opt;
+    while ((opt = getopt(argc, (char *const *)argv, "m:r:")) != -1) {
+        switch (opt) {
+        case 'm':
+            if (sscanf(optarg, "%ux%u", &test.max_width, &test.max_height) != 2)
+                sk_die("bad max size %s", optarg);
+            break;
+        case 'r': {
+            int x, y, w, h;
+            if (sscanf(optarg, "%d,%d,%d,%d", &x, &y, &w, &h) != 4)
+                sk_die("bad region %s", optarg);
+            test.subset = SkIRect::MakeXYWH(x, y, w, h);
+            break;
+        }
+        default:
+            sk_die("usage: %s [-m <max-w>x<max-h>] [-r <x>,<y>,<w>,<h>] <image-file>", argv[0]);
+        }
+    }
+    if (optind != argc - 1)
+        sk_die("usage: %s [-m <max-w>x<max-h>] [-r <x>,<y>,<w>,<h>] <image-file>", argv[0]);
+
+    test.filename = argv[optind];
+
+    decode_test_init(&test);
+    sk_alloc_set_phase(SK_ALLOC_PHASE_DRAW);
+
+    const struct sk_decode_params sampled = {
+        .max_width = test.max_width,
+        .max_height = test.max_height,
+    };
+    struct sk_decode_params streamed = sampled;
+    streamed.streamed = true;
+
+    decode_test_run(&test, "full", NULL);
+    decode_test_run(&test, "sampled", &sampled);
+    decode_test_run(&test, "streamed", &streamed);
+
+    if (!test.subset.isEmpty()) {
+        const struct sk_decode_params subset = {
+            .subset = test.subset,
+        };
+        decode_test_run(&test, "subset", &subset);
+    }
+
+    sk_alloc_set_phase(SK_ALLOC_PHASE_CLEANUP);
+    decode_test_cleanup(&test);
+
+    return 0;
+}
@@ -63,6 +63,8 @@ drawable_test_draw(struct drawable_test *test)
     SkCanvas *canvas = test->surf->getCanvas();
     canvas->drawDrawable(test->drawable.get());
 
+    sk_report_first_pixel(sk);
+
     sk_dump_surface(sk, test->surf, "rt.png");
 }
 
@@ -75,7 +77,9 @@ main(int argc, const char **argv)
     };
 
     drawable_test_init(&test);
+    sk_alloc_set_phase(SK_ALLOC_PHASE_DRAW);
     drawable_test_draw(&test);
+    sk_alloc_set_phase(SK_ALLOC_PHASE_CLEANUP);
     drawable_test_cleanup(&test);
 
     return 0;
@@ -0,0 +1,129 @@
+/*
+ * Copyright 2023 Google LLC
+ * SPDX-License-Identifier: MIT
+ */
+
+#include "skutil.h"
+
+struct executor_test {
+    uint32_t width;
+    uint32_t height;
+    uint32_t tile_size;
+    uint32_t max_thread_count;
+
+    struct sk sk;
+    sk_sp<SkSurface> surf;
+    SkPixmap pixmap;
+};
+
+static void
+executor_test_init(struct executor_test *test)
+{
+    struct sk *sk = &test->sk;
+
+    /* the pools are created by executor_test_encode */
+    sk_init(sk, NULL);
+    test->surf = sk_create_surface_raster(sk, test->width, test->height);
+}
+
+static void
+executor_test_cleanup(struct executor_test *test)
+{
+    struct sk *sk = &test->sk;
+
+    test->surf.reset();
+    sk_cleanup(sk);
+}
+
+static void
+executor_test_draw(struct executor_test *test)
+{
+    struct sk *sk = &test->sk;
+
+    SkCanvas *canvas = test->surf->getCanvas();
+    canvas->clear(SK_ColorWHITE);
+
+    SkPaint paint;
+    paint.setAntiAlias(true);
+    for (uint32_t i = 0; i < 256; i++) {
+        paint.setColor(SkColorSetARGB(0xff, i * 7, i * 13, i * 29));
+        canvas->drawCircle((i * 97) % test->width, (i * 53) % test->height, 10 + i % 100,
+                           paint);
+    }
+
+    sk_report_first_pixel(sk);
+
+    if (!test->surf->peekPixels(&test->pixmap))
+        sk_die("failed to peek pixels");
+}
+
+/* encodes every tile to png on a pool of thread_count workers */
+static uint64_t
+executor_test_encode(struct executor_test *test, uint32_t thread_count)
+{
+    struct sk *sk = &test->sk;
+    sk_executor executor(thread_count, sk->params.pin_threads);
+
+    const uint32_t tiles_x = test->width / test->tile_size;
+    const uint32_t tiles_y = test->height / test->tile_size;
+    uint32_t remaining = tiles_x * tiles_y;
+    std::mutex mutex;
+    std::condition_variable cond;
+
+    const uint64_t begin = sk_now_ns();
+    for (uint32_t ty = 0; ty < tiles_y; ty++) {
+        for (uint32_t tx = 0; tx < tiles_x; tx++) {
+            const SkIRect rect = SkIRect::MakeXYWH(tx * test->tile_size, ty * test->tile_size,
+                                                   test->tile_size, test->tile_size);
+            executor.add([test, rect, &remaining, &mutex, &cond] {
+                SkPixmap tile;
+                test->pixmap.extractSubset(&tile, rect);
+
+                SkDynamicMemoryWStream writer;
+                if (!SkPngEncoder::Encode(&writer, tile, SkPngEncoder::Options()))
+                    sk_die("failed to encode tile");
+
+                std::lock_guard<std::mutex> lock(mutex);
+                if (!--remaining)
+                    cond.notify_one();
+            });
+        }
+    }
+
+    /* sleep rather than spin so that the main thread does not take a core from the pool */
+    {
+        std::unique_lock<std::mutex> lock(mutex);
+        cond.wait(lock, [&remaining] { return !remaining; });
+    }
+
+    return sk_now_ns() - begin;
+}
+
+int
+main(int argc, const char **argv)
+{
+    struct executor_test test = {
+        .width = 2048,
+        .height = 2048,
+        .tile_size = 128,
+        .max_thread_count = 64,
+    };
+
+    executor_test_init(&test);
+    sk_alloc_set_phase(SK_ALLOC_PHASE_DRAW);
+    executor_test_draw(&test);
+
+    uint64_t base_ns = 0;
+    for (uint32_t count = 1; count <= test.max_thread_count; count *= 2) {
+        const uint64_t ns = executor_test_encode(&test, count);
+        if (count == 1)
+            base_ns = ns;
+
+        sk_log("%2u workers: %.3f ms, %.2fx", count, (double)ns / 1e6, (double)base_ns / ns);
+    }
+
+    sk_alloc_set_phase(SK_ALLOC_PHASE_CLEANUP);
+    executor_test_cleanup(&test);
+
+    return 0;
+}
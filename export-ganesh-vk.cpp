@@ -0,0 +1,440 @@
+/*
+ * Copyright 2023 Google LLC
+ * SPDX-License-Identifier: MIT
+ */
+
+#include "skutil.h"
+#include "skutil_scene.h"
+#include "skutil_vk.h"
+
+#include <sys/socket.h>
+#include <sys/wait.h>
+
+/* the producer renders into one image while the consumer samples the other */
+#define EXPORT_GANESH_VK_IMAGE_COUNT 2
+
+enum export_ganesh_vk_msg_type {
+    EXPORT_GANESH_VK_MSG_SETUP,
+    EXPORT_GANESH_VK_MSG_FRAME,
+    EXPORT_GANESH_VK_MSG_DONE,
+    EXPORT_GANESH_VK_MSG_ACK,
+};
+
+struct export_ganesh_vk_msg {
+    enum export_ganesh_vk_msg_type type;
+    uint32_t frame;
+    uint32_t image;
+
+    /* for EXPORT_GANESH_VK_MSG_SETUP */
+    uint32_t width;
+    uint32_t height;
+    uint64_t size;
+    uint32_t mem_type;
+};
+
+struct export_ganesh_vk_test {
+    uint32_t width;
+    uint32_t height;
+    enum sk_scene_type scene_type;
+    uint32_t frame_count;
+
+    int sock;
+    pid_t consumer;
+
+    struct sk sk;
+    struct sk_vk vk;
+    sk_sp<GrDirectContext> ctx;
+    struct sk_vk_image imgs[EXPORT_GANESH_VK_IMAGE_COUNT];
+    sk_sp<SkSurface> surfs[EXPORT_GANESH_VK_IMAGE_COUNT];
+    VkSemaphore sem;
+    struct sk_scene scene;
+};
+
+static void
+export_ganesh_vk_test_send(struct export_ganesh_vk_test *test,
+                           const struct export_ganesh_vk_msg *msg,
+                           int fd)
+{
+    struct iovec iov = {
+        .iov_base = (void *)msg,
+        .iov_len = sizeof(*msg),
+    };
+    char cmsg_buf[CMSG_SPACE(sizeof(int))] = {};
+    struct msghdr hdr = {
+        .msg_iov = &iov,
+        .msg_iovlen = 1,
+    };
+
+    if (fd >= 0) {
+        hdr.msg_control = cmsg_buf;
+        hdr.msg_controllen = sizeof(cmsg_buf);
+
+        struct cmsghdr *cmsg = CMSG_FIRSTHDR(&hdr);
+        cmsg->cmsg_level = SOL_SOCKET;
+        cmsg->cmsg_type = SCM_RIGHTS;
+        cmsg->cmsg_len = CMSG_LEN(sizeof(int));
+        memcpy(CMSG_DATA(cmsg), &fd, sizeof(int));
+    }
+
+    if (sendmsg(test->sock, &hdr, 0) != sizeof(*msg))
+        sk_die("failed to send message");
+}
+
+/* fd is set to -1 when the message carries no fd */
+static void
+export_ganesh_vk_test_recv(struct export_ganesh_vk_test *test,
+                           struct export_ganesh_vk_msg *msg,
+                           int *fd)
+{
+    struct iovec iov = {
+        .iov_base = msg,
+        .iov_len = sizeof(*msg),
+    };
+    char cmsg_buf[CMSG_SPACE(sizeof(int))] = {};
+    struct msghdr hdr = {
+        .msg_iov = &iov,
+        .msg_iovlen = 1,
+        .msg_control = cmsg_buf,
+        .msg_controllen = sizeof(cmsg_buf),
+    };
+
+    if (recvmsg(test->sock, &hdr, MSG_CMSG_CLOEXEC) != sizeof(*msg))
+        sk_die("failed to receive message");
+
+    struct cmsghdr *cmsg = CMSG_FIRSTHDR(&hdr);
+    const bool has_fd = cmsg && cmsg->cmsg_type == SCM_RIGHTS;
+    if (fd) {
+        *fd = -1;
+        if (has_fd)
+            memcpy(fd, CMSG_DATA(cmsg), sizeof(int));
+    } else if (has_fd) {
+        sk_die("unexpected fd received");
+    }
+}
+
+/* acks arrive in frame order, once the consumer is done with the frame */
+static void
+export_ganesh_vk_test_recv_ack(struct export_ganesh_vk_test *test, uint32_t frame)
+{
+    struct export_ganesh_vk_msg ack;
+    export_ganesh_vk_test_recv(test, &ack, NULL);
+    if (ack.type != EXPORT_GANESH_VK_MSG_ACK || ack.frame != frame)
+        sk_die("unexpected ack");
+}
+
+static void
+export_ganesh_vk_test_init(struct export_ganesh_vk_test *test)
+{
+    struct sk *sk = &test->sk;
+    struct sk_vk *vk = &test->vk;
+
+    sk_init(sk, NULL);
+    sk_vk_init(vk);
+
+    const GrVkBackendContext backend = sk_vk_make_backend_context(vk);
+    test->ctx = sk_create_context_ganesh_vk(sk, backend);
+
+    for (struct sk_vk_image &img : test->imgs) {
+        img.width = test->width;
+        img.height = test->height;
+        img.format = VK_FORMAT_R8G8B8A8_UNORM;
+        img.usage = VK_IMAGE_USAGE_COLOR_ATTACHMENT_BIT | VK_IMAGE_USAGE_SAMPLED_BIT |
+                    VK_IMAGE_USAGE_TRANSFER_SRC_BIT | VK_IMAGE_USAGE_TRANSFER_DST_BIT;
+    }
+}
+
+static void
+export_ganesh_vk_test_cleanup(struct export_ganesh_vk_test *test)
+{
+    struct sk *sk = &test->sk;
+    struct sk_vk *vk = &test->vk;
+
+    for (sk_sp<SkSurface> &surf : test->surfs)
+        surf.reset();
+    test->ctx.reset();
+    for (struct sk_vk_image &img : test->imgs)
+        sk_vk_destroy_external_image(vk, &img);
+    sk_vk_destroy_semaphore(vk, test->sem);
+    sk_vk_cleanup(vk);
+    sk_cleanup(sk);
+}
+
+/* the producer releases every frame to VK_QUEUE_FAMILY_EXTERNAL */
+static sk_sp<SkImage>
+export_ganesh_vk_test_borrow(struct export_ganesh_vk_test *test, const GrBackendTexture &tex)
+{
+    sk_sp<SkImage> img =
+        SkImages::BorrowTextureFrom(test->ctx.get(), tex, kTopLeft_GrSurfaceOrigin,
+                                    kRGBA_8888_SkColorType, kPremul_SkAlphaType, NULL);
+    if (!img)
+        sk_die("failed to wrap imported image");
+    return img;
+}
+
+static void
+export_ganesh_vk_test_consume(struct export_ganesh_vk_test *test)
+{
+    struct sk *sk = &test->sk;
+    struct sk_vk *vk = &test->vk;
+
+    for (uint32_t i = 0; i < EXPORT_GANESH_VK_IMAGE_COUNT; i++) {
+        struct export_ganesh_vk_msg msg;
+        int fd;
+        export_ganesh_vk_test_recv(test, &msg, &fd);
+        if (msg.type != EXPORT_GANESH_VK_MSG_SETUP || msg.image != i || fd < 0)
+            sk_die("unexpected message");
+
+        if (!i) {
+            test->width = msg.width;
+            test->height = msg.height;
+            export_ganesh_vk_test_init(test);
+            sk_alloc_set_phase(SK_ALLOC_PHASE_DRAW);
+        }
+
+        test->imgs[i].size = msg.size;
+        test->imgs[i].mem_type = msg.mem_type;
+        sk_vk_create_external_image(vk, fd, &test->imgs[i]);
+    }
+    test->sem = sk_vk_create_semaphore(vk, false);
+
+    const skgpu::MutableTextureState release(VK_IMAGE_LAYOUT_GENERAL, VK_QUEUE_FAMILY_EXTERNAL);
+    uint32_t pixel;
+    const SkPixmap pixmap(sk_make_image_info(sk, 1, 1), &pixel, sizeof(pixel));
+
+    /* wait for each frame on the gpu and sample a pixel, as a compositor would */
+    uint32_t frame_count = 0;
+    uint32_t last_image = 0;
+    while (true) {
+        struct export_ganesh_vk_msg msg;
+        int fd;
+        export_ganesh_vk_test_recv(test, &msg, &fd);
+        if (msg.type == EXPORT_GANESH_VK_MSG_DONE)
+            break;
+        if (msg.type != EXPORT_GANESH_VK_MSG_FRAME || msg.image >= EXPORT_GANESH_VK_IMAGE_COUNT)
+            sk_die("unexpected message");
+
+        /* no fd means the frame had already completed when it was sent */
+        if (fd >= 0) {
+            sk_vk_import_semaphore_fd(vk, test->sem, fd);
+            GrBackendSemaphore sem;
+            sem.initVulkan(test->sem);
+            if (!test->ctx->wait(1, &sem, false))
+                sk_die("failed to wait for frame");
+        }
+
+        const GrBackendTexture tex =
+            sk_vk_make_backend_texture(vk, &test->imgs[msg.image], VK_IMAGE_LAYOUT_GENERAL,
+                                       VK_QUEUE_FAMILY_EXTERNAL);
+        {
+            sk_sp<SkImage> img = export_ganesh_vk_test_borrow(test, tex);
+            if (!img->readPixels(test->ctx.get(), pixmap, test->width / 2, test->height / 2))
+                sk_die("failed to sample imported image");
+        }
+
+        /*
+         * Hand the image back.  The consumer keeps a cpu wait on purpose: the ack
+         * lets the producer render into the image again, so the read and the
+         * release must have executed by then.
+         */
+        if (!test->ctx->setBackendTextureState(tex, release))
+            sk_die("failed to release imported image");
+        test->ctx->submit(GrSyncCpu::kYes);
+
+        frame_count++;
+        last_image = msg.image;
+
+        const struct export_ganesh_vk_msg ack = {
+            .type = EXPORT_GANESH_VK_MSG_ACK,
+            .frame = msg.frame,
+        };
+        export_ganesh_vk_test_send(test, &ack, -1);
+    }
+
+    const GrBackendTexture tex = sk_vk_make_backend_texture(
+        vk, &test->imgs[last_image], VK_IMAGE_LAYOUT_GENERAL, VK_QUEUE_FAMILY_EXTERNAL);
+    sk_sp<SkImage> img = export_ganesh_vk_test_borrow(test, tex);
+
+    SkBitmap bitmap;
+    bitmap.allocPixels(sk_make_image_info(sk, test->width, test->height));
+    if (!img->readPixels(test->ctx.get(), bitmap.pixmap(), 0, 0))
+        sk_die("failed to read imported image");
+    img.reset();
+
+    sk_dump_pixmap(sk, bitmap.pixmap(), "rt.png");
+    sk_log("consumer: waited for and sampled %u frames", frame_count);
+
+    const struct export_ganesh_vk_msg ack = { .type = EXPORT_GANESH_VK_MSG_ACK };
+    export_ganesh_vk_test_send(test, &ack, -1);
+
+    sk_alloc_set_phase(SK_ALLOC_PHASE_CLEANUP);
+    export_ganesh_vk_test_cleanup(test);
+}
+
+/* the same frames through the sk_dump_surface readback, without encoding */
+static uint64_t
+export_ganesh_vk_test_draw_readback(struct export_ganesh_vk_test *test)
+{
+    struct sk *sk = &test->sk;
+
+    sk_sp<SkSurface> surf = sk_create_surface_ganesh(sk, test->ctx, test->width, test->height);
+    SkCanvas *canvas = surf->getCanvas();
+    SkBitmap bitmap;
+
+    const uint64_t begin = sk_now_ns();
+    for (uint32_t i = 0; i < test->frame_count; i++) {
+        sk_scene_draw(sk, &test->scene, canvas, i);
+        sk_read_surface(sk, surf, &bitmap);
+    }
+    return sk_now_ns() - begin;
+}
+
+static void
+export_ganesh_vk_test_produce(struct export_ganesh_vk_test *test)
+{
+    struct sk *sk = &test->sk;
+    struct sk_vk *vk = &test->vk;
+
+    export_ganesh_vk_test_init(test);
+    for (uint32_t i = 0; i < EXPORT_GANESH_VK_IMAGE_COUNT; i++) {
+        struct sk_vk_image *img = &test->imgs[i];
+        sk_vk_create_external_image(vk, -1, img);
+
+        const GrBackendTexture tex = sk_vk_make_backend_texture(
+            vk, img, VK_IMAGE_LAYOUT_UNDEFINED, VK_QUEUE_FAMILY_IGNORED);
+        test->surfs[i] =
+            SkSurfaces::WrapBackendTexture(test->ctx.get(), tex, kTopLeft_GrSurfaceOrigin, 1,
+                                           kRGBA_8888_SkColorType, NULL, NULL);
+        if (!test->surfs[i])
+            sk_die("failed to wrap exportable image");
+
+        const struct export_ganesh_vk_msg setup = {
+            .type = EXPORT_GANESH_VK_MSG_SETUP,
+            .image = i,
+            .width = test->width,
+            .height = test->height,
+            .size = img->size,
+            .mem_type = img->mem_type,
+        };
+        const int fd = sk_vk_export_image_fd(vk, img);
+        export_ganesh_vk_test_send(test, &setup, fd);
+        close(fd);
+    }
+    test->sem = sk_vk_create_external_semaphore(vk);
+    sk_scene_init(sk, &test->scene, test->scene_type, test->width, test->height);
+    sk_alloc_set_phase(SK_ALLOC_PHASE_DRAW);
+
+    /*
+     * Release the image to the consumer after every frame, with a sync fd for
+     * the rendering instead of a cpu wait.  The producer only blocks on the ack
+     * of the frame that last used the image it is about to render into.
+     */
+    const skgpu::MutableTextureState state(VK_IMAGE_LAYOUT_GENERAL, VK_QUEUE_FAMILY_EXTERNAL);
+    GrBackendSemaphore sem;
+    sem.initVulkan(test->sem);
+    GrFlushInfo flush_info;
+    flush_info.fNumSemaphores = 1;
+    flush_info.fSignalSemaphores = &sem;
+
+    const uint64_t begin = sk_now_ns();
+    for (uint32_t i = 0; i < test->frame_count; i++) {
+        const uint32_t image = i % EXPORT_GANESH_VK_IMAGE_COUNT;
+        if (i >= EXPORT_GANESH_VK_IMAGE_COUNT) {
+            export_ganesh_vk_test_recv_ack(test, i - EXPORT_GANESH_VK_IMAGE_COUNT);
+            sk_report_first_pixel(sk);
+        }
+
+        SkSurface *surf = test->surfs[image].get();
+        sk_scene_draw(sk, &test->scene, surf->getCanvas(), i);
+        sk_alloc_set_phase(SK_ALLOC_PHASE_FLUSH);
+        if (test->ctx->flush(surf, flush_info, &state) != GrSemaphoresSubmitted::kYes)
+            sk_die("failed to signal frame semaphore");
+        test->ctx->submit(GrSyncCpu::kNo);
+        sk_alloc_set_phase(SK_ALLOC_PHASE_DRAW);
+
+        const struct export_ganesh_vk_msg msg = {
+            .type = EXPORT_GANESH_VK_MSG_FRAME,
+            .frame = i,
+            .image = image,
+        };
+        const int fd = sk_vk_export_semaphore_fd(vk, test->sem);
+        export_ganesh_vk_test_send(test, &msg, fd);
+        if (fd >= 0)
+            close(fd);
+    }
+    const uint32_t pending = std::min(test->frame_count, (uint32_t)EXPORT_GANESH_VK_IMAGE_COUNT);
+    for (uint32_t i = test->frame_count - pending; i < test->frame_count; i++) {
+        export_ganesh_vk_test_recv_ack(test, i);
+        sk_report_first_pixel(sk);
+    }
+    const uint64_t end = sk_now_ns();
+
+    sk_scene_report(sk, &test->scene, "ganesh-vk-export", test->frame_count, end - begin);
+
+    const struct export_ganesh_vk_msg done = { .type = EXPORT_GANESH_VK_MSG_DONE };
+    export_ganesh_vk_test_send(test, &done, -1);
+    export_ganesh_vk_test_recv_ack(test, 0);
+
+    const uint64_t readback_ns = export_ganesh_vk_test_draw_readback(test);
+    sk_log("ganesh-vk-export: export %.3f ms/frame, readback %.3f ms/frame",
+           (double)(end - begin) / test->frame_count / 1e6,
+           (double)readback_ns / test->frame_count / 1e6);
+
+    sk_alloc_set_phase(SK_ALLOC_PHASE_CLEANUP);
+    sk_scene_cleanup(sk, &test->scene);
+    export_ganesh_vk_test_cleanup(test);
+}
+
+int
+main(int argc, const char **argv)
+{
+    struct export_ganesh_vk_test test = {
+        .width = 300,
+        .height = 300,
+        .scene_type = SK_SCENE_CIRCLE,
+        .frame_count = 1,
+    };
+
+    int opt;
+    while ((opt = getopt(argc, (char *const *)argv, "s:n:")) != -1) {
+        switch (opt) {
+        case 's':
+            test.scene_type = sk_scene_parse_type(optarg);
+            break;
+        case 'n':
+            test.frame_count = atoi(optarg);
+            break;
+        default:
+            sk_die("usage: %s [-s <scene>] [-n <frame-count>]", argv[0]);
+        }
+    }
+    if (!test.frame_count)
+        sk_die("frame count must be positive");
+
+    /* fork the consumer stand-in before any Vulkan or Skia state exists */
+    int socks[2];
+    if (socketpair(AF_UNIX, SOCK_SEQPACKET | SOCK_CLOEXEC, 0, socks))
+        sk_die("failed to create socket pair");
+
+    test.consumer = fork();
+    if (test.consumer < 0)
+        sk_die("failed to fork");
+
+    if (!test.consumer) {
+        close(socks[0]);
+        test.sock = socks[1];
+        export_ganesh_vk_test_consume(&test);
+        close(test.sock);
+        return 0;
+    }
+
+    close(socks[1]);
+    test.sock = socks[0];
+    export_ganesh_vk_test_produce(&test);
+    close(test.sock);
+
+    int status;
+    if (waitpid(test.consumer, &status, 0) < 0 || !WIFEXITED(status) || WEXITSTATUS(status))
+        sk_die("consumer failed");
+
+    return 0;
+}
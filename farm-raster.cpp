@@ -0,0 +1,296 @@
+/*
+ * Copyright 2023 Google LLC
+ * SPDX-License-Identifier: MIT
+ */
+
+#include "include/core/SkPicture.h"
+#include "include/core/SkPictureRecorder.h"
+#include "skutil.h"
+#include "skutil_scene.h"
+
+#include <sys/mman.h>
+#include <sys/wait.h>
+
+/* lives in a shared mapping and is updated by all workers */
+struct farm_raster_shared {
+    std::atomic<uint32_t> next_tile;
+};
+
+struct farm_raster_test {
+    uint32_t width;
+    uint32_t height;
+    uint32_t tile_size;
+    enum sk_scene_type scene_type;
+    uint32_t max_process_count;
+
+    struct sk sk;
+    struct sk_scene scene;
+
+    /* the serialized picture */
+    int pic_fd;
+    size_t pic_size;
+
+    struct farm_raster_shared *shared;
+    void *pixels;
+    size_t pixels_size;
+    SkImageInfo info;
+};
+
+static void
+farm_raster_test_init_picture(struct farm_raster_test *test)
+{
+    struct sk *sk = &test->sk;
+
+    SkPictureRecorder rec;
+    SkCanvas *canvas =
+        rec.beginRecording(SkIntToScalar(test->width), SkIntToScalar(test->height));
+    sk_scene_draw(sk, &test->scene, canvas, 0);
+    sk_sp<SkPicture> pic = rec.finishRecordingAsPicture();
+
+    /* serialize once; the workers map and deserialize it */
+    sk_sp<SkData> data = pic->serialize();
+    test->pic_size = data->size();
+    test->pic_fd = memfd_create("farm-raster-picture", MFD_CLOEXEC);
+    if (test->pic_fd < 0)
+        sk_die("failed to create memfd");
+
+    size_t offset = 0;
+    while (offset < data->size()) {
+        const ssize_t ret = write(test->pic_fd, data->bytes() + offset, data->size() - offset);
+        if (ret <= 0)
+            sk_die("failed to write picture");
+        offset += ret;
+    }
+}
+
+static void
+farm_raster_test_init(struct farm_raster_test *test)
+{
+    struct sk *sk = &test->sk;
+
+    /* no worker threads; the workers are forked */
+    sk_init(sk, NULL);
+    if (sk->executor)
+        sk_die("SK_THREAD_COUNT is incompatible with forking workers");
+
+    sk_scene_init(sk, &test->scene, test->scene_type, test->width, test->height);
+    farm_raster_test_init_picture(test);
+
+    test->info = sk_make_image_info(sk, test->width, test->height);
+    test->pixels_size = test->info.computeMinByteSize();
+    test->pixels = mmap(NULL, test->pixels_size, PROT_READ | PROT_WRITE,
+                        MAP_SHARED | MAP_ANONYMOUS, -1, 0);
+    if (test->pixels == MAP_FAILED)
+        sk_die("failed to map %zu bytes", test->pixels_size);
+
+    void *shared = mmap(NULL, sizeof(*test->shared), PROT_READ | PROT_WRITE,
+                        MAP_SHARED | MAP_ANONYMOUS, -1, 0);
+    if (shared == MAP_FAILED)
+        sk_die("failed to map shared state");
+    test->shared = new (shared) struct farm_raster_shared;
+}
+
+static void
+farm_raster_test_cleanup(struct farm_raster_test *test)
+{
+    struct sk *sk = &test->sk;
+
+    test->shared->~farm_raster_shared();
+    munmap(test->shared, sizeof(*test->shared));
+    munmap(test->pixels, test->pixels_size);
+    close(test->pic_fd);
+
+    sk_scene_cleanup(sk, &test->scene);
+    sk_cleanup(sk);
+}
+
+static sk_sp<SkPicture>
+farm_raster_test_load_picture(struct farm_raster_test *test)
+{
+    void *addr = mmap(NULL, test->pic_size, PROT_READ, MAP_PRIVATE, test->pic_fd, 0);
+    if (addr == MAP_FAILED)
+        sk_die("failed to map picture");
+
+    sk_sp<SkPicture> pic = SkPicture::MakeFromData(addr, test->pic_size);
+    munmap(addr, test->pic_size);
+    if (!pic)
+        sk_die("failed to deserialize picture");
+
+    return pic;
+}
+
+static uint32_t
+farm_raster_test_get_tile_count(struct farm_raster_test *test, uint32_t *tiles_x)
+{
+    *tiles_x = (test->width + test->tile_size - 1) / test->tile_size;
+    const uint32_t tiles_y = (test->height + test->tile_size - 1) / test->tile_size;
+    return *tiles_x * tiles_y;
+}
+
+/* renders tiles straight into the shared output until none is left */
+static void
+farm_raster_test_work(struct farm_raster_test *test)
+{
+    sk_sp<SkPicture> pic = farm_raster_test_load_picture(test);
+
+    uint32_t tiles_x;
+    const uint32_t tile_count = farm_raster_test_get_tile_count(test, &tiles_x);
+    const SkIRect bounds = SkIRect::MakeWH(test->width, test->height);
+
+    while (true) {
+        const uint32_t tile = test->shared->next_tile++;
+        if (tile >= tile_count)
+            break;
+
+        SkIRect rect = SkIRect::MakeXYWH(tile % tiles_x * test->tile_size,
+                                         tile / tiles_x * test->tile_size, test->tile_size,
+                                         test->tile_size);
+        rect.intersect(bounds);
+
+        SkPixmap pixmap(test->info, test->pixels, test->info.minRowBytes());
+        SkPixmap tile_pixmap;
+        pixmap.extractSubset(&tile_pixmap, rect);
+
+        sk_sp<SkSurface> surf = SkSurfaces::WrapPixels(tile_pixmap);
+        if (!surf)
+            sk_die("failed to wrap tile");
+
+        SkCanvas *canvas = surf->getCanvas();
+        canvas->translate(-rect.x(), -rect.y());
+        pic->playback(canvas);
+    }
+}
+
+static uint64_t
+farm_raster_test_render(struct farm_raster_test *test, uint32_t process_count)
+{
+    memset(test->pixels, 0, test->pixels_size);
+    test->shared->next_tile = 0;
+
+    const uint64_t begin = sk_now_ns();
+
+    std::vector<pid_t> pids;
+    for (uint32_t i = 0; i < process_count; i++) {
+        const pid_t pid = fork();
+        if (pid < 0)
+            sk_die("failed to fork");
+        if (!pid) {
+            farm_raster_test_work(test);
+            _exit(0);
+        }
+        pids.push_back(pid);
+    }
+
+    for (const pid_t pid : pids) {
+        int status;
+        if (waitpid(pid, &status, 0) < 0 || !WIFEXITED(status) || WEXITSTATUS(status))
+            sk_die("worker %d failed", pid);
+    }
+
+    return sk_now_ns() - begin;
+}
+
+/* renders in this process without tiling, as canvas-picture does */
+static uint64_t
+farm_raster_test_render_reference(struct farm_raster_test *test)
+{
+    memset(test->pixels, 0, test->pixels_size);
+
+    const uint64_t begin = sk_now_ns();
+    sk_sp<SkPicture> pic = farm_raster_test_load_picture(test);
+    sk_sp<SkSurface> surf =
+        SkSurfaces::WrapPixels(test->info, test->pixels, test->info.minRowBytes());
+    if (!surf)
+        sk_die("failed to wrap output");
+    pic->playback(surf->getCanvas());
+
+    return sk_now_ns() - begin;
+}
+
+static uint64_t
+farm_raster_test_hash(struct farm_raster_test *test)
+{
+    const uint64_t *words = (const uint64_t *)test->pixels;
+    const size_t count = test->pixels_size / sizeof(*words);
+
+    uint64_t hash = 0xcbf29ce484222325ull;
+    for (size_t i = 0; i < count; i++)
+        hash = (hash ^ words[i]) * 0x100000001b3ull;
+
+    /* an odd pixel count leaves a partial word */
+    const uint8_t *tail = (const uint8_t *)(words + count);
+    for (size_t i = 0; i < test->pixels_size % sizeof(*words); i++)
+        hash = (hash ^ tail[i]) * 0x100000001b3ull;
+
+    return hash;
+}
+
+int
+main(int argc, const char **argv)
+{
+    struct farm_raster_test test = {
+        .width = 16384,
+        .height = 16384,
+        .tile_size = 512,
+        .scene_type = SK_SCENE_PATH,
+        .max_process_count = sk_get_cpu_count(),
+    };
+
+    int opt;
+    while ((opt = getopt(argc, (char *const *)argv, "g:t:s:p:")) != -1) {
+        switch (opt) {
+        case 'g':
+            if (sscanf(optarg, "%ux%u", &test.width, &test.height) != 2)
+                sk_die("bad geometry %s", optarg);
+            break;
+        case 't':
+            test.tile_size = atoi(optarg);
+            break;
+        case 's':
+            test.scene_type = sk_scene_parse_type(optarg);
+            break;
+        case 'p':
+            test.max_process_count = atoi(optarg);
+            break;
+        default:
+            sk_die("usage: %s [-g <width>x<height>] [-t <tile-size>] [-s <scene>] "
+                   "[-p <max-process-count>]",
+                   argv[0]);
+        }
+    }
+    if (!test.width || !test.height || !test.tile_size || !test.max_process_count)
+        sk_die("geometry, tile size and process count must be positive");
+
+    farm_raster_test_init(&test);
+    sk_alloc_set_phase(SK_ALLOC_PHASE_DRAW);
+
+    const uint64_t ref_ns = farm_raster_test_render_reference(&test);
+    const uint64_t ref_hash = farm_raster_test_hash(&test);
+    sk_report_first_pixel(&test.sk);
+    sk_log("%ux%u, single process: %.3f ms", test.width, test.height, ref_ns / 1e6);
+
+    /* double the process count but always end with the requested maximum */
+    uint64_t base_ns = 0;
+    uint32_t count = 1;
+    while (true) {
+        const uint64_t ns = farm_raster_test_render(&test, count);
+        if (count == 1)
+            base_ns = ns;
+
+        const bool match = farm_raster_test_hash(&test) == ref_hash;
+        sk_log("%2u processes: %.3f ms, %.2fx, %s", count, ns / 1e6, (double)base_ns / ns,
+               match ? "matches" : "differs from the single-process render");
+
+        if (count == test.max_process_count)
+            break;
+        count = std::min(count * 2, test.max_process_count);
+    }
+
+    const SkPixmap pixmap(test.info, test.pixels, test.info.minRowBytes());
+    sk_dump_pixmap(&test.sk, pixmap, "rt.png");
+
+    sk_alloc_set_phase(SK_ALLOC_PHASE_CLEANUP);
+    farm_raster_test_cleanup(&test);
+
+    return 0;
+}
@@ -6,16 +6,38 @@
 #include "skutil.h"
 #include "skutil_vk.h"
 
+struct image_ganesh_vk_stats {
+    uint32_t count;
+    uint64_t pixel_count;
+    uint64_t decode_ns;
+    uint64_t encode_ns;
+    uint64_t upload_ns;
+    uint64_t upload_bytes;
+    uint64_t texture_bytes;
+    uint64_t elapsed_ns;
+};
+
 struct image_ganesh_vk_test {
     bool upload;
-    const char *filename;
+    bool yuva;
+    const char *compressed_cache_dir;
+    const char *path;
+    uint32_t prefetch_depth;
+    bool sampling;
 
     struct sk sk;
     struct sk_vk vk;
     sk_sp<GrDirectContext> ctx;
+    std::vector<std::string> files;
+    struct sk_decode_params decode;
+    std::unique_ptr<sk_persistent_cache> compressed_cache;
+    struct sk_prefetch prefetch;
+    struct sk_mipmap_cache mipmap_cache;
+    struct sk_sampling_stats sampling_stats;
 
     sk_sp<SkImage> img;
     sk_sp<SkSurface> surf;
+    struct image_ganesh_vk_stats stats;
 };
 
 static void
@@ -24,42 +46,140 @@ image_ganesh_vk_test_init(struct image_ganesh_vk_test *test)
     struct sk *sk = &test->sk;
     struct sk_vk *vk = &test->vk;
 
-    sk_init(sk, NULL);
+    const struct sk_init_params params = {
+        .thread_count = sk_get_cpu_count(),
+        .warm_init = true,
+    };
+    sk_init(sk, &params);
+    sk_collect_files(sk, test->path, &test->files);
+    sk_prefetch_init(sk, &test->prefetch, &test->files, &test->decode, test->prefetch_depth);
+
     sk_vk_init(vk);
 
     const GrVkBackendContext backend = sk_vk_make_backend_context(vk);
     test->ctx = sk_create_context_ganesh_vk(sk, backend);
 
-    test->img = sk_load_png(sk, test->filename);
-    assert(!test->img->isTextureBacked());
-    if (test->upload) {
+    sk_mipmap_cache_init(sk, &test->mipmap_cache, 256 << 20);
+    test->sampling_stats = {};
+    test->sampling_stats.repeat_count = 4;
+}
+
+static void
+image_ganesh_vk_test_cleanup(struct image_ganesh_vk_test *test)
+{
+    struct sk *sk = &test->sk;
+    struct sk_vk *vk = &test->vk;
+
+    test->surf.reset();
+    test->img.reset();
+    sk_mipmap_cache_cleanup(sk, &test->mipmap_cache);
+    sk_prefetch_cleanup(sk, &test->prefetch);
+    test->compressed_cache.reset();
+    test->ctx.reset();
+    sk_vk_cleanup(vk);
+    sk_cleanup(sk);
+}
+
+/* restarts the batch with the current test->decode */
+static void
+image_ganesh_vk_test_rewind(struct image_ganesh_vk_test *test)
+{
+    struct sk *sk = &test->sk;
+
+    sk_prefetch_cleanup(sk, &test->prefetch);
+    sk_prefetch_init(sk, &test->prefetch, &test->files, &test->decode, test->prefetch_depth);
+    test->stats = {};
+
+    /* the images of the new batch have new unique ids */
+    sk_mipmap_cache_cleanup(sk, &test->mipmap_cache);
+    sk_mipmap_cache_init(sk, &test->mipmap_cache, test->mipmap_cache.budget);
+    const uint32_t repeat_count = test->sampling_stats.repeat_count;
+    test->sampling_stats = {};
+    test->sampling_stats.repeat_count = repeat_count;
+}
+
+static void
+image_ganesh_vk_test_upload(struct image_ganesh_vk_test *test, struct sk_decoded_image *decoded)
+{
+    struct image_ganesh_vk_stats *stats = &test->stats;
+
+    const uint64_t begin = sk_now_ns();
+    if (decoded->yuva.isValid()) {
+        /* the planes are converted to rgb by the gpu when drawn */
+        test->img = SkImages::TextureFromYUVAPixmaps(test->ctx.get(), decoded->yuva,
+                                                     skgpu::Mipmapped::kNo, false, NULL);
+        if (!test->img)
+            sk_die("failed to create yuva texture");
+
+        size_t size = 0;
+        for (int i = 0; i < decoded->yuva.numPlanes(); i++)
+            size += decoded->yuva.plane(i).computeByteSize();
+        stats->upload_bytes += size;
+        stats->texture_bytes += size;
+    } else if (decoded->compressed.data) {
+        const struct sk_compressed_image *compressed = &decoded->compressed;
+        test->img = SkImages::TextureFromCompressedTextureData(
+            test->ctx.get(), compressed->data, compressed->width, compressed->height,
+            compressed->type, skgpu::Mipmapped::kNo, GrProtected::kNo);
+        if (!test->img)
+            sk_die("failed to create compressed texture");
+
+        /* skia decompresses to rgba when the gpu lacks the format */
+        stats->upload_bytes += compressed->data->size();
+        if (test->ctx->compressedBackendFormat(compressed->type).isValid())
+            stats->texture_bytes += compressed->data->size();
+        else
+            stats->texture_bytes += (uint64_t)compressed->width * compressed->height * 4;
+    } else {
         SkPixmap pixmap;
-        test->img->peekPixels(&pixmap);
+        decoded->img->peekPixels(&pixmap);
 
         GrBackendTexture tex = test->ctx->createBackendTexture(
             pixmap, kTopLeft_GrSurfaceOrigin, GrRenderable::kNo, GrProtected::kNo);
         if (!tex.isValid())
             sk_die("failed to create backend texture");
         test->img = SkImages::AdoptTextureFrom(test->ctx.get(), tex, kTopLeft_GrSurfaceOrigin,
-                                               test->img->colorType());
+                                               decoded->img->colorType());
 
-        assert(test->img->isTextureBacked());
+        stats->upload_bytes += pixmap.computeByteSize();
+        stats->texture_bytes += pixmap.computeByteSize();
     }
+    stats->upload_ns += sk_now_ns() - begin;
 
-    test->surf = sk_create_surface_ganesh(sk, test->ctx, test->img->width(), test->img->height());
+    assert(test->img->isTextureBacked());
 }
 
-static void
-image_ganesh_vk_test_cleanup(struct image_ganesh_vk_test *test)
+static bool
+image_ganesh_vk_test_next(struct image_ganesh_vk_test *test)
 {
     struct sk *sk = &test->sk;
-    struct sk_vk *vk = &test->vk;
+    struct image_ganesh_vk_stats *stats = &test->stats;
 
-    test->surf.reset();
-    test->img.reset();
-    test->ctx.reset();
-    sk_vk_cleanup(vk);
-    sk_cleanup(sk);
+    struct sk_decoded_image decoded;
+    if (!sk_prefetch_next(sk, &test->prefetch, &decoded))
+        return false;
+
+    stats->count++;
+    stats->decode_ns += decoded.decode_ns;
+    stats->encode_ns += decoded.encode_ns;
+
+    if (test->upload || decoded.yuva.isValid() || decoded.compressed.data) {
+        image_ganesh_vk_test_upload(test, &decoded);
+    } else {
+        assert(!decoded.img->isTextureBacked());
+        test->img = decoded.img;
+    }
+    stats->pixel_count += (uint64_t)test->img->width() * test->img->height();
+
+    /* reuse the surface when the size does not change; the matrix needs the largest scale */
+    const SkRect dst = sk_sampling_get_dst_rect(
+        test->img.get(),
+        test->sampling ? sk_sampling_scales[SK_SAMPLING_SCALE_COUNT - 1] : 1.0f);
+    if (!test->surf || test->surf->width() != dst.width() ||
+        test->surf->height() != dst.height())
+        test->surf = sk_create_surface_ganesh(sk, test->ctx, dst.width(), dst.height());
+
+    return true;
 }
 
 static void
@@ -72,9 +192,103 @@ image_ganesh_vk_test_draw(struct image_ganesh_vk_test *test)
 
     canvas->drawImage(test->img, 0, 0);
 
+    sk_alloc_set_phase(SK_ALLOC_PHASE_FLUSH);
     test->ctx->flushAndSubmit(test->surf.get());
+    if (!sk->first_pixel_reported) {
+        test->ctx->submit(GrSyncCpu::kYes);
+        sk_report_first_pixel(sk);
+    }
+    sk_alloc_set_phase(SK_ALLOC_PHASE_DRAW);
 
-    sk_dump_surface(sk, test->surf, "rt.png");
+    /* only dump in one-shot mode */
+    if (test->files.size() == 1)
+        sk_dump_surface(sk, test->surf, "rt.png");
+}
+
+/* draws the image at every scale and sampling mode of the matrix */
+static void
+image_ganesh_vk_test_draw_sampling(struct image_ganesh_vk_test *test)
+{
+    struct sk *sk = &test->sk;
+    struct sk_sampling_stats *stats = &test->sampling_stats;
+
+    SkCanvas *canvas = test->surf->getCanvas();
+    canvas->clear(SK_ColorWHITE);
+
+    const SkRect src = SkRect::Make(test->img->bounds());
+    for (uint32_t s = 0; s < SK_SAMPLING_SCALE_COUNT; s++) {
+        const SkRect dst = sk_sampling_get_dst_rect(test->img.get(), sk_sampling_scales[s]);
+        stats->pixel_count[s] += (uint64_t)dst.width() * dst.height();
+
+        for (uint32_t m = 0; m < SK_SAMPLING_MODE_COUNT; m++) {
+            const SkSamplingOptions &sampling = sk_sampling_modes[m].sampling;
+            /* without the cache, ganesh would copy to a mipmapped texture on every draw */
+            const sk_sp<SkImage> img =
+                sampling.mipmap != SkMipmapMode::kNone
+                    ? sk_mipmap_cache_get(sk, &test->mipmap_cache, test->ctx.get(), test->img)
+                    : test->img;
+
+            /* keep pipeline compilation out of the timing */
+            canvas->drawImageRect(img, src, dst, sampling, NULL,
+                                  SkCanvas::kFast_SrcRectConstraint);
+            test->ctx->flushAndSubmit(test->surf.get(), GrSyncCpu::kYes);
+
+            sk_alloc_set_phase(SK_ALLOC_PHASE_DRAW);
+            const uint64_t begin = sk_now_ns();
+            for (uint32_t i = 0; i < stats->repeat_count; i++)
+                canvas->drawImageRect(img, src, dst, sampling, NULL,
+                                      SkCanvas::kFast_SrcRectConstraint);
+            sk_alloc_set_phase(SK_ALLOC_PHASE_FLUSH);
+            test->ctx->flushAndSubmit(test->surf.get(), GrSyncCpu::kYes);
+            stats->ns[s][m] += sk_now_ns() - begin;
+        }
+    }
+    sk_alloc_set_phase(SK_ALLOC_PHASE_DRAW);
+    stats->image_count++;
+    sk_report_first_pixel(sk);
+
+    if (test->files.size() == 1)
+        sk_dump_surface(sk, test->surf, "rt.png");
+}
+
+static void
+image_ganesh_vk_test_run(struct image_ganesh_vk_test *test)
+{
+    const uint64_t begin = sk_now_ns();
+    while (image_ganesh_vk_test_next(test)) {
+        if (test->sampling)
+            image_ganesh_vk_test_draw_sampling(test);
+        else
+            image_ganesh_vk_test_draw(test);
+    }
+
+    /* wait for the last item */
+    test->ctx->submit(GrSyncCpu::kYes);
+    test->stats.elapsed_ns = sk_now_ns() - begin;
+}
+
+/* base, when set, is the rgba pass to compare against */
+static void
+image_ganesh_vk_test_report(const char *name,
+                            const struct image_ganesh_vk_stats *stats,
+                            const struct image_ganesh_vk_stats *base)
+{
+    const double upload_mib = (double)stats->upload_bytes / (1 << 20);
+    const double bytes_per_pixel = (double)stats->upload_bytes / stats->pixel_count;
+    sk_log("%s: decode %.3f ms/item, upload %.1f MiB (%.2f bytes/pixel) at %.1f MiB/s, "
+           "textures %.1f MiB, %.3f ms/item end-to-end",
+           name, stats->decode_ns / 1e6 / stats->count, upload_mib, bytes_per_pixel,
+           upload_mib / (stats->upload_ns / 1e9), (double)stats->texture_bytes / (1 << 20),
+           stats->elapsed_ns / 1e6 / stats->count);
+    /* transcoding on cache misses runs on the prefetch threads, off the draw path */
+    if (stats->encode_ns)
+        sk_log("%s: transcode %.3f ms/item", name, stats->encode_ns / 1e6 / stats->count);
+
+    if (base) {
+        sk_log("%s: saves %.3f ms/item end-to-end, uses %.1f%% of the rgba texture memory", name,
+               ((double)base->elapsed_ns - stats->elapsed_ns) / 1e6 / stats->count,
+               100.0 * stats->texture_bytes / base->texture_bytes);
+    }
 }
 
 int
@@ -82,16 +296,89 @@ main(int argc, const char **argv)
 {
     struct image_ganesh_vk_test test = {
         .upload = true,
+        .yuva = false,
+        .compressed_cache_dir = NULL,
+        .path = NULL,
+        .prefetch_depth = 4,
+        .sampling = false,
     };
 
-    if (argc != 2)
-        sk_die("usage: %s <png-file>", argv[0]);
+    int opt;
+    while ((opt = getopt(argc, (char *const *)argv, "yc:s")) != -1) {
+        switch (opt) {
+        case 'y':
+            test.yuva = true;
+            break;
+        case 'c':
+            test.compressed_cache_dir = optarg;
+            break;
+        case 's':
+            test.sampling = true;
+            break;
+        default:
+            sk_die("usage: %s [-y] [-c <cache-dir>] [-s] <image-file|list-file|dir>", argv[0]);
+        }
+    }
+    if (optind != argc - 1)
+        sk_die("usage: %s [-y] [-c <cache-dir>] [-s] <image-file|list-file|dir>", argv[0]);
 
-    test.filename = argv[1];
+    test.path = argv[optind];
 
+    const uint64_t init_begin = sk_now_ns();
     image_ganesh_vk_test_init(&test);
-    image_ganesh_vk_test_draw(&test);
+    sk_alloc_set_phase(SK_ALLOC_PHASE_DRAW);
+    const uint64_t init_end = sk_now_ns();
+
+    /* an untimed pass so that the rgba pass does not warm the file cache for the others */
+    if (test.yuva || test.compressed_cache_dir) {
+        image_ganesh_vk_test_run(&test);
+        image_ganesh_vk_test_rewind(&test);
+    }
+
+    const uint64_t draw_begin = sk_now_ns();
+    image_ganesh_vk_test_run(&test);
+    const uint64_t draw_end = sk_now_ns();
+    /* the batch is the rgba pass; leave out the warm-up pass and everything after */
+    uint64_t batch_ns = sk_get_ns_since_exec();
+    if (batch_ns)
+        batch_ns -= std::min(batch_ns, draw_begin - init_end);
+    const struct image_ganesh_vk_stats rgba_stats = test.stats;
+    image_ganesh_vk_test_report("rgba", &rgba_stats, NULL);
+    sk_sampling_report(&test.sk, "ganesh-vk", &test.sampling_stats, &test.mipmap_cache);
+
+    /* run the batch again with jpegs decoded to planes */
+    if (test.yuva) {
+        test.decode.yuva = true;
+        image_ganesh_vk_test_rewind(&test);
+        image_ganesh_vk_test_run(&test);
+        image_ganesh_vk_test_report("yuva", &test.stats, &rgba_stats);
+        sk_sampling_report(&test.sk, "ganesh-vk/yuva", &test.sampling_stats, &test.mipmap_cache);
+        test.decode.yuva = false;
+    }
+
+    /* run the batch again with bc1 textures; the first run populates the cache */
+    if (test.compressed_cache_dir) {
+        test.compressed_cache = std::make_unique<sk_persistent_cache>(test.compressed_cache_dir);
+        test.decode.compressed_cache = test.compressed_cache.get();
+        image_ganesh_vk_test_rewind(&test);
+        image_ganesh_vk_test_run(&test);
+        image_ganesh_vk_test_report("bc1", &test.stats, &rgba_stats);
+        sk_sampling_report(&test.sk, "ganesh-vk/bc1", &test.sampling_stats, &test.mipmap_cache);
+        sk_log("bc1: %u/%u cache hits", test.compressed_cache->hit_count(),
+               test.compressed_cache->load_count());
+    }
+
+    sk_alloc_set_phase(SK_ALLOC_PHASE_CLEANUP);
     image_ganesh_vk_test_cleanup(&test);
 
+    /* time a few real one-shot runs; without options, they only do the rgba pass */
+    uint64_t oneshot_ns = 0;
+    if (rgba_stats.count > 1) {
+        const std::vector<const char *> args = { argv[0] };
+        oneshot_ns = sk_time_oneshot(&test.sk, args, test.files, 3);
+    }
+    sk_report_batch(&test.sk, rgba_stats.count, init_end - init_begin, draw_end - draw_begin,
+                    batch_ns, oneshot_ns);
+
     return 0;
 }
@@ -6,11 +6,23 @@
 #include "skutil.h"
 
 struct image_raster_test {
-    const char *filename;
+    const char *path;
+    struct sk_decode_params decode;
+    const char *compressed_cache_dir;
+    uint32_t prefetch_depth;
+    bool sampling;
+    bool cpu_levels;
 
     struct sk sk;
+    std::vector<std::string> files;
+    std::unique_ptr<sk_persistent_cache> compressed_cache;
+    struct sk_prefetch prefetch;
+    struct sk_mipmap_cache mipmap_cache;
+    struct sk_sampling_stats sampling_stats;
+
     sk_sp<SkImage> img;
     sk_sp<SkSurface> surf;
+    uint64_t encode_ns;
 };
 
 static void
@@ -18,9 +30,23 @@ image_raster_test_init(struct image_raster_test *test)
 {
     struct sk *sk = &test->sk;
 
-    sk_init(sk, NULL);
-    test->img = sk_load_png(sk, test->filename);
-    test->surf = sk_create_surface_raster(sk, test->img->width(), test->img->height());
+    const struct sk_init_params params = {
+        .thread_count = sk_get_cpu_count(),
+        .warm_init = true,
+    };
+    sk_init(sk, &params);
+    sk_collect_files(sk, test->path, &test->files);
+
+    if (test->compressed_cache_dir) {
+        test->compressed_cache =
+            std::make_unique<sk_persistent_cache>(test->compressed_cache_dir);
+        test->decode.compressed_cache = test->compressed_cache.get();
+    }
+    sk_prefetch_init(sk, &test->prefetch, &test->files, &test->decode, test->prefetch_depth);
+
+    sk_mipmap_cache_init(sk, &test->mipmap_cache, 256 << 20);
+    test->sampling_stats = {};
+    test->sampling_stats.repeat_count = 4;
 }
 
 static void
@@ -30,9 +56,43 @@ image_raster_test_cleanup(struct image_raster_test *test)
 
     test->surf.reset();
     test->img.reset();
+    sk_mipmap_cache_cleanup(sk, &test->mipmap_cache);
+    sk_prefetch_cleanup(sk, &test->prefetch);
+    test->compressed_cache.reset();
     sk_cleanup(sk);
 }
 
+static bool
+image_raster_test_next(struct image_raster_test *test)
+{
+    struct sk *sk = &test->sk;
+
+    struct sk_decoded_image decoded;
+    if (!sk_prefetch_next(sk, &test->prefetch, &decoded))
+        return false;
+    test->encode_ns += decoded.encode_ns;
+    if (decoded.compressed.data) {
+        /* decompresses the blocks; there is no compressed raster format */
+        const struct sk_compressed_image *compressed = &decoded.compressed;
+        test->img = SkImages::RasterFromCompressedTextureData(
+            compressed->data, compressed->width, compressed->height, compressed->type);
+        if (!test->img)
+            sk_die("failed to decompress image");
+    } else {
+        test->img = decoded.img;
+    }
+
+    /* reuse the surface when the size does not change; the matrix needs the largest scale */
+    const SkRect dst = sk_sampling_get_dst_rect(
+        test->img.get(),
+        test->sampling ? sk_sampling_scales[SK_SAMPLING_SCALE_COUNT - 1] : 1.0f);
+    if (!test->surf || test->surf->width() != dst.width() ||
+        test->surf->height() != dst.height())
+        test->surf = sk_create_surface_raster(sk, dst.width(), dst.height());
+
+    return true;
+}
+
 static void
 image_raster_test_draw(struct image_raster_test *test)
 {
@@ -42,25 +102,177 @@ image_raster_test_draw(struct image_raster_test *test)
     canvas->clear(SK_ColorWHITE);
 
     canvas->drawImage(test->img, 0, 0);
+    sk_report_first_pixel(sk);
+
+    /* only dump in one-shot mode */
+    if (test->files.size() == 1 && !test->cpu_levels)
+        sk_dump_surface(sk, test->surf, "rt.png");
+}
+
+/* draws the image at every scale and sampling mode of the matrix */
+static void
+image_raster_test_draw_sampling(struct image_raster_test *test)
+{
+    struct sk *sk = &test->sk;
+    struct sk_sampling_stats *stats = &test->sampling_stats;
+
+    SkCanvas *canvas = test->surf->getCanvas();
+    canvas->clear(SK_ColorWHITE);
 
-    sk_dump_surface(sk, test->surf, "rt.png");
+    const SkRect src = SkRect::Make(test->img->bounds());
+    for (uint32_t s = 0; s < SK_SAMPLING_SCALE_COUNT; s++) {
+        const SkRect dst = sk_sampling_get_dst_rect(test->img.get(), sk_sampling_scales[s]);
+        stats->pixel_count[s] += (uint64_t)dst.width() * dst.height();
+
+        for (uint32_t m = 0; m < SK_SAMPLING_MODE_COUNT; m++) {
+            const SkSamplingOptions &sampling = sk_sampling_modes[m].sampling;
+            /* without the cache, skia would build the mipmaps on the first draw */
+            const sk_sp<SkImage> img =
+                sampling.mipmap != SkMipmapMode::kNone
+                    ? sk_mipmap_cache_get(sk, &test->mipmap_cache, NULL, test->img)
+                    : test->img;
+
+            const uint64_t begin = sk_now_ns();
+            for (uint32_t i = 0; i < stats->repeat_count; i++)
+                canvas->drawImageRect(img, src, dst, sampling, NULL,
+                                      SkCanvas::kFast_SrcRectConstraint);
+            stats->ns[s][m] += sk_now_ns() - begin;
+        }
+    }
+    stats->image_count++;
+    sk_report_first_pixel(sk);
+
+    if (test->files.size() == 1)
+        sk_dump_surface(sk, test->surf, "rt.png");
+}
+
+/* runs the batch in a child process per cpu level; this runs before init */
+static void
+image_raster_test_draw_cpu_levels(struct image_raster_test *test)
+{
+    struct sk *sk = &test->sk;
+
+    /* decoding runs at the same level */
+    const auto draw = [&](enum sk_cpu_level_type level) -> uint64_t {
+        image_raster_test_init(test);
+
+        const uint64_t begin = sk_now_ns();
+        uint32_t count = 0;
+        while (image_raster_test_next(test)) {
+            image_raster_test_draw(test);
+            count++;
+        }
+        const uint64_t ns = sk_now_ns() - begin;
+        if (!count)
+            sk_die("no image");
+
+        /* all levels dump the last image */
+        char filename[64];
+        sk_cpu_level_get_filename(level, filename, sizeof(filename));
+        sk_dump_surface(sk, test->surf, filename);
+        image_raster_test_cleanup(test);
+
+        return ns / count;
+    };
+    struct sk_cpu_level_results results;
+    sk_cpu_levels_run("raster", draw, &results);
+
+    sk_init(sk, NULL);
+    sk_cpu_levels_report(sk, "raster", &results, 1, "item");
+    sk_cleanup(sk);
 }
 
 int
 main(int argc, const char **argv)
 {
     struct image_raster_test test = {
-        .filename = NULL,
+        .path = NULL,
+        .decode = {},
+        .compressed_cache_dir = NULL,
+        .prefetch_depth = 4,
+        .sampling = false,
+        .cpu_levels = false,
     };
 
-    if (argc != 2)
-        sk_die("usage: %s <png-file>", argv[0]);
+    int opt;
+    while ((opt = getopt(argc, (char *const *)argv, "m:r:Sc:sC")) != -1) {
+        switch (opt) {
+        case 'm':
+            if (sscanf(optarg, "%ux%u", &test.decode.max_width, &test.decode.max_height) != 2)
+                sk_die("bad max size %s", optarg);
+            break;
+        case 'r': {
+            int x, y, w, h;
+            if (sscanf(optarg, "%d,%d,%d,%d", &x, &y, &w, &h) != 4)
+                sk_die("bad region %s", optarg);
+            test.decode.subset = SkIRect::MakeXYWH(x, y, w, h);
+            break;
+        }
+        case 'S':
+            test.decode.streamed = true;
+            break;
+        case 'c':
+            test.compressed_cache_dir = optarg;
+            break;
+        case 's':
+            test.sampling = true;
+            break;
+        case 'C':
+            test.cpu_levels = true;
+            break;
+        default:
+            sk_die("usage: %s [-m <max-w>x<max-h>] [-r <x>,<y>,<w>,<h>] [-S] [-c <cache-dir>] "
+                   "[-s] [-C] <image-file|list-file|dir>",
+                   argv[0]);
+        }
+    }
+    if (optind != argc - 1)
+        sk_die("usage: %s [-m <max-w>x<max-h>] [-r <x>,<y>,<w>,<h>] [-S] [-c <cache-dir>] "
+               "[-s] [-C] <image-file|list-file|dir>",
+               argv[0]);
 
-    test.filename = argv[1];
+    test.path = argv[optind];
 
+    /* every level runs in its own process, before skia is initialized */
+    if (test.cpu_levels) {
+        image_raster_test_draw_cpu_levels(&test);
+        return 0;
+    }
+
+    const uint64_t init_begin = sk_now_ns();
     image_raster_test_init(&test);
-    image_raster_test_draw(&test);
+    sk_alloc_set_phase(SK_ALLOC_PHASE_DRAW);
+    const uint64_t init_end = sk_now_ns();
+
+    uint32_t count = 0;
+    while (image_raster_test_next(&test)) {
+        if (test.sampling)
+            image_raster_test_draw_sampling(&test);
+        else
+            image_raster_test_draw(&test);
+        count++;
+    }
+    const uint64_t draw_end = sk_now_ns();
+    const uint64_t batch_ns = sk_get_ns_since_exec();
+
+    sk_sampling_report(&test.sk, "raster", &test.sampling_stats, &test.mipmap_cache);
+    if (test.compressed_cache) {
+        sk_log("bc1: %u/%u cache hits, transcode %.3f ms total",
+               test.compressed_cache->hit_count(), test.compressed_cache->load_count(),
+               test.encode_ns / 1e6);
+    }
+
+    sk_alloc_set_phase(SK_ALLOC_PHASE_CLEANUP);
     image_raster_test_cleanup(&test);
 
+    /* time a few real one-shot runs with the same options */
+    uint64_t oneshot_ns = 0;
+    if (count > 1) {
+        const std::vector<const char *> args(argv, argv + optind);
+        oneshot_ns = sk_time_oneshot(&test.sk, args, test.files, 3);
+    }
+    sk_report_batch(&test.sk, count, init_end - init_begin, draw_end - init_end, batch_ns,
+                    oneshot_ns);
+
     return 0;
 }
@@ -0,0 +1,397 @@
+/*
+ * Copyright 2023 Google LLC
+ * SPDX-License-Identifier: MIT
+ */
+
+#include "skutil.h"
+
+/* per-frame times of a test, backend, scene, size and color type; one vector per run */
+typedef std::map<std::string, std::vector<std::vector<double>>> results_compare_set;
+
+struct results_compare_stats {
+    /* medians of the run medians */
+    double base_median;
+    double new_median;
+    /* confidence interval of new_median / base_median */
+    double ratio_lo;
+    double ratio_hi;
+    /* two-sided mann-whitney u test of the run medians */
+    double p;
+};
+
+struct results_compare_test {
+    const char *base_path;
+    const char *new_path;
+    double alpha;
+    double threshold;
+    uint32_t resample_count;
+    uint32_t min_run_count;
+
+    struct sk sk;
+    results_compare_set base;
+    results_compare_set cur;
+};
+
+static void
+results_compare_skip_space(const char **p)
+{
+    while (**p == ' ' || **p == '\t')
+        (*p)++;
+}
+
+static void
+results_compare_expect(const char **p, char c, const char *line)
+{
+    results_compare_skip_space(p);
+    if (**p != c)
+        sk_die("expected '%c' in %s", c, line);
+    (*p)++;
+}
+
+/* no escapes; sk_write_result does not write any */
+static std::string
+results_compare_parse_string(const char **p, const char *line)
+{
+    results_compare_expect(p, '"', line);
+    const char *end = strchr(*p, '"');
+    if (!end)
+        sk_die("unterminated string in %s", line);
+
+    std::string str(*p, end - *p);
+    *p = end + 1;
+    return str;
+}
+
+static double
+results_compare_parse_number(const char **p, const char *line)
+{
+    results_compare_skip_space(p);
+    char *end;
+    const double val = strtod(*p, &end);
+    if (end == *p)
+        sk_die("expected a number in %s", line);
+    *p = end;
+    return val;
+}
+
+/* parses a record of sk_write_result and adds its samples to the set as a run */
+static void
+results_compare_parse_line(struct results_compare_test *test,
+                           const char *line,
+                           results_compare_set *set)
+{
+    std::map<std::string, std::string> fields;
+    std::vector<double> samples;
+
+    const char *p = line;
+    results_compare_expect(&p, '{', line);
+    while (true) {
+        const std::string name = results_compare_parse_string(&p, line);
+        results_compare_expect(&p, ':', line);
+        results_compare_skip_space(&p);
+
+        if (*p == '"') {
+            fields[name] = results_compare_parse_string(&p, line);
+        } else if (*p == '[') {
+            p++;
+            results_compare_skip_space(&p);
+            while (*p != ']') {
+                const double val = results_compare_parse_number(&p, line);
+                if (name == "samples_ns")
+                    samples.push_back(val);
+                results_compare_skip_space(&p);
+                if (*p == ',')
+                    p++;
+                else if (*p != ']')
+                    sk_die("expected ']' in %s", line);
+                results_compare_skip_space(&p);
+            }
+            p++;
+        } else {
+            char buf[32];
+            snprintf(buf, sizeof(buf), "%.0f", results_compare_parse_number(&p, line));
+            fields[name] = buf;
+        }
+
+        results_compare_skip_space(&p);
+        if (*p == '}')
+            break;
+        results_compare_expect(&p, ',', line);
+    }
+
+    const std::string key = fields["test"] + " " + fields["backend"] + "/" + fields["scene"] +
+                            " " + fields["width"] + "x" + fields["height"] + " " +
+                            fields["color_type"];
+    if (!samples.empty())
+        (*set)[key].push_back(std::move(samples));
+}
+
+/*
+ * results files are json lines, one line per run of a configuration; frames of a run are
+ * correlated, so each run is reduced to its median and the runs are compared
+ */
+static void
+results_compare_load(struct results_compare_test *test,
+                     const char *path,
+                     results_compare_set *set)
+{
+    std::ifstream file(path);
+    if (!file)
+        sk_die("failed to open %s", path);
+
+    std::string line;
+    while (std::getline(file, line)) {
+        if (line.find_first_not_of(" \t\r") != std::string::npos)
+            results_compare_parse_line(test, line.c_str(), set);
+    }
+}
+
+static void
+results_compare_test_init(struct results_compare_test *test)
+{
+    struct sk *sk = &test->sk;
+
+    sk_init(sk, NULL);
+    results_compare_load(test, test->base_path, &test->base);
+    results_compare_load(test, test->new_path, &test->cur);
+}
+
+static void
+results_compare_test_cleanup(struct results_compare_test *test)
+{
+    struct sk *sk = &test->sk;
+
+    test->base.clear();
+    test->cur.clear();
+    sk_cleanup(sk);
+}
+
+static double
+results_compare_median(std::vector<double> vals)
+{
+    const size_t mid = vals.size() / 2;
+    std::nth_element(vals.begin(), vals.begin() + mid, vals.end());
+    if (vals.size() % 2)
+        return vals[mid];
+
+    const double hi = vals[mid];
+    return (*std::max_element(vals.begin(), vals.begin() + mid) + hi) / 2.0;
+}
+
+/* normal approximation with tie and continuity corrections */
+static double
+results_compare_mann_whitney(const std::vector<double> &a, const std::vector<double> &b)
+{
+    std::vector<std::pair<double, bool>> all;
+    all.reserve(a.size() + b.size());
+    for (double val : a)
+        all.emplace_back(val, true);
+    for (double val : b)
+        all.emplace_back(val, false);
+    std::sort(all.begin(), all.end());
+
+    /* ranks are 1-based and ties get the average rank */
+    const double n = all.size();
+    double rank_sum = 0.0;
+    double tie_sum = 0.0;
+    for (size_t i = 0; i < all.size();) {
+        size_t j = i;
+        while (j < all.size() && all[j].first == all[i].first)
+            j++;
+
+        const double rank = (i + 1 + j) / 2.0;
+        for (size_t k = i; k < j; k++) {
+            if (all[k].second)
+                rank_sum += rank;
+        }
+
+        const double t = j - i;
+        tie_sum += t * t * t - t;
+        i = j;
+    }
+
+    const double n1 = a.size();
+    const double n2 = b.size();
+    const double u = rank_sum - n1 * (n1 + 1) / 2.0;
+    const double mean = n1 * n2 / 2.0;
+    const double var = n1 * n2 / 12.0 * ((n + 1) - tie_sum / (n * (n - 1)));
+    if (var <= 0.0)
+        return 1.0;
+
+    const double diff = std::max(fabs(u - mean) - 0.5, 0.0);
+    return erfc(diff / sqrt(var) / sqrt(2.0));
+}
+
+/* splitmix64, so that runs are reproducible */
+static uint64_t
+results_compare_rand(uint64_t *state)
+{
+    uint64_t z = (*state += 0x9e3779b97f4a7c15ull);
+    z = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9ull;
+    z = (z ^ (z >> 27)) * 0x94d049bb133111ebull;
+    return z ^ (z >> 31);
+}
+
+static double
+results_compare_resample_median(const std::vector<double> &vals,
+                                std::vector<double> *tmp,
+                                uint64_t *state)
+{
+    tmp->resize(vals.size());
+    for (size_t i = 0; i < vals.size(); i++)
+        (*tmp)[i] = vals[results_compare_rand(state) % vals.size()];
+    return results_compare_median(*tmp);
+}
+
+static std::vector<double>
+results_compare_get_run_medians(const std::vector<std::vector<double>> &runs)
+{
+    std::vector<double> medians;
+    medians.reserve(runs.size());
+    for (const std::vector<double> &run : runs)
+        medians.push_back(results_compare_median(run));
+    return medians;
+}
+
+static struct results_compare_stats
+results_compare_compute(struct results_compare_test *test,
+                        const std::vector<std::vector<double>> &base_runs,
+                        const std::vector<std::vector<double>> &cur_runs)
+{
+    const std::vector<double> base = results_compare_get_run_medians(base_runs);
+    const std::vector<double> cur = results_compare_get_run_medians(cur_runs);
+
+    struct results_compare_stats stats = {
+        .base_median = results_compare_median(base),
+        .new_median = results_compare_median(cur),
+        .p = results_compare_mann_whitney(base, cur),
+    };
+
+    /* percentile bootstrap of the ratio of medians, resampling whole runs */
+    uint64_t state = 0x5eed;
+    std::vector<double> tmp;
+    std::vector<double> ratios(test->resample_count);
+    for (uint32_t i = 0; i < test->resample_count; i++) {
+        const double base_median = results_compare_resample_median(base, &tmp, &state);
+        const double new_median = results_compare_resample_median(cur, &tmp, &state);
+        ratios[i] = new_median / base_median;
+    }
+    std::sort(ratios.begin(), ratios.end());
+
+    const size_t lo = (size_t)(test->alpha / 2.0 * (test->resample_count - 1));
+    const size_t hi = (size_t)((1.0 - test->alpha / 2.0) * (test->resample_count - 1));
+    stats.ratio_lo = ratios[lo];
+    stats.ratio_hi = ratios[hi];
+
+    return stats;
+}
+
+/* returns the number of significant regressions */
+static uint32_t
+results_compare_test_run(struct results_compare_test *test)
+{
+    uint32_t regression_count = 0;
+    uint32_t improvement_count = 0;
+    uint32_t compared_count = 0;
+
+    for (const auto &iter : test->base) {
+        const std::string &key = iter.first;
+        const auto cur = test->cur.find(key);
+        if (cur == test->cur.end()) {
+            sk_log("%s: missing from %s", key.c_str(), test->new_path);
+            continue;
+        }
+        if (iter.second.size() < test->min_run_count ||
+            cur->second.size() < test->min_run_count) {
+            sk_log("%s: too few runs (%zu/%zu, need %u)", key.c_str(), iter.second.size(),
+                   cur->second.size(), test->min_run_count);
+            continue;
+        }
+
+        const struct results_compare_stats stats =
+            results_compare_compute(test, iter.second, cur->second);
+        compared_count++;
+
+        /* both significant and larger than the noise we are willing to ignore */
+        const char *verdict = "";
+        if (stats.p < test->alpha && stats.ratio_lo > 1.0 + test->threshold) {
+            verdict = " REGRESSION";
+            regression_count++;
+        } else if (stats.p < test->alpha && stats.ratio_hi < 1.0 - test->threshold) {
+            verdict = " improvement";
+            improvement_count++;
+        }
+
+        sk_log("%s: %.3f -> %.3f ms, %+.1f%% [%+.1f%%, %+.1f%%], p=%.2g, runs=%zu/%zu%s",
+               key.c_str(), stats.base_median / 1e6, stats.new_median / 1e6,
+               (stats.new_median / stats.base_median - 1.0) * 100.0,
+               (stats.ratio_lo - 1.0) * 100.0, (stats.ratio_hi - 1.0) * 100.0, stats.p,
+               iter.second.size(), cur->second.size(), verdict);
+    }
+
+    for (const auto &iter : test->cur) {
+        if (!test->base.count(iter.first))
+            sk_log("%s: missing from %s", iter.first.c_str(), test->base_path);
+    }
+
+    sk_log("%u compared, %u regressions, %u improvements (alpha %.3g, threshold %.1f%%)",
+           compared_count, regression_count, improvement_count, test->alpha,
+           test->threshold * 100.0);
+
+    return regression_count;
+}
+
+int
+main(int argc, const char **argv)
+{
+    struct results_compare_test test = {
+        .base_path = NULL,
+        .new_path = NULL,
+        .alpha = 0.05,
+        .threshold = 0.02,
+        .resample_count = 2000,
+        .min_run_count = 5,
+    };
+
+    int opt;
+    while ((opt = getopt(argc, (char *const *)argv, "a:t:b:n:")) != -1) {
+        switch (opt) {
+        case 'a':
+            test.alpha = atof(optarg);
+            break;
+        case 't':
+            test.threshold = atof(optarg) / 100.0;
+            break;
+        case 'b':
+            test.resample_count = atoi(optarg);
+            break;
+        case 'n':
+            test.min_run_count = atoi(optarg);
+            break;
+        default:
+            sk_die("usage: %s [-a <alpha>] [-t <threshold-percent>] [-b <resample-count>] "
+                   "[-n <min-runs>] <base-results> <new-results>\n"
+                   "each results file needs -n (default 5) runs of every configuration",
+                   argv[0]);
+        }
+    }
+    if (optind != argc - 2)
+        sk_die("usage: %s [-a <alpha>] [-t <threshold-percent>] [-b <resample-count>] "
+               "[-n <min-runs>] <base-results> <new-results>\n"
+               "each results file needs -n (default 5) runs of every configuration",
+               argv[0]);
+    if (test.alpha <= 0.0 || test.alpha >= 1.0 || !test.resample_count)
+        sk_die("alpha must be in (0, 1) and resample count must be positive");
+    if (test.min_run_count < 2)
+        sk_die("at least 2 runs are needed per configuration");
+
+    test.base_path = argv[optind];
+    test.new_path = argv[optind + 1];
+
+    results_compare_test_init(&test);
+    const uint32_t regression_count = results_compare_test_run(&test);
+    results_compare_test_cleanup(&test);
+
+    /* non-zero to gate skia upgrades on performance */
+    return regression_count ? 1 : 0;
+}
@@ -0,0 +1,184 @@
+/*
+ * Copyright 2023 Google LLC
+ * SPDX-License-Identifier: MIT
+ */
+
+#include "skutil.h"
+#include "skutil_scene.h"
+
+struct sequence_raster_test {
+    uint32_t width;
+    uint32_t height;
+    enum sk_scene_type scene_type;
+    uint32_t frame_count;
+    uint32_t tile_size;
+    int extract_frame;
+
+    struct sk sk;
+    struct sk_scene scene;
+    sk_sp<SkSurface> surf;
+};
+
+static void
+sequence_raster_test_init(struct sequence_raster_test *test)
+{
+    struct sk *sk = &test->sk;
+
+    sk_init(sk, NULL);
+    test->surf = sk_create_surface_raster(sk, test->width, test->height);
+    sk_scene_init(sk, &test->scene, test->scene_type, test->width, test->height);
+}
+
+static void
+sequence_raster_test_cleanup(struct sequence_raster_test *test)
+{
+    struct sk *sk = &test->sk;
+
+    sk_scene_cleanup(sk, &test->scene);
+    test->surf.reset();
+    sk_cleanup(sk);
+}
+
+/* dumps an animation both as a sequence and as a png per frame */
+static void
+sequence_raster_test_dump(struct sequence_raster_test *test, float damage)
+{
+    struct sk *sk = &test->sk;
+
+    SkCanvas *canvas = test->surf->getCanvas();
+    SkBitmap bitmap;
+    const SkPixmap pixmap = sk_read_surface(sk, test->surf, &bitmap);
+
+    struct sk_seq_writer writer;
+    sk_seq_writer_init(sk, &writer, "rt.skseq", pixmap.info(), test->tile_size);
+    sk_scene_reset_anim(&test->scene);
+
+    uint64_t seq_ns = 0;
+    uint64_t png_ns = 0;
+    uint64_t png_bytes = 0;
+    for (uint32_t i = 0; i < test->frame_count; i++) {
+        sk_scene_draw_anim(sk, &test->scene, canvas, i, damage, true);
+        sk_report_first_pixel(sk);
+
+        const uint64_t seq_begin = sk_now_ns();
+        sk_seq_writer_add_frame(sk, &writer, pixmap);
+        const uint64_t png_begin = sk_now_ns();
+        sk_dump_pixmap(sk, pixmap, "rt.png");
+        const uint64_t png_end = sk_now_ns();
+
+        seq_ns += png_begin - seq_begin;
+        png_ns += png_end - png_begin;
+
+        struct stat st;
+        if (stat("rt.png", &st))
+            sk_die("failed to stat rt.png");
+        png_bytes += st.st_size;
+    }
+
+    const uint64_t cleanup_begin = sk_now_ns();
+    const uint64_t seq_bytes = writer.stream->bytesWritten();
+    const double tile_ratio =
+        (double)writer.written_tile_count / ((uint64_t)writer.tile_count * test->frame_count);
+    sk_seq_writer_cleanup(sk, &writer);
+    seq_ns += sk_now_ns() - cleanup_begin;
+
+    /* the last frame must survive the round trip */
+    struct sk_seq_reader reader;
+    sk_seq_reader_init(sk, &reader, "rt.skseq");
+    SkBitmap last;
+    sk_seq_reader_read_frame(sk, &reader, test->frame_count - 1, &last);
+    const struct sk_compare_params params = {};
+    if (sk_compare_pixmaps(sk, pixmap, last.pixmap(), &params, NULL).diff_count)
+        sk_die("sequence does not reproduce the last frame");
+    sk_seq_reader_cleanup(sk, &reader);
+
+    sk_log("%s: %2.0f%% damage, %u frames: sequence %.1f KiB at %.3f ms/frame "
+           "(%.1f%% of tiles), png %.1f KiB at %.3f ms/frame",
+           sk_scene_get_name(test->scene_type), damage * 100.0f, test->frame_count,
+           seq_bytes / 1024.0, seq_ns / 1e6 / test->frame_count, tile_ratio * 100.0,
+           png_bytes / 1024.0, png_ns / 1e6 / test->frame_count);
+    sk_log("sequence: %.2fx smaller, %.2fx faster", (double)png_bytes / seq_bytes,
+           (double)png_ns / seq_ns);
+}
+
+/* reconstructs a frame of a previous run */
+static void
+sequence_raster_test_extract(struct sequence_raster_test *test)
+{
+    struct sk *sk = &test->sk;
+
+    sk_init(sk, NULL);
+
+    struct sk_seq_reader reader;
+    sk_seq_reader_init(sk, &reader, "rt.skseq");
+
+    SkBitmap bitmap;
+    const uint64_t begin = sk_now_ns();
+    sk_seq_reader_read_frame(sk, &reader, test->extract_frame, &bitmap);
+    const uint64_t end = sk_now_ns();
+
+    sk_log("frame %d of %zu: %.3f ms", test->extract_frame, reader.frames.size(),
+           (end - begin) / 1e6);
+    sk_dump_pixmap(sk, bitmap.pixmap(), "rt.png");
+
+    sk_seq_reader_cleanup(sk, &reader);
+    sk_cleanup(sk);
+}
+
+int
+main(int argc, const char **argv)
+{
+    struct sequence_raster_test test = {
+        .width = 1280,
+        .height = 720,
+        .scene_type = SK_SCENE_CIRCLE,
+        .frame_count = 60,
+        .tile_size = 64,
+        .extract_frame = -1,
+    };
+
+    int opt;
+    while ((opt = getopt(argc, (char *const *)argv, "g:s:n:t:x:")) != -1) {
+        switch (opt) {
+        case 'g':
+            if (sscanf(optarg, "%ux%u", &test.width, &test.height) != 2)
+                sk_die("bad geometry %s", optarg);
+            break;
+        case 's':
+            test.scene_type = sk_scene_parse_type(optarg);
+            break;
+        case 'n':
+            test.frame_count = atoi(optarg);
+            break;
+        case 't':
+            test.tile_size = atoi(optarg);
+            break;
+        case 'x':
+            test.extract_frame = atoi(optarg);
+            break;
+        default:
+            sk_die("usage: %s [-g <width>x<height>] [-s <scene>] [-n <frame-count>] "
+                   "[-t <tile-size>] [-x <frame>]",
+                   argv[0]);
+        }
+    }
+    if (!test.width || !test.height || !test.frame_count || !test.tile_size)
+        sk_die("geometry, frame count and tile size must be positive");
+
+    if (test.extract_frame >= 0) {
+        sequence_raster_test_extract(&test);
+        return 0;
+    }
+
+    sequence_raster_test_init(&test);
+    sk_alloc_set_phase(SK_ALLOC_PHASE_DRAW);
+
+    /* every run rewrites rt.skseq; the last one is left for -x */
+    for (uint32_t i = 0; i < ARRAY_SIZE(sk_scene_anim_damages); i++)
+        sequence_raster_test_dump(&test, sk_scene_anim_damages[i]);
+
+    sk_alloc_set_phase(SK_ALLOC_PHASE_CLEANUP);
+    sequence_raster_test_cleanup(&test);
+
+    return 0;
+}
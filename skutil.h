@@ -6,42 +6,355 @@
 #ifndef SKUTIL_H
 #define SKUTIL_H
 
+#include "include/codec/SkAndroidCodec.h"
+#include "include/codec/SkJpegDecoder.h"
 #include "include/codec/SkPngDecoder.h"
 #include "include/core/SkBitmap.h"
 #include "include/core/SkCanvas.h"
+#include "include/core/SkData.h"
+#include "include/core/SkExecutor.h"
+#include "include/core/SkFontMgr.h"
+#include "include/core/SkGraphics.h"
 #include "include/core/SkStream.h"
 #include "include/core/SkSurface.h"
+#include "include/core/SkTextureCompressionType.h"
+#include "include/core/SkTraceMemoryDump.h"
+#include "include/core/SkYUVAPixmaps.h"
 #include "include/encode/SkPngEncoder.h"
+#include "include/gpu/GrBackendSemaphore.h"
 #include "include/gpu/GrBackendSurface.h"
+#include "include/gpu/GrContextOptions.h"
 #include "include/gpu/GrDirectContext.h"
 #include "include/gpu/ganesh/SkImageGanesh.h"
 #include "include/gpu/ganesh/SkSurfaceGanesh.h"
 #include "include/gpu/ganesh/gl/GrGLDirectContext.h"
 #include "include/gpu/ganesh/vk/GrVkDirectContext.h"
 
+#include <algorithm>
 #include <assert.h>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <deque>
+#include <dirent.h>
+#include <errno.h>
 #include <fcntl.h>
+#include <fstream>
+#include <functional>
+#include <future>
+#include <inttypes.h>
+#include <map>
 #include <math.h>
 #include <memory>
+#include <mutex>
+#include <pthread.h>
+#include <sched.h>
+#include <signal.h>
 #include <stdarg.h>
 #include <stdbool.h>
 #include <stdint.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <string>
+#include <strings.h>
+#include <sys/stat.h>
+#include <sys/wait.h>
+#include <thread>
+#include <time.h>
+#include <unistd.h>
+#include <unordered_map>
+#include <vector>
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#elif defined(__aarch64__)
+#include <arm_neon.h>
+#endif
+
+#if defined(__x86_64__)
+#include <asm/prctl.h>
+#include <cpuid.h>
+#include <sys/syscall.h>
+#include <ucontext.h>
+#endif
 
 #define PRINTFLIKE(f, a) __attribute__((format(printf, f, a)))
 #define NORETURN __attribute__((noreturn))
 #define ARRAY_SIZE(a) (sizeof(a) / sizeof((a)[0]))
 
+enum sk_purge_policy {
+    SK_PURGE_NONE,
+    /* purge resources unused for purge_idle_ms */
+    SK_PURGE_IDLE,
+    /* purge unlocked scratch resources every frame */
+    SK_PURGE_SCRATCH,
+    /* purge all unlocked resources every frame */
+    SK_PURGE_ALL,
+};
+
 struct sk_init_params {
-    int unused;
+    /* 0 to not create sk::executor */
+    uint32_t thread_count;
+    /* pin worker i to the i-th cpu in the affinity mask */
+    bool pin_threads;
+    /* when set, Ganesh program binaries are cached in this directory */
+    const char *shader_cache_dir;
+    /* warm up the font manager and codecs on a background thread */
+    bool warm_init;
+    /* 0 to keep the default SkGraphics font cache limit */
+    size_t font_cache_limit;
+    /* comma-separated GpuPathRenderers names; requires GR_TEST_UTILS */
+    const char *gpu_path_renderers;
+    /* 0 to keep the default Ganesh resource cache budget */
+    size_t resource_cache_limit;
+    enum sk_purge_policy purge_policy;
+    uint32_t purge_idle_ms;
+    /* when set, results are appended to this file as json lines */
+    const char *results_path;
 };
 
+class sk_persistent_cache;
+
 struct sk {
     struct sk_init_params params;
+
+    std::unique_ptr<SkExecutor> executor;
+    std::unique_ptr<sk_persistent_cache> shader_cache;
+
+    uint64_t init_ns;
+    bool first_pixel_reported;
+
+    std::thread warm_thread;
+    sk_sp<SkFontMgr> font_mgr;
+};
+
+struct sk_decode_params {
+    /* when non-zero, decode at the largest 1/N scale that fits */
+    uint32_t max_width;
+    uint32_t max_height;
+    /* when non-empty, only this region is materialized */
+    SkIRect subset;
+    /* stream rows through a box filter instead of point sampling */
+    bool streamed;
+    /* decode jpegs to yuva planes when the codec supports it */
+    bool yuva;
+    /* when set, opaque images are transcoded to bc1 and cached here */
+    sk_persistent_cache *compressed_cache;
+};
+
+struct sk_compressed_image {
+    uint32_t width;
+    uint32_t height;
+    SkTextureCompressionType type;
+    /* the blocks, without mipmaps */
+    sk_sp<SkData> data;
+};
+
+/* a decoded image, as rgba pixels, as yuva planes, or as compressed blocks */
+struct sk_decoded_image {
+    sk_sp<SkImage> img;
+    SkYUVAPixmaps yuva;
+    struct sk_compressed_image compressed;
+    uint64_t decode_ns;
+    /* transcoding time on a compressed cache miss, not included in decode_ns */
+    uint64_t encode_ns;
+};
+
+struct sk_prefetch {
+    const std::vector<std::string> *files;
+    const struct sk_decode_params *decode;
+    uint32_t depth;
+
+    size_t next;
+    std::deque<std::future<struct sk_decoded_image>> pending;
+};
+
+/* a mipmapped copy of an image */
+struct sk_mipmap_entry {
+    sk_sp<SkImage> img;
+    size_t bytes;
+};
+
+/* mipmapped copies keyed by the unique id of the original, so that mipmaps are built once */
+struct sk_mipmap_cache {
+    size_t budget;
+    size_t bytes;
+    std::unordered_map<uint32_t, struct sk_mipmap_entry> entries;
+    /* unique ids in insertion order, for eviction */
+    std::deque<uint32_t> order;
+
+    uint32_t hit_count;
+    uint32_t miss_count;
+    uint64_t build_ns;
+    /* summed over misses; mip_bytes excludes the base levels */
+    uint64_t base_bytes;
+    uint64_t mip_bytes;
+};
+
+struct sk_sampling_mode {
+    const char *name;
+    SkSamplingOptions sampling;
+};
+
+static const struct sk_sampling_mode sk_sampling_modes[] = {
+    { "nearest", SkSamplingOptions(SkFilterMode::kNearest) },
+    { "linear", SkSamplingOptions(SkFilterMode::kLinear) },
+    { "mipmap", SkSamplingOptions(SkFilterMode::kLinear, SkMipmapMode::kLinear) },
+    { "cubic", SkSamplingOptions(SkCubicResampler::Mitchell()) },
+};
+
+static const float sk_sampling_scales[] = { 0.125f, 0.25f, 0.5f, 0.75f, 1.0f, 1.5f, 2.0f };
+
+#define SK_SAMPLING_MODE_COUNT ARRAY_SIZE(sk_sampling_modes)
+#define SK_SAMPLING_SCALE_COUNT ARRAY_SIZE(sk_sampling_scales)
+
+/* draw times of the sampling matrix, summed over images */
+struct sk_sampling_stats {
+    uint32_t image_count;
+    /* draws per image and cell */
+    uint32_t repeat_count;
+    uint64_t ns[SK_SAMPLING_SCALE_COUNT][SK_SAMPLING_MODE_COUNT];
+    uint64_t pixel_count[SK_SAMPLING_SCALE_COUNT];
+};
+
+struct sk_compare_params {
+    /* per-channel tolerance, in memory order (RGBA) */
+    uint8_t tolerance[4];
 };
 
+struct sk_compare_result {
+    /* per-channel max abs diff, in memory order (RGBA) */
+    uint8_t max_diff[4];
+    /* number of pixels with any channel exceeding the tolerance */
+    uint64_t diff_count;
+};
+
+#define SK_MAX_FRAMES_IN_FLIGHT 3
+
+/* a frame that may still be in flight on the gpu */
+struct sk_frame_slot {
+    sk_sp<SkSurface> surf;
+    uint32_t frame;
+    bool pending;
+
+    uint64_t begin_ns;
+    uint64_t end_ns;
+};
+
+struct sk_frame_stats {
+    uint32_t frame_count;
+    uint64_t latency_total_ns;
+    uint64_t latency_max_ns;
+};
+
+/* appends frames to a sequence file, writing only the tiles that changed */
+struct sk_seq_writer {
+    SkImageInfo info;
+    uint32_t tile_size;
+    uint32_t tiles_x;
+    uint32_t tile_count;
+
+    std::unique_ptr<SkFILEWStream> stream;
+    /* per tile, the hash of the last written pixels and their file offset */
+    std::vector<uint64_t> hashes;
+    std::vector<uint64_t> offsets;
+
+    uint32_t frame_count;
+    uint64_t written_tile_count;
+};
+
+struct sk_seq_reader {
+    sk_sp<SkData> data;
+    SkImageInfo info;
+    uint32_t tile_size;
+    uint32_t tiles_x;
+    uint32_t tile_count;
+
+    /* file offsets of the frame records */
+    std::vector<size_t> frames;
+};
+
+typedef void (*sk_seq_hash_row_func)(const uint32_t *pixels, uint32_t count, uint32_t lanes[4]);
+
+/* the cpu feature levels skia's raster backend dispatches on, lowest first */
+enum sk_cpu_level_type {
+    SK_CPU_LEVEL_SSE2,
+    SK_CPU_LEVEL_SSE41,
+    SK_CPU_LEVEL_AVX,
+    SK_CPU_LEVEL_HSW,
+    SK_CPU_LEVEL_SKX,
+    SK_CPU_LEVEL_COUNT,
+};
+
+struct sk_cpu_level {
+    const char *name;
+    /* cpuid bits introduced at this level, cleared at lower levels */
+    uint32_t leaf1_ecx;
+    uint32_t leaf7_ebx;
+    uint32_t leaf7_ecx;
+};
+
+/* the outcome of running a workload at every level */
+struct sk_cpu_level_results {
+    /* a level can run and take no measurable time */
+    bool ran[SK_CPU_LEVEL_COUNT];
+    uint64_t ns[SK_CPU_LEVEL_COUNT];
+};
+
+static const struct sk_cpu_level sk_cpu_levels[SK_CPU_LEVEL_COUNT] = {
+    { "sse2", 0, 0, 0 },
+    /* sse3, ssse3, sse4.1 */
+    { "sse41", (1u << 0) | (1u << 9) | (1u << 19), 0, 0 },
+    /* sse4.2, popcnt, avx */
+    { "avx", (1u << 20) | (1u << 23) | (1u << 28), 0, 0 },
+    /* fma, f16c; bmi1, avx2, bmi2 */
+    { "hsw", (1u << 12) | (1u << 29), (1u << 3) | (1u << 5) | (1u << 8), 0 },
+    /* avx512 f, dq, ifma, cd, bw, vl; vbmi, vbmi2, vnni, bitalg, vpopcntdq */
+    { "skx", 0, (1u << 16) | (1u << 17) | (1u << 21) | (1u << 28) | (1u << 30) | (1u << 31),
+      (1u << 1) | (1u << 6) | (1u << 11) | (1u << 12) | (1u << 14) },
+};
+
+enum sk_alloc_phase {
+    SK_ALLOC_PHASE_INIT,
+    SK_ALLOC_PHASE_DRAW,
+    SK_ALLOC_PHASE_FLUSH,
+    SK_ALLOC_PHASE_DUMP,
+    SK_ALLOC_PHASE_CLEANUP,
+    SK_ALLOC_PHASE_COUNT,
+};
+
+typedef void (*sk_compare_row_func)(const uint8_t *a,
+                                    const uint8_t *b,
+                                    uint8_t *diff,
+                                    uint32_t count,
+                                    const uint8_t tolerance[4],
+                                    struct sk_compare_result *res);
+
+#if SK_ALLOC_STATS
+
+/* skutil_alloc.cpp hooks the allocators and attributes allocations to the current phase */
+enum sk_alloc_phase
+sk_alloc_set_phase(enum sk_alloc_phase phase);
+
+void
+sk_alloc_mark_warm(void);
+
+#else
+
+static inline enum sk_alloc_phase
+sk_alloc_set_phase(enum sk_alloc_phase phase)
+{
+    return phase;
+}
+
+static inline void
+sk_alloc_mark_warm(void)
+{
+}
+
+#endif
+
 static inline void
 sk_logv(const char *format, va_list ap)
 {
@@ -73,17 +386,514 @@ static inline void PRINTFLIKE(1, 2) NORETURN sk_die(const char *format, ...)
     va_end(ap);
 }
 
+/* a work-stealing thread pool with one task deque per worker */
+class sk_executor : public SkExecutor {
+  public:
+    sk_executor(uint32_t thread_count, bool pin_threads) : pending_(0), stop_(false)
+    {
+        for (uint32_t i = 0; i < thread_count; i++)
+            workers_.push_back(std::make_unique<worker>());
+
+        /* pin to the cpus we are allowed to run on, which need not be 0..n-1 */
+        std::vector<int> cpus;
+        cpu_set_t allowed;
+        if (pin_threads && !sched_getaffinity(0, sizeof(allowed), &allowed)) {
+            for (int cpu = 0; cpu < CPU_SETSIZE; cpu++) {
+                if (CPU_ISSET(cpu, &allowed))
+                    cpus.push_back(cpu);
+            }
+        }
+
+        for (uint32_t i = 0; i < thread_count; i++) {
+            workers_[i]->thread = std::thread([this, i] { run(i); });
+
+            if (!cpus.empty()) {
+                cpu_set_t set;
+                CPU_ZERO(&set);
+                CPU_SET(cpus[i % cpus.size()], &set);
+                const pthread_t thread = workers_[i]->thread.native_handle();
+                if (pthread_setaffinity_np(thread, sizeof(set), &set))
+                    sk_log("failed to pin worker %u", i);
+            }
+        }
+    }
+
+    ~sk_executor() override
+    {
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            stop_ = true;
+        }
+        cond_.notify_all();
+
+        for (auto &w : workers_)
+            w->thread.join();
+    }
+
+    void add(std::function<void(void)> task) override
+    {
+        /* workers push to their own deques and external threads distribute round-robin */
+        uint32_t idx = current_worker();
+        if (idx == UINT32_MAX)
+            idx = next_.fetch_add(1, std::memory_order_relaxed) % workers_.size();
+
+        {
+            std::lock_guard<std::mutex> lock(workers_[idx]->mutex);
+            workers_[idx]->tasks.push_back(std::move(task));
+        }
+
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            pending_++;
+        }
+        cond_.notify_one();
+    }
+
+    void borrow() override
+    {
+        std::function<void(void)> task;
+        if (steal(0, &task))
+            task();
+    }
+
+    uint32_t thread_count() const { return workers_.size(); }
+
+  private:
+    struct worker {
+        std::mutex mutex;
+        std::deque<std::function<void(void)>> tasks;
+        std::thread thread;
+    };
+
+    struct worker_tls {
+        const sk_executor *owner;
+        uint32_t idx;
+    };
+
+    static worker_tls &tls()
+    {
+        static thread_local worker_tls t = { NULL, UINT32_MAX };
+        return t;
+    }
+
+    uint32_t current_worker() const { return tls().owner == this ? tls().idx : UINT32_MAX; }
+
+    bool pop(uint32_t idx, std::function<void(void)> *task)
+    {
+        worker *w = workers_[idx].get();
+        std::lock_guard<std::mutex> lock(w->mutex);
+        if (w->tasks.empty())
+            return false;
+
+        *task = std::move(w->tasks.back());
+        w->tasks.pop_back();
+        pending_--;
+        return true;
+    }
+
+    bool steal(uint32_t first, std::function<void(void)> *task)
+    {
+        for (uint32_t i = 0; i < workers_.size(); i++) {
+            worker *w = workers_[(first + i) % workers_.size()].get();
+            std::lock_guard<std::mutex> lock(w->mutex);
+            if (w->tasks.empty())
+                continue;
+
+            *task = std::move(w->tasks.front());
+            w->tasks.pop_front();
+            pending_--;
+            return true;
+        }
+        return false;
+    }
+
+    void run(uint32_t idx)
+    {
+        tls() = { this, idx };
+
+        while (true) {
+            std::function<void(void)> task;
+            if (pop(idx, &task) || steal(idx + 1, &task)) {
+                task();
+                continue;
+            }
+
+            std::unique_lock<std::mutex> lock(mutex_);
+            cond_.wait(lock, [this] { return pending_ > 0 || stop_; });
+            if (stop_ && !pending_)
+                break;
+        }
+    }
+
+    std::vector<std::unique_ptr<worker>> workers_;
+    std::atomic<uint32_t> next_{ 0 };
+
+    /* pending_ is only incremented with mutex_ held to not lose wakeups */
+    std::mutex mutex_;
+    std::condition_variable cond_;
+    std::atomic<int64_t> pending_;
+    bool stop_;
+};
+
+/* a persistent cache storing one file per key in a directory */
+class sk_persistent_cache : public GrContextOptions::PersistentCache {
+  public:
+    sk_persistent_cache(const char *dir) : dir_(dir), load_count_(0), hit_count_(0)
+    {
+        if (mkdir(dir, 0755) && errno != EEXIST)
+            sk_die("failed to create %s", dir);
+    }
+
+    sk_sp<SkData> load(const SkData &key) override
+    {
+        load_count_++;
+
+        /* the filename is only a hash; the stored key must match */
+        sk_sp<SkData> file = SkData::MakeFromFileName(get_filename(key).c_str());
+        if (!file || file->size() < sizeof(uint64_t))
+            return nullptr;
+
+        uint64_t key_size;
+        memcpy(&key_size, file->data(), sizeof(key_size));
+        const size_t header_size = sizeof(key_size) + key.size();
+        if (key_size != key.size() || file->size() < header_size ||
+            memcmp(file->bytes() + sizeof(key_size), key.data(), key.size()))
+            return nullptr;
+
+        hit_count_++;
+        return SkData::MakeSubset(file.get(), header_size, file->size() - header_size);
+    }
+
+    void store(const SkData &key, const SkData &data, const SkString &description) override
+    {
+        /* write to a temp file and rename for other processes sharing the directory */
+        const std::string filename = get_filename(key);
+        const std::string tmp_filename = filename + "." + std::to_string(getpid());
+        {
+            const uint64_t key_size = key.size();
+            SkFILEWStream writer(tmp_filename.c_str());
+            if (!writer.isValid() || !writer.write(&key_size, sizeof(key_size)) ||
+                !writer.write(key.data(), key.size()) ||
+                !writer.write(data.data(), data.size())) {
+                sk_log("failed to store %s", tmp_filename.c_str());
+                return;
+            }
+        }
+        if (rename(tmp_filename.c_str(), filename.c_str()))
+            sk_log("failed to rename %s", tmp_filename.c_str());
+    }
+
+    uint32_t load_count() const { return load_count_; }
+    uint32_t hit_count() const { return hit_count_; }
+
+  private:
+    std::string get_filename(const SkData &key) const
+    {
+        /* 64-bit FNV-1a */
+        uint64_t hash = 0xcbf29ce484222325ull;
+        const uint8_t *bytes = key.bytes();
+        for (size_t i = 0; i < key.size(); i++) {
+            hash ^= bytes[i];
+            hash *= 0x100000001b3ull;
+        }
+
+        char name[64];
+        snprintf(name, sizeof(name), "/%016" PRIx64 "-%zu", hash, key.size());
+        return dir_ + name;
+    }
+
+    const std::string dir_;
+    std::atomic<uint32_t> load_count_;
+    std::atomic<uint32_t> hit_count_;
+};
+
+/* aggregates the sizes of the dumped objects by category */
+class sk_memory_dump : public SkTraceMemoryDump {
+  public:
+    void dumpNumericValue(const char *dumpName,
+                          const char *valueName,
+                          const char *units,
+                          uint64_t value) override
+    {
+        if (!strcmp(valueName, "size"))
+            objects_[dumpName].size = value;
+    }
+
+    void dumpStringValue(const char *dumpName, const char *valueName, const char *value) override
+    {
+        if (!strcmp(valueName, "category"))
+            objects_[dumpName].category = value;
+    }
+
+    void setMemoryBacking(const char *dumpName,
+                          const char *backingType,
+                          const char *backingObjectId) override
+    {
+    }
+
+    void setDiscardableMemoryBacking(const char *dumpName,
+                                     const SkDiscardableMemory &discardableMemoryObject) override
+    {
+    }
+
+    LevelOfDetail getRequestedDetails() const override
+    {
+        return SkTraceMemoryDump::kObjectsBreakdowns_LevelOfDetail;
+    }
+
+    bool shouldDumpWrappedObjects() const override { return false; }
+
+    std::map<std::string, uint64_t> totals() const
+    {
+        std::map<std::string, uint64_t> totals;
+        for (const auto &iter : objects_) {
+            const std::string &category =
+                iter.second.category.empty() ? iter.first : iter.second.category;
+            totals[category] += iter.second.size;
+        }
+        return totals;
+    }
+
+  private:
+    struct object {
+        uint64_t size;
+        std::string category;
+    };
+
+    std::unordered_map<std::string, object> objects_;
+};
+
+static inline uint64_t
+sk_now_ns(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ull + ts.tv_nsec;
+}
+
+static inline void
+sk_init_graphics(void)
+{
+    static std::once_flag once;
+    std::call_once(once, [] { SkGraphics::Init(); });
+}
+
+/*
+ * SkGraphics::Init stays on the calling thread, which may draw before the warm-up finishes.
+ * GPU contexts are not created here: Ganesh and EGL contexts belong to the thread that uses
+ * them, and the caller sets up the GPU while this thread runs.
+ */
+static inline void
+sk_warm_init(struct sk *sk)
+{
+    sk_init_graphics();
+
+    sk->warm_thread = std::thread([sk] {
+        sk->font_mgr = SkFontMgr::RefDefault();
+        sk->font_mgr->legacyMakeTypeface(NULL, SkFontStyle());
+
+        /* round-trip a pixel through the png codec */
+        SkBitmap bitmap;
+        bitmap.allocPixels(SkImageInfo::MakeN32Premul(1, 1));
+        bitmap.eraseColor(SK_ColorWHITE);
+        SkDynamicMemoryWStream writer;
+        if (SkPngEncoder::Encode(&writer, bitmap.pixmap(), SkPngEncoder::Options())) {
+            std::unique_ptr<SkCodec> codec = SkPngDecoder::Decode(writer.detachAsData(), NULL);
+            if (codec)
+                codec->getImage();
+        }
+    });
+}
+
+static inline void
+sk_warm_wait(struct sk *sk)
+{
+    if (sk->warm_thread.joinable())
+        sk->warm_thread.join();
+}
+
 static inline void
 sk_init(struct sk *sk, const struct sk_init_params *params)
 {
-    memset(sk, 0, sizeof(*sk));
+    *sk = {};
     if (params)
         sk->params = *params;
+
+    sk->init_ns = sk_now_ns();
+    if (sk->params.warm_init)
+        sk_warm_init(sk);
+    else
+        sk_init_graphics();
+
+    /* allow the pool to be sized without rebuilding */
+    const char *thread_count = getenv("SK_THREAD_COUNT");
+    if (thread_count) {
+        char *end;
+        const long val = strtol(thread_count, &end, 10);
+        if (end == thread_count || *end || val < 0 || val > 1024)
+            sk_die("invalid SK_THREAD_COUNT %s", thread_count);
+        sk->params.thread_count = val;
+    }
+    const char *pin_threads = getenv("SK_PIN_THREADS");
+    if (pin_threads)
+        sk->params.pin_threads = atoi(pin_threads);
+
+    const char *shader_cache_dir = getenv("SK_SHADER_CACHE_DIR");
+    if (shader_cache_dir)
+        sk->params.shader_cache_dir = shader_cache_dir;
+    const char *font_cache_limit = getenv("SK_FONT_CACHE_LIMIT");
+    if (font_cache_limit)
+        sk->params.font_cache_limit = strtoull(font_cache_limit, NULL, 0);
+    const char *gpu_path_renderers = getenv("SK_GPU_PATH_RENDERERS");
+    if (gpu_path_renderers)
+        sk->params.gpu_path_renderers = gpu_path_renderers;
+    const char *results_path = getenv("SK_RESULTS");
+    if (results_path)
+        sk->params.results_path = results_path;
+
+    if (sk->params.font_cache_limit)
+        SkGraphics::SetFontCacheLimit(sk->params.font_cache_limit);
+
+    if (sk->params.thread_count)
+        sk->executor =
+            std::make_unique<sk_executor>(sk->params.thread_count, sk->params.pin_threads);
+    if (sk->params.shader_cache_dir)
+        sk->shader_cache = std::make_unique<sk_persistent_cache>(sk->params.shader_cache_dir);
 }
 
 static inline void
 sk_cleanup(struct sk *sk)
 {
+    sk_warm_wait(sk);
+    sk->font_mgr.reset();
+    sk->shader_cache.reset();
+    sk->executor.reset();
+}
+
+static inline sk_sp<SkFontMgr>
+sk_get_font_mgr(struct sk *sk)
+{
+    sk_warm_wait(sk);
+    if (!sk->font_mgr)
+        sk->font_mgr = SkFontMgr::RefDefault();
+    return sk->font_mgr;
+}
+
+/* returns the process start time on the CLOCK_BOOTTIME timeline */
+static inline uint64_t
+sk_get_process_start_ns(void)
+{
+    FILE *fp = fopen("/proc/self/stat", "r");
+    if (!fp)
+        return 0;
+
+    char buf[1024];
+    const size_t len = fread(buf, 1, sizeof(buf) - 1, fp);
+    fclose(fp);
+    buf[len] = '\0';
+
+    /* starttime is the 22nd field and comm, the 2nd field, can contain spaces */
+    const char *p = strrchr(buf, ')');
+    if (!p)
+        return 0;
+    for (int i = 2; i < 22 && p; i++)
+        p = strchr(p + 1, ' ');
+    if (!p)
+        return 0;
+
+    const uint64_t ticks = strtoull(p + 1, NULL, 10);
+    return ticks * 1000000000ull / sysconf(_SC_CLK_TCK);
+}
+
+/* returns 0 when unknown; the resolution is a clock tick */
+static inline uint64_t
+sk_get_ns_since_exec(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_BOOTTIME, &ts);
+    const uint64_t boot_ns = (uint64_t)ts.tv_sec * 1000000000ull + ts.tv_nsec;
+    const uint64_t start_ns = sk_get_process_start_ns();
+
+    return start_ns && start_ns < boot_ns ? boot_ns - start_ns : 0;
+}
+
+/* returns VmHWM in bytes */
+static inline size_t
+sk_get_peak_rss(void)
+{
+    FILE *fp = fopen("/proc/self/status", "r");
+    if (!fp)
+        return 0;
+
+    size_t kb = 0;
+    char line[256];
+    while (fgets(line, sizeof(line), fp)) {
+        if (sscanf(line, "VmHWM: %zu kB", &kb) == 1)
+            break;
+    }
+    fclose(fp);
+
+    return kb * 1024;
+}
+
+/* reads statm with libc calls that do not allocate, so the allocator hooks can call it */
+static inline size_t
+sk_get_rss(void)
+{
+    const int fd = open("/proc/self/statm", O_RDONLY | O_CLOEXEC);
+    if (fd < 0)
+        return 0;
+
+    char buf[128];
+    const ssize_t len = read(fd, buf, sizeof(buf) - 1);
+    close(fd);
+    if (len <= 0)
+        return 0;
+    buf[len] = '\0';
+
+    size_t size, resident;
+    if (sscanf(buf, "%zu %zu", &size, &resident) != 2)
+        return 0;
+
+    return resident * sysconf(_SC_PAGESIZE);
+}
+
+/* resets VmHWM to the current RSS */
+static inline void
+sk_reset_peak_rss(void)
+{
+    FILE *fp = fopen("/proc/self/clear_refs", "w");
+    if (!fp)
+        return;
+    fputs("5", fp);
+    fclose(fp);
+}
+
+/* reports the time to first pixel once; call it when the first frame is done */
+static inline void
+sk_report_first_pixel(struct sk *sk)
+{
+    if (sk->first_pixel_reported)
+        return;
+    sk->first_pixel_reported = true;
+    sk_alloc_mark_warm();
+
+    const uint64_t init_elapsed = sk_now_ns() - sk->init_ns;
+    const uint64_t exec_elapsed = sk_get_ns_since_exec();
+
+    if (exec_elapsed) {
+        sk_log("first pixel: %.3f ms after sk_init, %.3f ms after exec", init_elapsed / 1e6,
+               exec_elapsed / 1e6);
+    } else {
+        sk_log("first pixel: %.3f ms after sk_init", init_elapsed / 1e6);
+    }
+}
+
+static inline uint32_t
+sk_get_cpu_count(void)
+{
+    const long count = sysconf(_SC_NPROCESSORS_ONLN);
+    return count > 0 ? count : 1;
 }
 
 static inline SkImageInfo
@@ -104,26 +914,138 @@ sk_create_surface_raster(struct sk *sk, uint32_t width, uint32_t height)
     return surf;
 }
 
+#if GR_TEST_UTILS
+static inline GpuPathRenderers
+sk_parse_gpu_path_renderers(const char *names)
+{
+    static const struct {
+        const char *name;
+        GpuPathRenderers bits;
+    } renderers[] = {
+        { "none", GpuPathRenderers::kNone },
+        { "software", GpuPathRenderers::kNone },
+        { "dashline", GpuPathRenderers::kDashLine },
+        { "atlas", GpuPathRenderers::kAtlas },
+        { "tessellation", GpuPathRenderers::kTessellation },
+        { "aahairline", GpuPathRenderers::kAAHairline },
+        { "aaconvex", GpuPathRenderers::kAAConvex },
+        { "aalinearizing", GpuPathRenderers::kAALinearizing },
+        { "small", GpuPathRenderers::kSmall },
+        { "triangulating", GpuPathRenderers::kTriangulating },
+        { "default", GpuPathRenderers::kDefault },
+    };
+
+    uint32_t bits = 0;
+    std::string list(names);
+    size_t begin = 0;
+    while (begin <= list.size()) {
+        size_t end = list.find(',', begin);
+        if (end == std::string::npos)
+            end = list.size();
+        const std::string name = list.substr(begin, end - begin);
+
+        uint32_t i;
+        for (i = 0; i < ARRAY_SIZE(renderers); i++) {
+            if (name == renderers[i].name) {
+                bits |= static_cast<uint32_t>(renderers[i].bits);
+                break;
+            }
+        }
+        if (i == ARRAY_SIZE(renderers))
+            sk_die("unknown gpu path renderer %s", name.c_str());
+
+        begin = end + 1;
+    }
+
+    return static_cast<GpuPathRenderers>(bits);
+}
+#endif
+
+static inline GrContextOptions
+sk_make_context_options(struct sk *sk)
+{
+    GrContextOptions options;
+    options.fExecutor = sk->executor.get();
+    if (sk->shader_cache) {
+        options.fPersistentCache = sk->shader_cache.get();
+        options.fShaderCacheStrategy = GrContextOptions::ShaderCacheStrategy::kBackendBinary;
+    }
+
+    if (sk->params.gpu_path_renderers) {
+#if GR_TEST_UTILS
+        options.fGpuPathRenderers = sk_parse_gpu_path_renderers(sk->params.gpu_path_renderers);
+#else
+        sk_die("gpu path renderer selection requires a Skia build with GR_TEST_UTILS");
+#endif
+    }
+
+    return options;
+}
+
+static inline void
+sk_init_context_ganesh(struct sk *sk, GrDirectContext *ctx)
+{
+    if (sk->params.resource_cache_limit)
+        ctx->setResourceCacheLimit(sk->params.resource_cache_limit);
+}
+
 static inline sk_sp<GrDirectContext>
 sk_create_context_ganesh_gl(struct sk *sk)
 {
-    /* use the default GrGLInterface and GrContextOptions */
-    sk_sp<GrDirectContext> ctx = GrDirectContexts::MakeGL();
+    /* use the default GrGLInterface */
+    const GrContextOptions options = sk_make_context_options(sk);
+    sk_sp<GrDirectContext> ctx = GrDirectContexts::MakeGL(options);
     if (!ctx)
         sk_die("failed to create ganesh gl context");
+    sk_init_context_ganesh(sk, ctx.get());
     return ctx;
 }
 
 static inline sk_sp<GrDirectContext>
 sk_create_context_ganesh_vk(struct sk *sk, const GrVkBackendContext &backend)
 {
-    /* use the default GrContextOptions */
-    sk_sp<GrDirectContext> ctx = GrDirectContexts::MakeVulkan(backend);
+    const GrContextOptions options = sk_make_context_options(sk);
+    sk_sp<GrDirectContext> ctx = GrDirectContexts::MakeVulkan(backend, options);
     if (!ctx)
         sk_die("failed to create ganesh vk context");
+    sk_init_context_ganesh(sk, ctx.get());
     return ctx;
 }
 
+/* applies sk_init_params::purge_policy; call it once per frame */
+static inline void
+sk_purge_context_ganesh(struct sk *sk, GrDirectContext *ctx)
+{
+    switch (sk->params.purge_policy) {
+    case SK_PURGE_IDLE:
+        ctx->performDeferredCleanup(std::chrono::milliseconds(sk->params.purge_idle_ms));
+        break;
+    case SK_PURGE_SCRATCH:
+        ctx->purgeUnlockedResources(GrPurgeResourceOptions::kScratchResourcesOnly);
+        break;
+    case SK_PURGE_ALL:
+        ctx->purgeUnlockedResources(GrPurgeResourceOptions::kAllResources);
+        break;
+    default:
+        break;
+    }
+}
+
+static inline void
+sk_report_context_ganesh(struct sk *sk, GrDirectContext *ctx)
+{
+    int count;
+    size_t bytes;
+    ctx->getResourceCacheUsage(&count, &bytes);
+    sk_log("resource cache: %d resources, %zu/%zu bytes, %zu purgeable", count, bytes,
+           ctx->getResourceCacheLimit(), ctx->getResourceCachePurgeableBytes());
+
+    sk_memory_dump dump;
+    ctx->dumpMemoryStatistics(&dump);
+    for (const auto &iter : dump.totals())
+        sk_log("  %s: %" PRIu64 " bytes", iter.first.c_str(), iter.second);
+}
+
 static inline sk_sp<SkSurface>
 sk_create_surface_ganesh(struct sk *sk,
                          sk_sp<GrDirectContext> ctx,
@@ -137,35 +1059,1728 @@ sk_create_surface_ganesh(struct sk *sk,
     return surf;
 }
 
+/*
+ * a GrFlushInfo::fFinishedProc for sk_frame_slot; it runs from checkAsyncWorkCompletion, so
+ * callers poll that every frame for end_ns to be within a frame of the gpu finishing
+ */
 static inline void
-sk_dump_surface(struct sk *sk, sk_sp<SkSurface> surf, const char *filename)
+sk_frame_slot_finished(GrGpuFinishedContext ctx)
 {
-    SkFILEWStream writer(filename);
-    if (!writer.isValid())
-        sk_die("failed to create %s", filename);
+    struct sk_frame_slot *slot = (struct sk_frame_slot *)ctx;
+    slot->end_ns = sk_now_ns();
+    slot->pending = false;
+}
 
-    SkBitmap bitmap;
-    SkPixmap pixmap;
-    if (!surf->peekPixels(&pixmap)) {
-        bitmap.allocPixels(surf->imageInfo());
-        surf->readPixels(bitmap.pixmap(), 0, 0);
-        pixmap = bitmap.pixmap();
+static inline void
+sk_frame_slots_init(struct sk *sk,
+                    sk_sp<GrDirectContext> ctx,
+                    struct sk_frame_slot *slots,
+                    uint32_t count,
+                    uint32_t width,
+                    uint32_t height)
+{
+    for (uint32_t i = 0; i < count; i++) {
+        slots[i] = {};
+        slots[i].surf = sk_create_surface_ganesh(sk, ctx, width, height);
     }
+}
+
+static inline void
+sk_frame_slot_begin(struct sk_frame_slot *slot, uint32_t frame)
+{
+    slot->frame = frame;
+    slot->pending = true;
+    slot->begin_ns = sk_now_ns();
+}
 
-    if (!SkPngEncoder::Encode(&writer, pixmap, SkPngEncoder::Options()))
-        sk_die("failed to encode pixmap");
+/* fills in the pacing fields of a flush for the slot */
+static inline GrFlushInfo
+sk_frame_slot_flush_info(struct sk_frame_slot *slot, GrBackendSemaphore *signal)
+{
+    GrFlushInfo info;
+    info.fNumSemaphores = signal ? 1 : 0;
+    info.fSignalSemaphores = signal;
+    info.fFinishedProc = sk_frame_slot_finished;
+    info.fFinishedContext = slot;
+    return info;
 }
 
-static inline sk_sp<SkImage>
-sk_load_png(struct sk *sk, const char *filename)
+/* records the latency of a slot whose gpu work has finished */
+static inline void
+sk_frame_stats_add(struct sk_frame_stats *stats, const struct sk_frame_slot *slot)
 {
-    std::unique_ptr<SkFILEStream> reader = SkFILEStream::Make(filename);
-    if (!reader)
-        sk_die("failed to open %s", filename);
+    assert(!slot->pending);
+
+    const uint64_t latency = slot->end_ns - slot->begin_ns;
+    stats->frame_count++;
+    stats->latency_total_ns += latency;
+    stats->latency_max_ns = std::max(stats->latency_max_ns, latency);
+}
 
-    std::unique_ptr<SkCodec> codec = SkPngDecoder::Decode(std::move(reader), NULL);
+static inline void
+sk_frame_stats_report(struct sk *sk,
+                      const char *backend,
+                      uint32_t frames_in_flight,
+                      const struct sk_frame_stats *stats,
+                      uint64_t elapsed_ns)
+{
+    sk_log("%s: %u frame(s) in flight: %.1f frames/s, latency avg %.3f ms, max %.3f ms",
+           backend, frames_in_flight, stats->frame_count * 1e9 / elapsed_ns,
+           stats->latency_total_ns / 1e6 / stats->frame_count, stats->latency_max_ns / 1e6);
+}
 
-    return std::get<0>(codec->getImage());
+static inline bool
+sk_has_suffix(const char *str, const char *suffix)
+{
+    const size_t len = strlen(str);
+    const size_t suffix_len = strlen(suffix);
+    return len >= suffix_len && !strcasecmp(str + len - suffix_len, suffix);
+}
+
+static inline SkPixmap
+sk_read_surface(struct sk *sk, sk_sp<SkSurface> surf, SkBitmap *bitmap)
+{
+    SkPixmap pixmap;
+    if (!surf->peekPixels(&pixmap)) {
+        bitmap->allocPixels(surf->imageInfo());
+        surf->readPixels(bitmap->pixmap(), 0, 0);
+        pixmap = bitmap->pixmap();
+    }
+    return pixmap;
+}
+
+/* unlike sk_read_surface, the bitmap never aliases the surface */
+static inline void
+sk_copy_surface(struct sk *sk, sk_sp<SkSurface> surf, SkBitmap *bitmap)
+{
+    const enum sk_alloc_phase phase = sk_alloc_set_phase(SK_ALLOC_PHASE_DUMP);
+    bitmap->allocPixels(surf->imageInfo());
+    if (!surf->readPixels(bitmap->pixmap(), 0, 0))
+        sk_die("failed to read surface");
+    sk_alloc_set_phase(phase);
+}
+
+static inline void
+sk_dump_pixmap(struct sk *sk, const SkPixmap &pixmap, const char *filename)
+{
+    const enum sk_alloc_phase phase = sk_alloc_set_phase(SK_ALLOC_PHASE_DUMP);
+
+    {
+        SkFILEWStream writer(filename);
+        if (!writer.isValid())
+            sk_die("failed to create %s", filename);
+
+        /* raw dumps are tightly packed pixels and can be used as goldens without decoding */
+        if (sk_has_suffix(filename, ".raw")) {
+            const size_t row_size = pixmap.info().minRowBytes();
+            for (int y = 0; y < pixmap.height(); y++) {
+                if (!writer.write(pixmap.addr(0, y), row_size))
+                    sk_die("failed to write %s", filename);
+            }
+        } else if (!SkPngEncoder::Encode(&writer, pixmap, SkPngEncoder::Options())) {
+            sk_die("failed to encode pixmap");
+        }
+    }
+
+    sk_alloc_set_phase(phase);
+}
+
+static inline void
+sk_dump_surface(struct sk *sk, sk_sp<SkSurface> surf, const char *filename)
+{
+    const enum sk_alloc_phase phase = sk_alloc_set_phase(SK_ALLOC_PHASE_DUMP);
+
+    /* the readback bitmap is accounted to the dump */
+    {
+        SkBitmap bitmap;
+        const SkPixmap pixmap = sk_read_surface(sk, surf, &bitmap);
+        sk_dump_pixmap(sk, pixmap, filename);
+    }
+
+    sk_alloc_set_phase(phase);
+}
+
+/* returns the smallest sample size at which region fits the limits */
+static inline uint32_t
+sk_decode_get_sample_size(const struct sk_decode_params *params, const SkIRect &region)
+{
+    const uint32_t width = region.width();
+    const uint32_t height = region.height();
+
+    uint32_t sample = 1;
+    if (params->max_width)
+        sample = std::max(sample, (width + params->max_width - 1) / params->max_width);
+    if (params->max_height)
+        sample = std::max(sample, (height + params->max_height - 1) / params->max_height);
+    return sample;
+}
+
+/* decodes region one band of sample rows at a time and box-filters each band */
+static inline sk_sp<SkImage>
+sk_load_image_streamed(struct sk *sk,
+                     const char *filename,
+                     SkCodec *codec,
+                     const SkIRect &region,
+                     uint32_t sample)
+{
+    sample = std::min(sample, (uint32_t)std::min(region.width(), region.height()));
+    const uint32_t dst_width = region.width() / sample;
+    const uint32_t dst_height = region.height() / sample;
+
+    /*
+     * scanline decoding only subsets in x: the decode info is the full image and the subset
+     * spans all rows, while the rows handed back are region.width() wide
+     */
+    const SkISize dims = codec->dimensions();
+    const SkIRect x_subset = SkIRect::MakeLTRB(region.left(), 0, region.right(), dims.height());
+    SkCodec::Options options;
+    options.fSubset = region.width() != dims.width() ? &x_subset : NULL;
+
+    const SkImageInfo band_info = SkImageInfo::MakeN32Premul(region.width(), sample);
+    const SkImageInfo decode_info = band_info.makeDimensions(dims);
+    if (codec->startScanlineDecode(decode_info, &options) != SkCodec::kSuccess)
+        sk_die("failed to start decoding %s", filename);
+    if (region.top() && !codec->skipScanlines(region.top()))
+        sk_die("failed to skip rows of %s", filename);
+
+    SkBitmap band;
+    band.allocPixels(band_info);
+    SkBitmap bitmap;
+    bitmap.allocPixels(SkImageInfo::MakeN32Premul(dst_width, dst_height));
+    std::vector<uint32_t> sums(dst_width * 4);
+
+    const uint32_t area = sample * sample;
+    for (uint32_t y = 0; y < dst_height; y++) {
+        if (codec->getScanlines(band.getPixels(), sample, band.rowBytes()) != (int)sample)
+            sk_die("failed to decode rows of %s", filename);
+
+        std::fill(sums.begin(), sums.end(), 0);
+        for (uint32_t row = 0; row < sample; row++) {
+            const uint8_t *src = (const uint8_t *)band.getAddr32(0, row);
+            for (uint32_t x = 0; x < dst_width * sample; x++) {
+                uint32_t *sum = &sums[x / sample * 4];
+                for (int c = 0; c < 4; c++)
+                    sum[c] += src[x * 4 + c];
+            }
+        }
+
+        uint8_t *dst = (uint8_t *)bitmap.getAddr32(0, y);
+        for (uint32_t i = 0; i < dst_width * 4; i++)
+            dst[i] = (sums[i] + area / 2) / area;
+    }
+
+    bitmap.setImmutable();
+    return bitmap.asImage();
+}
+
+/* decodes region at 1/sample scale, which skips decoding work where the codec can */
+static inline sk_sp<SkImage>
+sk_load_image_sampled(struct sk *sk,
+                    const char *filename,
+                    std::unique_ptr<SkCodec> codec,
+                    const SkIRect &region,
+                    uint32_t sample)
+{
+    std::unique_ptr<SkAndroidCodec> android_codec =
+        SkAndroidCodec::MakeFromCodec(std::move(codec));
+    if (!android_codec)
+        sk_die("failed to decode %s", filename);
+
+    SkIRect subset = region;
+    const bool has_subset = subset != SkIRect::MakeSize(android_codec->dimensions());
+    if (has_subset && !android_codec->getSupportedSubset(&subset))
+        sk_die("unsupported subset for %s", filename);
+
+    SkAndroidCodec::AndroidOptions options;
+    options.fSampleSize = sample;
+    options.fSubset = has_subset ? &subset : NULL;
+
+    const SkISize size = android_codec->getSampledSubsetDimensions(sample, subset);
+    const SkImageInfo info = SkImageInfo::MakeN32Premul(size);
+
+    SkBitmap bitmap;
+    bitmap.allocPixels(info);
+    if (android_codec->getAndroidPixels(info, bitmap.getPixels(), bitmap.rowBytes(), &options) !=
+        SkCodec::kSuccess)
+        sk_die("failed to decode %s", filename);
+
+    bitmap.setImmutable();
+    return bitmap.asImage();
+}
+
+static inline bool
+sk_is_jpeg_file(const char *filename)
+{
+    return sk_has_suffix(filename, ".jpg") || sk_has_suffix(filename, ".jpeg");
+}
+
+static inline bool
+sk_is_image_file(const char *filename)
+{
+    return sk_has_suffix(filename, ".png") || sk_is_jpeg_file(filename);
+}
+
+static inline std::unique_ptr<SkCodec>
+sk_open_codec(struct sk *sk, const char *filename)
+{
+    std::unique_ptr<SkFILEStream> reader = SkFILEStream::Make(filename);
+    if (!reader)
+        sk_die("failed to open %s", filename);
+
+    std::unique_ptr<SkCodec> codec = sk_is_jpeg_file(filename)
+                                         ? SkJpegDecoder::Decode(std::move(reader), NULL)
+                                         : SkPngDecoder::Decode(std::move(reader), NULL);
+    if (!codec)
+        sk_die("failed to decode %s", filename);
+
+    return codec;
+}
+
+/* decodes a png or jpeg file; params is optional and defaults to a full decode at native size */
+static inline sk_sp<SkImage>
+sk_load_image(struct sk *sk, const char *filename, const struct sk_decode_params *params)
+{
+    std::unique_ptr<SkCodec> codec = sk_open_codec(sk, filename);
+
+    if (!params)
+        return std::get<0>(codec->getImage());
+
+    const SkIRect bounds = SkIRect::MakeSize(codec->dimensions());
+    SkIRect region = bounds;
+    if (!params->subset.isEmpty() && !region.intersect(params->subset))
+        sk_die("subset is outside of %s", filename);
+
+    /* a full decode at native size takes the same path as without params */
+    const uint32_t sample = sk_decode_get_sample_size(params, region);
+    if (sample == 1 && region == bounds && !params->streamed)
+        return std::get<0>(codec->getImage());
+    if (params->streamed)
+        return sk_load_image_streamed(sk, filename, codec.get(), region, sample);
+    else
+        return sk_load_image_sampled(sk, filename, std::move(codec), region, sample);
+}
+
+/* decodes a jpeg file to 8-bit yuva planes; returns false when the codec cannot */
+static inline bool
+sk_load_yuva(struct sk *sk, const char *filename, SkYUVAPixmaps *yuva)
+{
+    std::unique_ptr<SkCodec> codec = sk_open_codec(sk, filename);
+
+    SkYUVAPixmapInfo::SupportedDataTypes types;
+    types.enableDataType(SkYUVAPixmaps::DataType::kUnorm8, 1);
+    types.enableDataType(SkYUVAPixmaps::DataType::kUnorm8, 2);
+    types.enableDataType(SkYUVAPixmaps::DataType::kUnorm8, 3);
+
+    SkYUVAPixmapInfo info;
+    if (!codec->queryYUVAInfo(types, &info))
+        return false;
+
+    *yuva = SkYUVAPixmaps::Allocate(info);
+    if (codec->getYUVAPlanes(*yuva) != SkCodec::kSuccess)
+        sk_die("failed to decode planes of %s", filename);
+
+    return true;
+}
+
+static inline uint16_t
+sk_bc1_pack_565(const int rgb[3])
+{
+    return (rgb[0] * 31 + 127) / 255 << 11 | (rgb[1] * 63 + 127) / 255 << 5 |
+           (rgb[2] * 31 + 127) / 255;
+}
+
+static inline void
+sk_bc1_unpack_565(uint16_t c, int rgb[3])
+{
+    rgb[0] = (c >> 11) * 255 / 31;
+    rgb[1] = (c >> 5 & 0x3f) * 255 / 63;
+    rgb[2] = (c & 0x1f) * 255 / 31;
+}
+
+/* encodes 16 opaque rgba pixels with a range fit along the bounding box diagonal */
+static inline void
+sk_bc1_encode_block(const uint8_t *pixels[16], uint8_t *block)
+{
+    int lo[3] = { 255, 255, 255 };
+    int hi[3] = { 0, 0, 0 };
+    for (int i = 0; i < 16; i++) {
+        for (int c = 0; c < 3; c++) {
+            lo[c] = std::min(lo[c], (int)pixels[i][c]);
+            hi[c] = std::max(hi[c], (int)pixels[i][c]);
+        }
+    }
+
+    /* inset the box to reduce the error of the interpolated colors */
+    for (int c = 0; c < 3; c++) {
+        const int inset = (hi[c] - lo[c]) / 16;
+        lo[c] += inset;
+        hi[c] -= inset;
+    }
+
+    uint16_t c0 = sk_bc1_pack_565(hi);
+    uint16_t c1 = sk_bc1_pack_565(lo);
+    uint32_t indices = 0;
+    if (c0 != c1) {
+        /* c0 > c1 selects the 4-color mode */
+        if (c0 < c1)
+            std::swap(c0, c1);
+
+        int palette[4][3];
+        sk_bc1_unpack_565(c0, palette[0]);
+        sk_bc1_unpack_565(c1, palette[1]);
+        for (int c = 0; c < 3; c++) {
+            palette[2][c] = (2 * palette[0][c] + palette[1][c]) / 3;
+            palette[3][c] = (palette[0][c] + 2 * palette[1][c]) / 3;
+        }
+
+        for (int i = 0; i < 16; i++) {
+            int best = 0;
+            int best_dist = INT32_MAX;
+            for (int j = 0; j < 4; j++) {
+                int dist = 0;
+                for (int c = 0; c < 3; c++) {
+                    const int d = pixels[i][c] - palette[j][c];
+                    dist += d * d;
+                }
+                if (dist < best_dist) {
+                    best = j;
+                    best_dist = dist;
+                }
+            }
+            indices |= (uint32_t)best << (i * 2);
+        }
+    }
+
+    block[0] = c0 & 0xff;
+    block[1] = c0 >> 8;
+    block[2] = c1 & 0xff;
+    block[3] = c1 >> 8;
+    for (int i = 0; i < 4; i++)
+        block[4 + i] = indices >> (i * 8) & 0xff;
+}
+
+/* all supported types use 8-byte 4x4 blocks */
+static inline size_t
+sk_get_compressed_size(uint32_t width, uint32_t height)
+{
+    return (size_t)((width + 3) / 4) * ((height + 3) / 4) * 8;
+}
+
+/* the cached form is a 16-byte header followed by the blocks */
+struct sk_compressed_header {
+    uint32_t magic;
+    uint32_t width;
+    uint32_t height;
+    uint32_t type;
+};
+
+#define SK_COMPRESSED_MAGIC 0x43544b53 /* "SKTC" */
+
+/* transcodes an opaque image to bc1 and returns the cacheable data, or NULL */
+static inline sk_sp<SkData>
+sk_compress_image(struct sk *sk, SkImage *img, struct sk_compressed_image *compressed)
+{
+    const uint32_t width = img->width();
+    const uint32_t height = img->height();
+
+    SkBitmap bitmap;
+    bitmap.allocPixels(
+        SkImageInfo::Make(width, height, kRGBA_8888_SkColorType, kUnpremul_SkAlphaType));
+    if (!img->readPixels(NULL, bitmap.pixmap(), 0, 0))
+        sk_die("failed to read image pixels");
+
+    for (uint32_t y = 0; y < height; y++) {
+        const uint8_t *row = (const uint8_t *)bitmap.getAddr32(0, y);
+        for (uint32_t x = 0; x < width; x++) {
+            if (row[x * 4 + 3] != 0xff)
+                return NULL;
+        }
+    }
+
+    const SkTextureCompressionType type = SkTextureCompressionType::kBC1_RGB8_UNORM;
+    const size_t size = sk_get_compressed_size(width, height);
+    const size_t header_size = sizeof(struct sk_compressed_header);
+    sk_sp<SkData> data = SkData::MakeUninitialized(header_size + size);
+
+    const struct sk_compressed_header header = {
+        .magic = SK_COMPRESSED_MAGIC,
+        .width = width,
+        .height = height,
+        .type = (uint32_t)type,
+    };
+    uint8_t *dst = (uint8_t *)data->writable_data();
+    memcpy(dst, &header, header_size);
+    dst += header_size;
+
+    /* edge blocks replicate the last row and column */
+    for (uint32_t by = 0; by < height; by += 4) {
+        for (uint32_t bx = 0; bx < width; bx += 4) {
+            const uint8_t *pixels[16];
+            for (uint32_t i = 0; i < 16; i++) {
+                const uint32_t x = std::min(bx + i % 4, width - 1);
+                const uint32_t y = std::min(by + i / 4, height - 1);
+                pixels[i] = (const uint8_t *)bitmap.getAddr32(x, y);
+            }
+            sk_bc1_encode_block(pixels, dst);
+            dst += 8;
+        }
+    }
+
+    compressed->width = width;
+    compressed->height = height;
+    compressed->type = type;
+    compressed->data = SkData::MakeSubset(data.get(), header_size, size);
+
+    return data;
+}
+
+static inline bool
+sk_parse_compressed_image(sk_sp<SkData> data, struct sk_compressed_image *compressed)
+{
+    struct sk_compressed_header header;
+    const size_t header_size = sizeof(header);
+    if (data->size() < header_size)
+        return false;
+
+    memcpy(&header, data->data(), header_size);
+    const SkTextureCompressionType type = (SkTextureCompressionType)header.type;
+    const size_t size = sk_get_compressed_size(header.width, header.height);
+    if (header.magic != SK_COMPRESSED_MAGIC ||
+        type != SkTextureCompressionType::kBC1_RGB8_UNORM || data->size() != header_size + size)
+        return false;
+
+    compressed->width = header.width;
+    compressed->height = header.height;
+    compressed->type = type;
+    compressed->data = SkData::MakeSubset(data.get(), header_size, size);
+
+    return true;
+}
+
+/* the key covers the file identity and the decode params that change the pixels */
+static inline sk_sp<SkData>
+sk_get_compressed_key(const char *filename, const struct sk_decode_params *params)
+{
+    struct stat st;
+    if (stat(filename, &st))
+        sk_die("failed to stat %s", filename);
+
+    char suffix[128];
+    snprintf(suffix, sizeof(suffix), ":%lld:%lld:%ux%u:%d,%d,%d,%d:%d", (long long)st.st_mtime,
+             (long long)st.st_size, params->max_width, params->max_height, params->subset.x(),
+             params->subset.y(), params->subset.width(), params->subset.height(),
+             params->streamed);
+
+    const std::string key = std::string("bc1:") + filename + suffix;
+    return SkData::MakeWithCopy(key.data(), key.size());
+}
+
+/* loads the compressed image from the cache, transcoding and storing it on a miss */
+static inline void
+sk_load_compressed(struct sk *sk,
+                   const char *filename,
+                   const struct sk_decode_params *params,
+                   struct sk_decoded_image *decoded)
+{
+    sk_persistent_cache *cache = params->compressed_cache;
+    const sk_sp<SkData> key = sk_get_compressed_key(filename, params);
+
+    /* images with alpha stay uncompressed and are cached as empty entries */
+    sk_sp<SkData> data = cache->load(*key);
+    if (data && !data->size()) {
+        decoded->img = sk_load_image(sk, filename, params);
+        return;
+    }
+    if (data && sk_parse_compressed_image(data, &decoded->compressed))
+        return;
+
+    decoded->img = sk_load_image(sk, filename, params);
+
+    const uint64_t begin = sk_now_ns();
+    data = sk_compress_image(sk, decoded->img.get(), &decoded->compressed);
+    decoded->encode_ns = sk_now_ns() - begin;
+
+    if (data) {
+        cache->store(*key, *data, SkString(filename));
+        decoded->img.reset();
+    } else {
+        cache->store(*key, *SkData::MakeEmpty(), SkString(filename));
+    }
+}
+
+static inline struct sk_decoded_image
+sk_decode_image(struct sk *sk, const char *filename, const struct sk_decode_params *params)
+{
+    struct sk_decoded_image decoded = {};
+
+    const uint64_t begin = sk_now_ns();
+    if (params && params->compressed_cache)
+        sk_load_compressed(sk, filename, params, &decoded);
+    else if (!params || !params->yuva || !sk_is_jpeg_file(filename) ||
+             !sk_load_yuva(sk, filename, &decoded.yuva))
+        decoded.img = sk_load_image(sk, filename, params);
+    decoded.decode_ns = sk_now_ns() - begin - decoded.encode_ns;
+
+    return decoded;
+}
+
+/* path can be an image file, a directory of image files, or a list file with one path per line */
+static inline void
+sk_collect_files(struct sk *sk, const char *path, std::vector<std::string> *files)
+{
+    struct stat st;
+    if (stat(path, &st))
+        sk_die("failed to stat %s", path);
+
+    if (S_ISDIR(st.st_mode)) {
+        DIR *dir = opendir(path);
+        if (!dir)
+            sk_die("failed to open %s", path);
+
+        const size_t first = files->size();
+        while (const struct dirent *ent = readdir(dir)) {
+            if (sk_is_image_file(ent->d_name))
+                files->push_back(std::string(path) + "/" + ent->d_name);
+        }
+        closedir(dir);
+
+        std::sort(files->begin() + first, files->end());
+    } else if (sk_is_image_file(path)) {
+        files->push_back(path);
+    } else {
+        std::ifstream list(path);
+        if (!list)
+            sk_die("failed to open %s", path);
+
+        std::string line;
+        while (std::getline(list, line)) {
+            if (!line.empty() && line[0] != '#')
+                files->push_back(line);
+        }
+    }
+
+    if (files->empty())
+        sk_die("no image file found in %s", path);
+}
+
+static inline void
+sk_prefetch_submit(struct sk *sk, struct sk_prefetch *prefetch)
+{
+    while (prefetch->pending.size() < prefetch->depth &&
+           prefetch->next < prefetch->files->size()) {
+        const char *filename = (*prefetch->files)[prefetch->next++].c_str();
+        const struct sk_decode_params *decode = prefetch->decode;
+        const auto load = [sk, filename, decode] {
+            return sk_decode_image(sk, filename, decode);
+        };
+
+        if (sk->executor) {
+            auto task = std::make_shared<std::packaged_task<struct sk_decoded_image()>>(load);
+            prefetch->pending.push_back(task->get_future());
+            sk->executor->add([task] { (*task)(); });
+        } else {
+            prefetch->pending.push_back(std::async(std::launch::async, load));
+        }
+    }
+}
+
+/* decodes up to depth files ahead of the consumer on sk->executor or background threads */
+static inline void
+sk_prefetch_init(struct sk *sk,
+                 struct sk_prefetch *prefetch,
+                 const std::vector<std::string> *files,
+                 const struct sk_decode_params *decode,
+                 uint32_t depth)
+{
+    prefetch->files = files;
+    prefetch->decode = decode;
+    prefetch->depth = depth;
+    prefetch->next = 0;
+    prefetch->pending.clear();
+
+    sk_prefetch_submit(sk, prefetch);
+}
+
+static inline void
+sk_prefetch_cleanup(struct sk *sk, struct sk_prefetch *prefetch)
+{
+    for (auto &fut : prefetch->pending)
+        fut.wait();
+    prefetch->pending.clear();
+}
+
+/* returns false when all files have been consumed */
+static inline bool
+sk_prefetch_next(struct sk *sk, struct sk_prefetch *prefetch, struct sk_decoded_image *decoded)
+{
+    if (prefetch->pending.empty())
+        return false;
+
+    *decoded = prefetch->pending.front().get();
+    prefetch->pending.pop_front();
+    sk_prefetch_submit(sk, prefetch);
+
+    return true;
+}
+
+static inline const char *
+sk_get_color_type_name(SkColorType color_type)
+{
+    switch (color_type) {
+    case kRGBA_8888_SkColorType:
+        return "rgba8888";
+    case kBGRA_8888_SkColorType:
+        return "bgra8888";
+    case kRGB_565_SkColorType:
+        return "rgb565";
+    case kRGBA_1010102_SkColorType:
+        return "rgba1010102";
+    case kRGBA_F16_SkColorType:
+        return "rgbaf16";
+    default:
+        return "other";
+    }
+}
+
+/*
+ * Appends a result to params.results_path, for results-compare.  samples are
+ * per-iteration times and the first one, which includes the warmup, is
+ * written separately.
+ */
+static inline void
+sk_write_result(struct sk *sk,
+                const char *backend,
+                const char *scene,
+                const SkImageInfo &info,
+                const std::vector<uint64_t> &samples)
+{
+    if (!sk->params.results_path || samples.empty())
+        return;
+
+    FILE *fp = fopen(sk->params.results_path, "a");
+    if (!fp)
+        sk_die("failed to open %s", sk->params.results_path);
+
+    fprintf(fp,
+            "{\"test\": \"%s\", \"backend\": \"%s\", \"scene\": \"%s\", "
+            "\"width\": %d, \"height\": %d, \"color_type\": \"%s\", "
+            "\"first_ns\": %" PRIu64 ", \"samples_ns\": [",
+            program_invocation_short_name, backend, scene, info.width(), info.height(),
+            sk_get_color_type_name(info.colorType()), samples[0]);
+    for (size_t i = 1; i < samples.size(); i++)
+        fprintf(fp, "%s%" PRIu64, i > 1 ? ", " : "", samples[i]);
+    fprintf(fp, "]}\n");
+
+    if (fclose(fp))
+        sk_die("failed to write %s", sk->params.results_path);
+}
+
+/*
+ * Runs this executable once per file on up to max_count files, with stdout
+ * discarded, and returns the mean wall time of a run.  args are the options
+ * to run with, and the file is appended.  The caller must not be a one-shot
+ * run itself.
+ */
+static inline uint64_t
+sk_time_oneshot(struct sk *sk,
+                const std::vector<const char *> &args,
+                const std::vector<std::string> &files,
+                uint32_t max_count)
+{
+    const uint32_t count = std::min<size_t>(files.size(), max_count);
+    if (!count)
+        return 0;
+
+    uint64_t total_ns = 0;
+    for (uint32_t i = 0; i < count; i++) {
+        std::vector<const char *> argv = args;
+        argv.push_back(files[i].c_str());
+        argv.push_back(NULL);
+
+        fflush(stdout);
+        const uint64_t begin = sk_now_ns();
+        const pid_t pid = fork();
+        if (pid < 0)
+            sk_die("failed to fork");
+        if (!pid) {
+            const int fd = open("/dev/null", O_WRONLY);
+            if (fd >= 0) {
+                dup2(fd, STDOUT_FILENO);
+                close(fd);
+            }
+            execv("/proc/self/exe", (char *const *)argv.data());
+            _exit(127);
+        }
+
+        int status;
+        if (waitpid(pid, &status, 0) != pid || !WIFEXITED(status) || WEXITSTATUS(status))
+            sk_die("one-shot run on %s failed", files[i].c_str());
+        total_ns += sk_now_ns() - begin;
+    }
+
+    return total_ns / count;
+}
+
+/*
+ * Compares batch throughput against one process per item.  batch_ns is the
+ * time from exec to the end of the batch, or 0 when unknown, and must be
+ * taken before anything else runs.  oneshot_ns is the measured time of a
+ * one-shot process, or 0 to extrapolate from init_ns, which leaves out
+ * process start and skia init.
+ */
+static inline void
+sk_report_batch(struct sk *sk,
+                uint32_t count,
+                uint64_t init_ns,
+                uint64_t draw_ns,
+                uint64_t batch_ns,
+                uint64_t oneshot_ns)
+{
+    const double init_sec = (double)init_ns / 1e9;
+    const double draw_sec = (double)draw_ns / 1e9;
+
+    sk_log("%u items: init %.3f ms, draw %.3f ms/item", count, init_sec * 1e3,
+           draw_sec * 1e3 / count);
+
+    if (oneshot_ns) {
+        /* count the process start of the batch as well */
+        const double batch_sec = batch_ns ? batch_ns / 1e9 : init_sec + draw_sec;
+        sk_log("batch %.2f items/s, one-shot %.2f items/s (measured, %.3f ms/process)",
+               count / batch_sec, 1e9 / oneshot_ns, oneshot_ns / 1e6);
+    } else {
+        sk_log("batch %.2f items/s, one-shot %.2f items/s (extrapolated from init)",
+               count / (init_sec + draw_sec), count / (init_sec * count + draw_sec));
+    }
+}
+
+/* the bytes of the mip levels below the base level */
+static inline size_t
+sk_get_mipmap_bytes(const SkImageInfo &info)
+{
+    size_t bytes = 0;
+    uint32_t w = info.width();
+    uint32_t h = info.height();
+    while (w > 1 || h > 1) {
+        w = std::max(w / 2, 1u);
+        h = std::max(h / 2, 1u);
+        bytes += (size_t)w * h * info.bytesPerPixel();
+    }
+    return bytes;
+}
+
+static inline void
+sk_mipmap_cache_init(struct sk *sk, struct sk_mipmap_cache *cache, size_t budget)
+{
+    *cache = {};
+    cache->budget = budget;
+}
+
+static inline void
+sk_mipmap_cache_cleanup(struct sk *sk, struct sk_mipmap_cache *cache)
+{
+    cache->entries.clear();
+    cache->order.clear();
+    cache->bytes = 0;
+}
+
+/* returns a mipmapped copy of img, as a texture when ctx is set */
+static inline sk_sp<SkImage>
+sk_mipmap_cache_get(struct sk *sk,
+                    struct sk_mipmap_cache *cache,
+                    GrDirectContext *ctx,
+                    const sk_sp<SkImage> &img)
+{
+    const uint32_t id = img->uniqueID();
+    auto iter = cache->entries.find(id);
+    if (iter != cache->entries.end()) {
+        cache->hit_count++;
+        return iter->second.img;
+    }
+
+    const uint64_t begin = sk_now_ns();
+    sk_sp<SkImage> mipmapped;
+    if (ctx) {
+        mipmapped = SkImages::TextureFromImage(ctx, img, skgpu::Mipmapped::kYes);
+        if (mipmapped)
+            ctx->flushAndSubmit(GrSyncCpu::kYes);
+    } else {
+        mipmapped = img->withDefaultMipmaps();
+    }
+    if (!mipmapped)
+        sk_die("failed to build mipmaps");
+    cache->build_ns += sk_now_ns() - begin;
+    cache->miss_count++;
+
+    const size_t base_bytes = img->imageInfo().computeMinByteSize();
+    const size_t mip_bytes = sk_get_mipmap_bytes(img->imageInfo());
+    cache->base_bytes += base_bytes;
+    cache->mip_bytes += mip_bytes;
+
+    /* the newest entry is kept even when it alone exceeds the budget */
+    const size_t bytes = base_bytes + mip_bytes;
+    while (!cache->order.empty() && cache->bytes + bytes > cache->budget) {
+        auto victim = cache->entries.find(cache->order.front());
+        cache->bytes -= victim->second.bytes;
+        cache->entries.erase(victim);
+        cache->order.pop_front();
+    }
+
+    cache->entries[id] = { mipmapped, bytes };
+    cache->order.push_back(id);
+    cache->bytes += bytes;
+
+    return mipmapped;
+}
+
+/* the destination of an image drawn at a scale of the sampling matrix */
+static inline SkRect
+sk_sampling_get_dst_rect(const SkImage *img, float scale)
+{
+    return SkRect::MakeWH(ceilf(img->width() * scale), ceilf(img->height() * scale));
+}
+
+static inline void
+sk_sampling_report(struct sk *sk,
+                   const char *backend,
+                   const struct sk_sampling_stats *stats,
+                   const struct sk_mipmap_cache *cache)
+{
+    if (!stats->image_count)
+        return;
+
+    char header[128];
+    int len = snprintf(header, sizeof(header), "%-6s", "scale");
+    for (uint32_t m = 0; m < SK_SAMPLING_MODE_COUNT; m++)
+        len += snprintf(header + len, sizeof(header) - len, " %13s", sk_sampling_modes[m].name);
+    sk_log("%s: sampling matrix over %u images, ms/draw (Mpixels/s):", backend,
+           stats->image_count);
+    sk_log("%s", header);
+
+    const uint64_t draw_count = (uint64_t)stats->image_count * stats->repeat_count;
+    for (uint32_t s = 0; s < SK_SAMPLING_SCALE_COUNT; s++) {
+        char row[256];
+        len = snprintf(row, sizeof(row), "%-6.3g", sk_sampling_scales[s]);
+        for (uint32_t m = 0; m < SK_SAMPLING_MODE_COUNT; m++) {
+            const double ms = stats->ns[s][m] / 1e6 / draw_count;
+            const double mpps =
+                (double)stats->pixel_count[s] * stats->repeat_count / (stats->ns[s][m] / 1e3);
+            len += snprintf(row + len, sizeof(row) - len, " %6.3f(%5.0f)", ms, mpps);
+        }
+        sk_log("%s", row);
+    }
+
+    if (cache->miss_count) {
+        sk_log("%s: mipmaps built in %.3f ms/image, +%.1f%% memory (%.1f MiB over %.1f MiB), "
+               "cache %u hits, %u misses, %.1f MiB resident",
+               backend, cache->build_ns / 1e6 / cache->miss_count,
+               100.0 * cache->mip_bytes / cache->base_bytes, cache->mip_bytes / (double)(1 << 20),
+               cache->base_bytes / (double)(1 << 20), cache->hit_count, cache->miss_count,
+               cache->bytes / (double)(1 << 20));
+    }
+}
+
+static inline void
+sk_load_golden(struct sk *sk, const char *filename, const SkImageInfo &info, SkBitmap *bitmap)
+{
+    /* this mmaps the file */
+    sk_sp<SkData> data = SkData::MakeFromFileName(filename);
+    if (!data)
+        sk_die("failed to open %s", filename);
+
+    /* wrap raw goldens without copying */
+    if (data->size() == info.computeMinByteSize()) {
+        SkData *raw = data.release();
+        const auto release = [](void *addr, void *ctx) { static_cast<SkData *>(ctx)->unref(); };
+        if (!bitmap->installPixels(info, const_cast<void *>(raw->data()), info.minRowBytes(),
+                                   release, raw))
+            sk_die("failed to wrap %s", filename);
+        return;
+    }
+
+    std::unique_ptr<SkCodec> codec = SkPngDecoder::Decode(SkMemoryStream::Make(data), NULL);
+    if (!codec)
+        sk_die("failed to decode %s", filename);
+    if (codec->dimensions() != info.dimensions())
+        sk_die("golden %s is %dx%d, expected %dx%d", filename, codec->dimensions().width(),
+               codec->dimensions().height(), info.width(), info.height());
+
+    bitmap->allocPixels(info);
+    if (codec->getPixels(bitmap->pixmap()) != SkCodec::kSuccess)
+        sk_die("failed to decode %s", filename);
+}
+
+static inline void
+sk_compare_row_c(const uint8_t *a,
+                 const uint8_t *b,
+                 uint8_t *diff,
+                 uint32_t count,
+                 const uint8_t tolerance[4],
+                 struct sk_compare_result *res)
+{
+    for (uint32_t i = 0; i < count; i++) {
+        bool differ = false;
+        for (int c = 0; c < 4; c++) {
+            const uint8_t d = a[c] > b[c] ? a[c] - b[c] : b[c] - a[c];
+            if (res->max_diff[c] < d)
+                res->max_diff[c] = d;
+            if (d > tolerance[c])
+                differ = true;
+            if (diff)
+                diff[c] = c == 3 ? 0xff : d;
+        }
+        res->diff_count += differ;
+
+        a += 4;
+        b += 4;
+        if (diff)
+            diff += 4;
+    }
+}
+
+static inline void
+sk_compare_reduce_max(const uint8_t *lanes, int lane_count, struct sk_compare_result *res)
+{
+    for (int i = 0; i < lane_count; i++) {
+        if (res->max_diff[i % 4] < lanes[i])
+            res->max_diff[i % 4] = lanes[i];
+    }
+}
+
+#if defined(__x86_64__) || defined(__i386__)
+
+static inline void
+sk_compare_row_sse2(const uint8_t *a,
+                    const uint8_t *b,
+                    uint8_t *diff,
+                    uint32_t count,
+                    const uint8_t tolerance[4],
+                    struct sk_compare_result *res)
+{
+    uint32_t tol;
+    memcpy(&tol, tolerance, sizeof(tol));
+    const __m128i vtol = _mm_set1_epi32(tol);
+    const __m128i vopaque = _mm_set1_epi32(0xff000000);
+    const __m128i vzero = _mm_setzero_si128();
+    __m128i vmax = vzero;
+
+    uint32_t i = 0;
+    for (; i + 4 <= count; i += 4) {
+        const __m128i va = _mm_loadu_si128((const __m128i *)(a + i * 4));
+        const __m128i vb = _mm_loadu_si128((const __m128i *)(b + i * 4));
+        const __m128i vd = _mm_or_si128(_mm_subs_epu8(va, vb), _mm_subs_epu8(vb, va));
+        vmax = _mm_max_epu8(vmax, vd);
+
+        /* a pixel is within tolerance when all of its channels saturate to 0 */
+        const __m128i vok = _mm_cmpeq_epi32(_mm_subs_epu8(vd, vtol), vzero);
+        res->diff_count += 4 - __builtin_popcount(_mm_movemask_ps(_mm_castsi128_ps(vok)));
+
+        if (diff)
+            _mm_storeu_si128((__m128i *)(diff + i * 4), _mm_or_si128(vd, vopaque));
+    }
+
+    uint8_t lanes[16];
+    _mm_storeu_si128((__m128i *)lanes, vmax);
+    sk_compare_reduce_max(lanes, ARRAY_SIZE(lanes), res);
+
+    sk_compare_row_c(a + i * 4, b + i * 4, diff ? diff + i * 4 : NULL, count - i, tolerance,
+                     res);
+}
+
+__attribute__((target("avx2"))) static inline void
+sk_compare_row_avx2(const uint8_t *a,
+                    const uint8_t *b,
+                    uint8_t *diff,
+                    uint32_t count,
+                    const uint8_t tolerance[4],
+                    struct sk_compare_result *res)
+{
+    uint32_t tol;
+    memcpy(&tol, tolerance, sizeof(tol));
+    const __m256i vtol = _mm256_set1_epi32(tol);
+    const __m256i vopaque = _mm256_set1_epi32(0xff000000);
+    const __m256i vzero = _mm256_setzero_si256();
+    __m256i vmax = vzero;
+
+    uint32_t i = 0;
+    for (; i + 8 <= count; i += 8) {
+        const __m256i va = _mm256_loadu_si256((const __m256i *)(a + i * 4));
+        const __m256i vb = _mm256_loadu_si256((const __m256i *)(b + i * 4));
+        const __m256i vd = _mm256_or_si256(_mm256_subs_epu8(va, vb), _mm256_subs_epu8(vb, va));
+        vmax = _mm256_max_epu8(vmax, vd);
+
+        const __m256i vok = _mm256_cmpeq_epi32(_mm256_subs_epu8(vd, vtol), vzero);
+        res->diff_count += 8 - __builtin_popcount(_mm256_movemask_ps(_mm256_castsi256_ps(vok)));
+
+        if (diff)
+            _mm256_storeu_si256((__m256i *)(diff + i * 4), _mm256_or_si256(vd, vopaque));
+    }
+
+    uint8_t lanes[32];
+    _mm256_storeu_si256((__m256i *)lanes, vmax);
+    sk_compare_reduce_max(lanes, ARRAY_SIZE(lanes), res);
+
+    sk_compare_row_sse2(a + i * 4, b + i * 4, diff ? diff + i * 4 : NULL, count - i, tolerance,
+                        res);
+}
+
+#elif defined(__aarch64__)
+
+static inline void
+sk_compare_row_neon(const uint8_t *a,
+                    const uint8_t *b,
+                    uint8_t *diff,
+                    uint32_t count,
+                    const uint8_t tolerance[4],
+                    struct sk_compare_result *res)
+{
+    uint32_t tol;
+    memcpy(&tol, tolerance, sizeof(tol));
+    const uint8x16_t vtol = vreinterpretq_u8_u32(vdupq_n_u32(tol));
+    const uint8x16_t vopaque = vreinterpretq_u8_u32(vdupq_n_u32(0xff000000));
+    uint8x16_t vmax = vdupq_n_u8(0);
+
+    uint32_t i = 0;
+    for (; i + 4 <= count; i += 4) {
+        const uint8x16_t va = vld1q_u8(a + i * 4);
+        const uint8x16_t vb = vld1q_u8(b + i * 4);
+        const uint8x16_t vd = vabdq_u8(va, vb);
+        vmax = vmaxq_u8(vmax, vd);
+
+        const uint32x4_t vok = vceqzq_u32(vreinterpretq_u32_u8(vqsubq_u8(vd, vtol)));
+        res->diff_count += 4 - vaddvq_u32(vshrq_n_u32(vok, 31));
+
+        if (diff)
+            vst1q_u8(diff + i * 4, vorrq_u8(vd, vopaque));
+    }
+
+    uint8_t lanes[16];
+    vst1q_u8(lanes, vmax);
+    sk_compare_reduce_max(lanes, ARRAY_SIZE(lanes), res);
+
+    sk_compare_row_c(a + i * 4, b + i * 4, diff ? diff + i * 4 : NULL, count - i, tolerance,
+                     res);
+}
+
+#endif
+
+static inline sk_compare_row_func
+sk_compare_get_row_func(void)
+{
+#if defined(__x86_64__) || defined(__i386__)
+    __builtin_cpu_init();
+    return __builtin_cpu_supports("avx2") ? sk_compare_row_avx2 : sk_compare_row_sse2;
+#elif defined(__aarch64__)
+    return sk_compare_row_neon;
+#else
+    return sk_compare_row_c;
+#endif
+}
+
+static inline struct sk_compare_result
+sk_compare_pixmaps(struct sk *sk,
+                   const SkPixmap &a,
+                   const SkPixmap &b,
+                   const struct sk_compare_params *params,
+                   const SkPixmap *diff)
+{
+    if (a.info() != b.info() || a.info().bytesPerPixel() != 4)
+        sk_die("cannot compare incompatible pixmaps");
+    if (diff && diff->info() != a.info())
+        sk_die("bad diff pixmap");
+
+    static const sk_compare_row_func compare_row = sk_compare_get_row_func();
+
+    struct sk_compare_result res = {};
+    for (int y = 0; y < a.height(); y++) {
+        compare_row(a.addr8(0, y), b.addr8(0, y), diff ? diff->writable_addr8(0, y) : NULL,
+                    a.width(), params->tolerance, &res);
+    }
+
+    return res;
+}
+
+/* compares surf against golden_filename, which can be a png or a raw dump */
+static inline struct sk_compare_result
+sk_compare_surface(struct sk *sk,
+                   sk_sp<SkSurface> surf,
+                   const char *golden_filename,
+                   const struct sk_compare_params *params,
+                   const char *diff_filename)
+{
+    SkBitmap bitmap;
+    const SkPixmap pixmap = sk_read_surface(sk, surf, &bitmap);
+
+    SkBitmap golden;
+    sk_load_golden(sk, golden_filename, pixmap.info(), &golden);
+
+    SkBitmap diff;
+    if (diff_filename)
+        diff.allocPixels(pixmap.info());
+
+    const struct sk_compare_result res = sk_compare_pixmaps(
+        sk, pixmap, golden.pixmap(), params, diff_filename ? &diff.pixmap() : NULL);
+
+    if (diff_filename && res.diff_count)
+        sk_dump_pixmap(sk, diff.pixmap(), diff_filename);
+
+    return res;
+}
+
+/*
+ * A sequence file is a header followed by one record per frame.  A record
+ * is a frame header, the changed tiles, each a tile index followed by the
+ * tightly packed pixels, and the file offsets of the current pixels of every
+ * tile.  Any frame can be reconstructed from its record alone.
+ */
+struct sk_seq_header {
+    uint32_t magic;
+    uint32_t width;
+    uint32_t height;
+    uint32_t tile_size;
+    uint32_t color_type;
+    uint32_t alpha_type;
+};
+
+struct sk_seq_frame_header {
+    uint32_t magic;
+    uint32_t changed_count;
+    uint64_t size;
+};
+
+#define SK_SEQ_MAGIC 0x51455353       /* "SSEQ" */
+#define SK_SEQ_FRAME_MAGIC 0x4d415246 /* "FRAM" */
+#define SK_SEQ_HASH_PRIME 0x9e3779b1u
+
+/* pixel i of a row is mixed into lane i % 4; the simd variants produce the same hashes */
+static inline void
+sk_seq_hash_row_c(const uint32_t *pixels, uint32_t count, uint32_t lanes[4])
+{
+    for (uint32_t i = 0; i < count; i++) {
+        const uint32_t lane = (lanes[i % 4] ^ pixels[i]) * SK_SEQ_HASH_PRIME;
+        lanes[i % 4] = lane << 15 | lane >> 17;
+    }
+}
+
+#if defined(__x86_64__) || defined(__i386__)
+
+__attribute__((target("sse4.1"))) static inline void
+sk_seq_hash_row_sse41(const uint32_t *pixels, uint32_t count, uint32_t lanes[4])
+{
+    const __m128i vprime = _mm_set1_epi32(SK_SEQ_HASH_PRIME);
+    __m128i vlanes = _mm_loadu_si128((const __m128i *)lanes);
+
+    uint32_t i = 0;
+    for (; i + 4 <= count; i += 4) {
+        const __m128i v = _mm_loadu_si128((const __m128i *)(pixels + i));
+        vlanes = _mm_mullo_epi32(_mm_xor_si128(vlanes, v), vprime);
+        vlanes = _mm_or_si128(_mm_slli_epi32(vlanes, 15), _mm_srli_epi32(vlanes, 17));
+    }
+
+    _mm_storeu_si128((__m128i *)lanes, vlanes);
+    sk_seq_hash_row_c(pixels + i, count - i, lanes);
+}
+
+#elif defined(__aarch64__)
+
+static inline void
+sk_seq_hash_row_neon(const uint32_t *pixels, uint32_t count, uint32_t lanes[4])
+{
+    const uint32x4_t vprime = vdupq_n_u32(SK_SEQ_HASH_PRIME);
+    uint32x4_t vlanes = vld1q_u32(lanes);
+
+    uint32_t i = 0;
+    for (; i + 4 <= count; i += 4) {
+        const uint32x4_t v = vld1q_u32(pixels + i);
+        vlanes = vmulq_u32(veorq_u32(vlanes, v), vprime);
+        vlanes = vorrq_u32(vshlq_n_u32(vlanes, 15), vshrq_n_u32(vlanes, 17));
+    }
+
+    vst1q_u32(lanes, vlanes);
+    sk_seq_hash_row_c(pixels + i, count - i, lanes);
+}
+
+#endif
+
+static inline sk_seq_hash_row_func
+sk_seq_get_hash_row_func(void)
+{
+#if defined(__x86_64__) || defined(__i386__)
+    __builtin_cpu_init();
+    return __builtin_cpu_supports("sse4.1") ? sk_seq_hash_row_sse41 : sk_seq_hash_row_c;
+#elif defined(__aarch64__)
+    return sk_seq_hash_row_neon;
+#else
+    return sk_seq_hash_row_c;
+#endif
+}
+
+static inline uint64_t
+sk_seq_hash_tile(const SkPixmap &pixmap, const SkIRect &rect)
+{
+    static const sk_seq_hash_row_func hash_row = sk_seq_get_hash_row_func();
+
+    uint32_t lanes[4] = { 0x243f6a88, 0x85a308d3, 0x13198a2e, 0x03707344 };
+    for (int y = rect.top(); y < rect.bottom(); y++)
+        hash_row(pixmap.addr32(rect.left(), y), rect.width(), lanes);
+
+    uint64_t hash = ((uint64_t)lanes[0] << 32 | lanes[1]) ^
+                    ((uint64_t)lanes[2] << 32 | lanes[3]) * 0x9e3779b97f4a7c15ull;
+    hash = (hash ^ hash >> 31) * 0xbf58476d1ce4e5b9ull;
+    return hash ^ hash >> 29;
+}
+
+static inline SkIRect
+sk_seq_get_tile_rect(const SkImageInfo &info, uint32_t tile_size, uint32_t tiles_x, uint32_t tile)
+{
+    SkIRect rect = SkIRect::MakeXYWH(tile % tiles_x * tile_size, tile / tiles_x * tile_size,
+                                     tile_size, tile_size);
+    rect.intersect(info.bounds());
+    return rect;
+}
+
+static inline void
+sk_seq_writer_write(struct sk_seq_writer *writer, const void *data, size_t size)
+{
+    if (!writer->stream->write(data, size))
+        sk_die("failed to write sequence");
+}
+
+static inline void
+sk_seq_writer_init(struct sk *sk,
+                   struct sk_seq_writer *writer,
+                   const char *filename,
+                   const SkImageInfo &info,
+                   uint32_t tile_size)
+{
+    if (info.bytesPerPixel() != 4)
+        sk_die("sequences support only 32-bit pixels");
+
+    writer->info = info;
+    writer->tile_size = tile_size;
+    writer->tiles_x = (info.width() + tile_size - 1) / tile_size;
+    writer->tile_count = writer->tiles_x * ((info.height() + tile_size - 1) / tile_size);
+
+    writer->stream = std::make_unique<SkFILEWStream>(filename);
+    if (!writer->stream->isValid())
+        sk_die("failed to create %s", filename);
+
+    /* no tile is at offset 0, which is taken by the header */
+    writer->hashes.assign(writer->tile_count, 0);
+    writer->offsets.assign(writer->tile_count, 0);
+    writer->frame_count = 0;
+    writer->written_tile_count = 0;
+
+    const struct sk_seq_header header = {
+        .magic = SK_SEQ_MAGIC,
+        .width = (uint32_t)info.width(),
+        .height = (uint32_t)info.height(),
+        .tile_size = tile_size,
+        .color_type = (uint32_t)info.colorType(),
+        .alpha_type = (uint32_t)info.alphaType(),
+    };
+    sk_seq_writer_write(writer, &header, sizeof(header));
+}
+
+static inline void
+sk_seq_writer_cleanup(struct sk *sk, struct sk_seq_writer *writer)
+{
+    writer->stream->flush();
+    writer->stream.reset();
+    writer->hashes.clear();
+    writer->offsets.clear();
+}
+
+static inline void
+sk_seq_writer_add_frame(struct sk *sk, struct sk_seq_writer *writer, const SkPixmap &pixmap)
+{
+    if (pixmap.info() != writer->info)
+        sk_die("frame does not match the sequence");
+
+    /* hash first; the frame header needs the size of the record */
+    std::vector<uint32_t> changed;
+    size_t size = sizeof(struct sk_seq_frame_header) + sizeof(uint64_t) * writer->tile_count;
+    for (uint32_t i = 0; i < writer->tile_count; i++) {
+        const SkIRect rect =
+            sk_seq_get_tile_rect(writer->info, writer->tile_size, writer->tiles_x, i);
+        const uint64_t hash = sk_seq_hash_tile(pixmap, rect);
+        if (writer->offsets[i] && writer->hashes[i] == hash)
+            continue;
+
+        writer->hashes[i] = hash;
+        changed.push_back(i);
+        size += sizeof(uint32_t) + (size_t)rect.width() * rect.height() * 4;
+    }
+
+    const struct sk_seq_frame_header header = {
+        .magic = SK_SEQ_FRAME_MAGIC,
+        .changed_count = (uint32_t)changed.size(),
+        .size = size,
+    };
+    sk_seq_writer_write(writer, &header, sizeof(header));
+
+    for (const uint32_t tile : changed) {
+        const SkIRect rect =
+            sk_seq_get_tile_rect(writer->info, writer->tile_size, writer->tiles_x, tile);
+        sk_seq_writer_write(writer, &tile, sizeof(tile));
+
+        writer->offsets[tile] = writer->stream->bytesWritten();
+        for (int y = rect.top(); y < rect.bottom(); y++)
+            sk_seq_writer_write(writer, pixmap.addr32(rect.left(), y), rect.width() * 4);
+    }
+
+    sk_seq_writer_write(writer, writer->offsets.data(), sizeof(uint64_t) * writer->tile_count);
+
+    writer->frame_count++;
+    writer->written_tile_count += changed.size();
+}
+
+static inline void
+sk_seq_reader_init(struct sk *sk, struct sk_seq_reader *reader, const char *filename)
+{
+    reader->data = SkData::MakeFromFileName(filename);
+    if (!reader->data)
+        sk_die("failed to read %s", filename);
+
+    const uint8_t *bytes = reader->data->bytes();
+    const size_t size = reader->data->size();
+
+    struct sk_seq_header header;
+    if (size < sizeof(header))
+        sk_die("bad sequence %s", filename);
+    memcpy(&header, bytes, sizeof(header));
+    if (header.magic != SK_SEQ_MAGIC || !header.tile_size)
+        sk_die("bad sequence %s", filename);
+
+    reader->info = SkImageInfo::Make(header.width, header.height,
+                                     (SkColorType)header.color_type,
+                                     (SkAlphaType)header.alpha_type);
+    if (reader->info.bytesPerPixel() != 4)
+        sk_die("bad sequence %s", filename);
+    reader->tile_size = header.tile_size;
+    reader->tiles_x = (header.width + header.tile_size - 1) / header.tile_size;
+    reader->tile_count =
+        reader->tiles_x * ((header.height + header.tile_size - 1) / header.tile_size);
+
+    /* a truncated last record, as left by an interrupted writer, is ignored */
+    const size_t index_size = sizeof(uint64_t) * reader->tile_count;
+    size_t offset = sizeof(header);
+    reader->frames.clear();
+    while (size - offset >= sizeof(struct sk_seq_frame_header)) {
+        struct sk_seq_frame_header frame;
+        memcpy(&frame, bytes + offset, sizeof(frame));
+        if (frame.magic != SK_SEQ_FRAME_MAGIC || frame.size < sizeof(frame) + index_size)
+            sk_die("bad frame record in %s", filename);
+        if (frame.size > size - offset)
+            break;
+
+        reader->frames.push_back(offset);
+        offset += frame.size;
+    }
+}
+
+static inline void
+sk_seq_reader_cleanup(struct sk *sk, struct sk_seq_reader *reader)
+{
+    reader->frames.clear();
+    reader->data.reset();
+}
+
+static inline void
+sk_seq_reader_read_frame(struct sk *sk,
+                         struct sk_seq_reader *reader,
+                         uint32_t frame,
+                         SkBitmap *bitmap)
+{
+    if (frame >= reader->frames.size())
+        sk_die("no frame %u in a sequence of %zu", frame, reader->frames.size());
+
+    const uint8_t *bytes = reader->data->bytes();
+    const size_t record = reader->frames[frame];
+    struct sk_seq_frame_header header;
+    memcpy(&header, bytes + record, sizeof(header));
+
+    /* the index ends the record and points at tiles in this or earlier records */
+    const size_t record_end = record + header.size;
+    const uint8_t *index = bytes + record_end - sizeof(uint64_t) * reader->tile_count;
+
+    bitmap->allocPixels(reader->info);
+    for (uint32_t i = 0; i < reader->tile_count; i++) {
+        const SkIRect rect =
+            sk_seq_get_tile_rect(reader->info, reader->tile_size, reader->tiles_x, i);
+        const size_t row_size = (size_t)rect.width() * 4;
+
+        uint64_t offset;
+        memcpy(&offset, index + sizeof(offset) * i, sizeof(offset));
+        if (!offset || offset + row_size * rect.height() > record_end)
+            sk_die("bad tile offset in frame %u", frame);
+
+        for (int y = 0; y < rect.height(); y++) {
+            memcpy(bitmap->getAddr(rect.left(), rect.top() + y), bytes + offset + row_size * y,
+                   row_size);
+        }
+    }
+}
+
+static inline bool
+sk_cpu_level_is_supported(enum sk_cpu_level_type level)
+{
+#if defined(__x86_64__)
+    /* these also check that the os saves the wider registers */
+    switch (level) {
+    case SK_CPU_LEVEL_SSE2:
+        return true;
+    case SK_CPU_LEVEL_SSE41:
+        return __builtin_cpu_supports("sse4.1");
+    case SK_CPU_LEVEL_AVX:
+        return __builtin_cpu_supports("sse4.2") && __builtin_cpu_supports("avx");
+    case SK_CPU_LEVEL_HSW:
+        return __builtin_cpu_supports("avx2") && __builtin_cpu_supports("bmi2") &&
+               __builtin_cpu_supports("fma");
+    case SK_CPU_LEVEL_SKX:
+        return __builtin_cpu_supports("avx512f") && __builtin_cpu_supports("avx512dq") &&
+               __builtin_cpu_supports("avx512cd") && __builtin_cpu_supports("avx512bw") &&
+               __builtin_cpu_supports("avx512vl");
+    default:
+        return false;
+    }
+#else
+    return false;
+#endif
+}
+
+static inline void
+sk_cpu_level_get_filename(enum sk_cpu_level_type level, char *filename, size_t size)
+{
+    snprintf(filename, size, "rt-%s.png", sk_cpu_levels[level].name);
+}
+
+#if defined(__x86_64__)
+
+struct sk_cpuid_entry {
+    uint32_t leaf;
+    uint32_t subleaf;
+    uint32_t regs[4];
+};
+
+/* cpuid results captured before cpuid faulting is enabled */
+static struct {
+    struct sk_cpuid_entry entries[320];
+    uint32_t count;
+} sk_cpuid;
+
+static inline void
+sk_cpuid_capture(uint32_t leaf, uint32_t subleaf)
+{
+    if (sk_cpuid.count >= ARRAY_SIZE(sk_cpuid.entries))
+        return;
+
+    struct sk_cpuid_entry *entry = &sk_cpuid.entries[sk_cpuid.count++];
+    entry->leaf = leaf;
+    entry->subleaf = subleaf;
+    __cpuid_count(leaf, subleaf, entry->regs[0], entry->regs[1], entry->regs[2], entry->regs[3]);
+}
+
+/* emulates a faulting cpuid from the captured results */
+static inline void
+sk_cpuid_handle_fault(int sig, siginfo_t *info, void *data)
+{
+    ucontext_t *uc = (ucontext_t *)data;
+    greg_t *regs = uc->uc_mcontext.gregs;
+    const uint8_t *ip = (const uint8_t *)regs[REG_RIP];
+
+    /* a real segfault; return to fault again with the default action */
+    if (info->si_code != SI_KERNEL || ip[0] != 0x0f || ip[1] != 0xa2) {
+        signal(SIGSEGV, SIG_DFL);
+        return;
+    }
+
+    const uint32_t leaf = regs[REG_RAX];
+    const uint32_t subleaf = regs[REG_RCX];
+    const struct sk_cpuid_entry *match = NULL;
+    for (uint32_t i = 0; i < sk_cpuid.count; i++) {
+        const struct sk_cpuid_entry *entry = &sk_cpuid.entries[i];
+        if (entry->leaf != leaf)
+            continue;
+        /* leaves without subleaves ignore ecx */
+        if (entry->subleaf == subleaf) {
+            match = entry;
+            break;
+        }
+        if (!entry->subleaf)
+            match = entry;
+    }
+
+    regs[REG_RAX] = match ? match->regs[0] : 0;
+    regs[REG_RBX] = match ? match->regs[1] : 0;
+    regs[REG_RCX] = match ? match->regs[2] : 0;
+    regs[REG_RDX] = match ? match->regs[3] : 0;
+    regs[REG_RIP] += 2;
+}
+
+/*
+ * Hides the cpuid bits above level from this thread and the threads it
+ * creates, so that SkCpu picks the code paths of that level.  It must be
+ * called before skia reads cpuid, and requires cpuid faulting.
+ */
+static inline void
+sk_cpu_restrict(enum sk_cpu_level_type level)
+{
+    const uint32_t max_leaf = std::min(__get_cpuid_max(0, NULL), 0x1fu);
+    for (uint32_t leaf = 0; leaf <= max_leaf; leaf++) {
+        for (uint32_t subleaf = 0; subleaf < 8; subleaf++)
+            sk_cpuid_capture(leaf, subleaf);
+    }
+    const uint32_t max_ext_leaf = std::min(__get_cpuid_max(0x80000000, NULL), 0x80000008u);
+    for (uint32_t leaf = 0x80000000; leaf <= max_ext_leaf; leaf++)
+        sk_cpuid_capture(leaf, 0);
+
+    struct sk_cpu_level hidden = {};
+    for (int i = level + 1; i < SK_CPU_LEVEL_COUNT; i++) {
+        hidden.leaf1_ecx |= sk_cpu_levels[i].leaf1_ecx;
+        hidden.leaf7_ebx |= sk_cpu_levels[i].leaf7_ebx;
+        hidden.leaf7_ecx |= sk_cpu_levels[i].leaf7_ecx;
+    }
+    for (uint32_t i = 0; i < sk_cpuid.count; i++) {
+        struct sk_cpuid_entry *entry = &sk_cpuid.entries[i];
+        if (entry->leaf == 1) {
+            entry->regs[2] &= ~hidden.leaf1_ecx;
+        } else if (entry->leaf == 7 && !entry->subleaf) {
+            entry->regs[1] &= ~hidden.leaf7_ebx;
+            entry->regs[2] &= ~hidden.leaf7_ecx;
+        }
+    }
+
+    struct sigaction act = {};
+    act.sa_sigaction = sk_cpuid_handle_fault;
+    act.sa_flags = SA_SIGINFO;
+    if (sigaction(SIGSEGV, &act, NULL))
+        sk_die("failed to install the cpuid handler");
+
+    if (syscall(SYS_arch_prctl, ARCH_SET_CPUID, 0))
+        sk_die("cpuid faulting is not supported");
+}
+
+#else
+
+static inline void
+sk_cpu_restrict(enum sk_cpu_level_type level)
+{
+    sk_die("cpu levels require x86-64");
+}
+
+#endif
+
+/*
+ * Runs func in a child process restricted to level and returns the time func
+ * returns.  The caller must not have created threads or initialized skia.
+ */
+static inline bool
+sk_cpu_level_run(enum sk_cpu_level_type level,
+                 const std::function<uint64_t(void)> &func,
+                 uint64_t *ns)
+{
+    int fds[2];
+    if (pipe(fds))
+        sk_die("failed to create pipe");
+
+    /* or the child would print the buffered output again */
+    fflush(stdout);
+
+    const pid_t pid = fork();
+    if (pid < 0)
+        sk_die("failed to fork");
+    if (!pid) {
+        close(fds[0]);
+        sk_cpu_restrict(level);
+        const uint64_t val = func();
+        const bool ok = write(fds[1], &val, sizeof(val)) == sizeof(val);
+        fflush(stdout);
+        _exit(ok ? 0 : 1);
+    }
+
+    close(fds[1]);
+    const bool ok = read(fds[0], ns, sizeof(*ns)) == sizeof(*ns);
+    close(fds[0]);
+
+    int status;
+    if (waitpid(pid, &status, 0) != pid)
+        sk_die("failed to wait for %s", sk_cpu_levels[level].name);
+
+    return ok && WIFEXITED(status) && !WEXITSTATUS(status);
+}
+
+/*
+ * Runs draw in a child process per supported level.  draw must dump the
+ * image named by sk_cpu_level_get_filename and return the time it took.
+ */
+static inline void
+sk_cpu_levels_run(const char *name,
+                  const std::function<uint64_t(enum sk_cpu_level_type)> &draw,
+                  struct sk_cpu_level_results *results)
+{
+    *results = {};
+    for (int i = 0; i < SK_CPU_LEVEL_COUNT; i++) {
+        const enum sk_cpu_level_type level = (enum sk_cpu_level_type)i;
+        if (!sk_cpu_level_is_supported(level)) {
+            sk_log("%s/%s: not supported by this cpu", name, sk_cpu_levels[i].name);
+            continue;
+        }
+
+        results->ran[i] =
+            sk_cpu_level_run(level, [&draw, level] { return draw(level); }, &results->ns[i]);
+        if (!results->ran[i])
+            sk_log("%s/%s: failed", name, sk_cpu_levels[i].name);
+    }
+}
+
+/* compares the times and the rt-<level>.png dumps of the levels that ran */
+static inline void
+sk_cpu_levels_report(struct sk *sk,
+                     const char *name,
+                     const struct sk_cpu_level_results *results,
+                     uint32_t iter_count,
+                     const char *unit)
+{
+    int base = -1;
+    int top = -1;
+    for (int i = 0; i < SK_CPU_LEVEL_COUNT; i++) {
+        if (!results->ran[i])
+            continue;
+        if (base < 0)
+            base = i;
+        top = i;
+    }
+    if (base < 0)
+        sk_die("no cpu level ran");
+
+    /* the highest level is the reference */
+    char filename[64];
+    sk_cpu_level_get_filename((enum sk_cpu_level_type)top, filename, sizeof(filename));
+    const SkISize size = sk_open_codec(sk, filename)->dimensions();
+    const SkImageInfo info = sk_make_image_info(sk, size.width(), size.height());
+    SkBitmap ref;
+    sk_load_golden(sk, filename, info, &ref);
+
+    for (int i = base; i <= top; i++) {
+        if (!results->ran[i])
+            continue;
+
+        sk_cpu_level_get_filename((enum sk_cpu_level_type)i, filename, sizeof(filename));
+        SkBitmap bitmap;
+        sk_load_golden(sk, filename, info, &bitmap);
+        const struct sk_compare_params params = {};
+        const struct sk_compare_result res =
+            sk_compare_pixmaps(sk, bitmap.pixmap(), ref.pixmap(), &params, NULL);
+
+        /* at least 1 ns so that a level too fast to measure does not divide by zero */
+        const uint64_t ns = std::max<uint64_t>(results->ns[i], 1);
+        sk_log("%s/%-5s: %.3f ms/%s, %.2fx over %s, max diff (%d, %d, %d, %d) and %" PRIu64
+               " pixels differ from %s",
+               name, sk_cpu_levels[i].name, results->ns[i] / 1e6 / iter_count, unit,
+               (double)results->ns[base] / ns, sk_cpu_levels[base].name, res.max_diff[0],
+               res.max_diff[1], res.max_diff[2], res.max_diff[3], res.diff_count,
+               sk_cpu_levels[top].name);
+    }
 }
 
 #endif /* SKUTIL_H */
@@ -0,0 +1,347 @@
+/*
+ * Copyright 2023 Google LLC
+ * SPDX-License-Identifier: MIT
+ */
+
+/*
+ * Linked into every test when alloc-stats is enabled.  It replaces malloc
+ * and friends, forwarding to glibc, and the global operator new and delete,
+ * forwarding to malloc and free.  Allocations are attributed to the phase
+ * set with sk_alloc_set_phase and a table is printed at exit.
+ */
+
+#include "skutil.h"
+
+#include <malloc.h>
+#include <new>
+
+extern "C" {
+void *__libc_malloc(size_t size);
+void *__libc_calloc(size_t count, size_t size);
+void *__libc_realloc(void *ptr, size_t size);
+void *__libc_memalign(size_t alignment, size_t size);
+void *__libc_valloc(size_t size);
+void __libc_free(void *ptr);
+}
+
+struct sk_alloc_counters {
+    std::atomic<uint64_t> alloc_count;
+    std::atomic<uint64_t> alloc_bytes;
+    std::atomic<uint64_t> free_count;
+    std::atomic<uint64_t> free_bytes;
+    /* the most that live bytes grew above their value on entering the phase */
+    std::atomic<int64_t> peak_growth_bytes;
+    std::atomic<uint64_t> max_rss;
+};
+
+/* zero-initialized before any constructor runs, and thus before the first malloc */
+static struct {
+    std::atomic<int> phase;
+    std::atomic<bool> warm;
+    std::atomic<int64_t> live_bytes;
+    /* live_bytes when the current phase was entered */
+    std::atomic<int64_t> phase_live_bytes;
+
+    struct sk_alloc_counters phases[SK_ALLOC_PHASE_COUNT];
+    /* draw and flush allocations after the first pixel */
+    struct sk_alloc_counters steady;
+} sk_alloc;
+
+static const char *const sk_alloc_phase_names[SK_ALLOC_PHASE_COUNT] = {
+    "init", "draw", "flush", "dump", "cleanup",
+};
+
+static void
+sk_alloc_update_max(std::atomic<int64_t> *max, int64_t val)
+{
+    int64_t cur = max->load(std::memory_order_relaxed);
+    while (cur < val && !max->compare_exchange_weak(cur, val, std::memory_order_relaxed))
+        ;
+}
+
+static void
+sk_alloc_track(void *ptr)
+{
+    if (!ptr)
+        return;
+
+    const uint64_t size = malloc_usable_size(ptr);
+    const int phase = sk_alloc.phase.load(std::memory_order_relaxed);
+    const int64_t live = sk_alloc.live_bytes.fetch_add(size, std::memory_order_relaxed) + size;
+
+    struct sk_alloc_counters *counters = &sk_alloc.phases[phase];
+    counters->alloc_count.fetch_add(1, std::memory_order_relaxed);
+    counters->alloc_bytes.fetch_add(size, std::memory_order_relaxed);
+    sk_alloc_update_max(&counters->peak_growth_bytes,
+                        live - sk_alloc.phase_live_bytes.load(std::memory_order_relaxed));
+
+    if (sk_alloc.warm.load(std::memory_order_relaxed) &&
+        (phase == SK_ALLOC_PHASE_DRAW || phase == SK_ALLOC_PHASE_FLUSH)) {
+        sk_alloc.steady.alloc_count.fetch_add(1, std::memory_order_relaxed);
+        sk_alloc.steady.alloc_bytes.fetch_add(size, std::memory_order_relaxed);
+    }
+}
+
+static void
+sk_alloc_untrack_size(uint64_t size)
+{
+    const int phase = sk_alloc.phase.load(std::memory_order_relaxed);
+    sk_alloc.live_bytes.fetch_sub(size, std::memory_order_relaxed);
+
+    struct sk_alloc_counters *counters = &sk_alloc.phases[phase];
+    counters->free_count.fetch_add(1, std::memory_order_relaxed);
+    counters->free_bytes.fetch_add(size, std::memory_order_relaxed);
+}
+
+static void
+sk_alloc_untrack(void *ptr)
+{
+    if (ptr)
+        sk_alloc_untrack_size(malloc_usable_size(ptr));
+}
+
+static void
+sk_alloc_sample_rss(int phase)
+{
+    std::atomic<uint64_t> *max_rss = &sk_alloc.phases[phase].max_rss;
+    const uint64_t rss = sk_get_rss();
+    if (max_rss->load(std::memory_order_relaxed) < rss)
+        max_rss->store(rss, std::memory_order_relaxed);
+}
+
+enum sk_alloc_phase
+sk_alloc_set_phase(enum sk_alloc_phase phase)
+{
+    const int prev = sk_alloc.phase.exchange(phase, std::memory_order_relaxed);
+    if (prev != phase) {
+        sk_alloc.phase_live_bytes.store(sk_alloc.live_bytes.load(std::memory_order_relaxed),
+                                        std::memory_order_relaxed);
+        sk_alloc_sample_rss(prev);
+        sk_alloc_sample_rss(phase);
+    }
+    return (enum sk_alloc_phase)prev;
+}
+
+void
+sk_alloc_mark_warm(void)
+{
+    sk_alloc.warm.store(true, std::memory_order_relaxed);
+}
+
+__attribute__((destructor)) static void
+sk_alloc_report(void)
+{
+    sk_alloc_sample_rss(sk_alloc.phase.load(std::memory_order_relaxed));
+
+    /* snapshot first; printing allocates */
+    uint64_t counts[SK_ALLOC_PHASE_COUNT][6];
+    for (int i = 0; i < SK_ALLOC_PHASE_COUNT; i++) {
+        const struct sk_alloc_counters *counters = &sk_alloc.phases[i];
+        counts[i][0] = counters->alloc_count;
+        counts[i][1] = counters->alloc_bytes;
+        counts[i][2] = counters->free_count;
+        counts[i][3] = counters->free_bytes;
+        counts[i][4] = std::max<int64_t>(counters->peak_growth_bytes, 0);
+        counts[i][5] = counters->max_rss;
+    }
+    const uint64_t steady_count = sk_alloc.steady.alloc_count;
+    const uint64_t steady_bytes = sk_alloc.steady.alloc_bytes;
+    const bool warm = sk_alloc.warm;
+
+    sk_log("alloc stats for pid %d:", getpid());
+    sk_log("%-8s %10s %10s %10s %10s %10s %10s", "phase", "allocs", "alloc MiB", "frees",
+           "free MiB", "growth MiB", "rss MiB");
+    for (int i = 0; i < SK_ALLOC_PHASE_COUNT; i++) {
+        sk_log("%-8s %10" PRIu64 " %10.2f %10" PRIu64 " %10.2f %10.2f %10.2f",
+               sk_alloc_phase_names[i], counts[i][0], counts[i][1] / (double)(1 << 20),
+               counts[i][2], counts[i][3] / (double)(1 << 20), counts[i][4] / (double)(1 << 20),
+               counts[i][5] / (double)(1 << 20));
+    }
+
+    if (warm) {
+        sk_log("after the first pixel: %" PRIu64 " allocs, %.1f KiB in draw and flush%s",
+               steady_count, steady_bytes / 1024.0,
+               steady_count ? "" : " (allocation-free steady state)");
+    }
+}
+
+extern "C" {
+
+void *
+malloc(size_t size)
+{
+    void *ptr = __libc_malloc(size);
+    sk_alloc_track(ptr);
+    return ptr;
+}
+
+void *
+calloc(size_t count, size_t size)
+{
+    void *ptr = __libc_calloc(count, size);
+    sk_alloc_track(ptr);
+    return ptr;
+}
+
+void *
+realloc(void *ptr, size_t size)
+{
+    const uint64_t old_size = ptr ? malloc_usable_size(ptr) : 0;
+    void *ret = __libc_realloc(ptr, size);
+
+    /* on failure, ptr is left untouched */
+    if (!ret && size)
+        return NULL;
+
+    if (ptr)
+        sk_alloc_untrack_size(old_size);
+    sk_alloc_track(ret);
+    return ret;
+}
+
+void *
+memalign(size_t alignment, size_t size)
+{
+    void *ptr = __libc_memalign(alignment, size);
+    sk_alloc_track(ptr);
+    return ptr;
+}
+
+void *
+aligned_alloc(size_t alignment, size_t size)
+{
+    return memalign(alignment, size);
+}
+
+int
+posix_memalign(void **out, size_t alignment, size_t size)
+{
+    if (!alignment || (alignment & (alignment - 1)) || alignment % sizeof(void *))
+        return EINVAL;
+
+    void *ptr = memalign(alignment, size);
+    if (!ptr)
+        return ENOMEM;
+
+    *out = ptr;
+    return 0;
+}
+
+void *
+valloc(size_t size)
+{
+    void *ptr = __libc_valloc(size);
+    sk_alloc_track(ptr);
+    return ptr;
+}
+
+void
+free(void *ptr)
+{
+    sk_alloc_untrack(ptr);
+    __libc_free(ptr);
+}
+
+} /* extern "C" */
+
+static void *
+sk_alloc_new(size_t size)
+{
+    void *ptr = malloc(size ? size : 1);
+    if (!ptr)
+        throw std::bad_alloc();
+    return ptr;
+}
+
+static void *
+sk_alloc_new_aligned(size_t size, std::align_val_t alignment)
+{
+    void *ptr = memalign((size_t)alignment, size ? size : 1);
+    if (!ptr)
+        throw std::bad_alloc();
+    return ptr;
+}
+
+void *
+operator new(size_t size)
+{
+    return sk_alloc_new(size);
+}
+
+void *
+operator new[](size_t size)
+{
+    return sk_alloc_new(size);
+}
+
+void *
+operator new(size_t size, const std::nothrow_t &) noexcept
+{
+    return malloc(size ? size : 1);
+}
+
+void *
+operator new[](size_t size, const std::nothrow_t &) noexcept
+{
+    return malloc(size ? size : 1);
+}
+
+void *
+operator new(size_t size, std::align_val_t alignment)
+{
+    return sk_alloc_new_aligned(size, alignment);
+}
+
+void *
+operator new[](size_t size, std::align_val_t alignment)
+{
+    return sk_alloc_new_aligned(size, alignment);
+}
+
+void
+operator delete(void *ptr) noexcept
+{
+    free(ptr);
+}
+
+void
+operator delete[](void *ptr) noexcept
+{
+    free(ptr);
+}
+
+void
+operator delete(void *ptr, size_t) noexcept
+{
+    free(ptr);
+}
+
+void
+operator delete[](void *ptr, size_t) noexcept
+{
+    free(ptr);
+}
+
+void
+operator delete(void *ptr, std::align_val_t) noexcept
+{
+    free(ptr);
+}
+
+void
+operator delete[](void *ptr, std::align_val_t) noexcept
+{
+    free(ptr);
+}
+
+void
+operator delete(void *ptr, size_t, std::align_val_t) noexcept
+{
+    free(ptr);
+}
+
+void
+operator delete[](void *ptr, size_t, std::align_val_t) noexcept
+{
+    free(ptr);
+}
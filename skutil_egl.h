@@ -11,9 +11,26 @@
 #define EGL_EGL_PROTOTYPES 0
 #include <EGL/egl.h>
 #include <EGL/eglext.h>
+#define GL_GLES_PROTOTYPES 0
+#include <GLES3/gl3.h>
 #include <dlfcn.h>
+#include <mutex>
+
+enum sk_egl_device_type {
+    SK_EGL_DEVICE_ANY,
+    SK_EGL_DEVICE_HW,
+    SK_EGL_DEVICE_SW,
+};
+
+struct sk_egl_init_params {
+    /* when set, the device node or renderer name must contain this */
+    const char *device_name;
+    enum sk_egl_device_type device_type;
+};
 
 struct sk_egl {
+    struct sk_egl_init_params params;
+
     void *handle;
     PFNEGLGETPROCADDRESSPROC GetProcAddress;
     PFNEGLQUERYSTRINGPROC QueryString;
@@ -32,10 +49,12 @@ struct sk_egl {
     EGLDisplay dpy;
 
     EGLContext ctx;
+    PFNGLCLIENTWAITSYNCPROC ClientWaitSync;
+    PFNGLDELETESYNCPROC DeleteSync;
 };
 
 static inline void
-sk_egl_init_library(struct sk_egl *egl)
+sk_egl_load_library(struct sk_egl *egl)
 {
     const char libegl_name[] = "libEGL.so.1";
     egl->handle = dlopen(libegl_name, RTLD_LOCAL | RTLD_LAZY);
@@ -47,15 +66,17 @@ sk_egl_init_library(struct sk_egl *egl)
     if (!egl->GetProcAddress)
         sk_die("failed to find %s: %s", gipa_name, dlerror());
 
+#define GPA_OPTIONAL(proc, name)                                                                 \
+    egl->name = (PFNEGL##proc##PROC)egl->GetProcAddress("egl" #name)
 #define GPA(proc, name)                                                                          \
     do {                                                                                         \
-        egl->name = (PFNEGL##proc##PROC)egl->GetProcAddress("egl" #name);                        \
+        GPA_OPTIONAL(proc, name);                                                                \
         if (!egl->name)                                                                          \
             sk_die("failed to find egl" #name);                                                  \
     } while (false)
     GPA(QUERYSTRING, QueryString);
-    GPA(QUERYDEVICESEXT, QueryDevicesEXT);
-    GPA(QUERYDEVICESTRINGEXT, QueryDeviceStringEXT);
+    GPA_OPTIONAL(QUERYDEVICESEXT, QueryDevicesEXT);
+    GPA_OPTIONAL(QUERYDEVICESTRINGEXT, QueryDeviceStringEXT);
     GPA(GETPLATFORMDISPLAY, GetPlatformDisplay);
     GPA(INITIALIZE, Initialize);
     GPA(QUERYAPI, QueryAPI);
@@ -65,40 +86,123 @@ sk_egl_init_library(struct sk_egl *egl)
     GPA(TERMINATE, Terminate);
     GPA(RELEASETHREAD, ReleaseThread);
 #undef GPA
+#undef GPA_OPTIONAL
 }
 
 static inline void
-sk_egl_init_display(struct sk_egl *egl)
+sk_egl_init_library(struct sk_egl *egl)
 {
-    const char *client_exts = egl->QueryString(EGL_NO_DISPLAY, EGL_EXTENSIONS);
-    if (!client_exts || !strstr(client_exts, "EGL_EXT_device_enumeration") ||
+    /* load once and keep the library and the proc table for the process lifetime */
+    static struct sk_egl lib;
+    static std::once_flag once;
+    std::call_once(once, [] { sk_egl_load_library(&lib); });
+
+#define COPY(name) egl->name = lib.name
+    COPY(handle);
+    COPY(GetProcAddress);
+    COPY(QueryString);
+    COPY(QueryDevicesEXT);
+    COPY(QueryDeviceStringEXT);
+    COPY(GetPlatformDisplay);
+    COPY(Initialize);
+    COPY(QueryAPI);
+    COPY(CreateContext);
+    COPY(MakeCurrent);
+    COPY(DestroyContext);
+    COPY(Terminate);
+    COPY(ReleaseThread);
+#undef COPY
+}
+
+static inline bool
+sk_egl_match_device(struct sk_egl *egl, EGLDeviceEXT dev)
+{
+    const char *exts = egl->QueryDeviceStringEXT(dev, EGL_EXTENSIONS);
+    if (!exts)
+        return false;
+
+    /* hardware devices must have a render node to be usable without a display server */
+    const bool swrast = strstr(exts, "EGL_MESA_device_software");
+    const bool render_node = strstr(exts, "EGL_EXT_device_drm_render_node");
+    switch (egl->params.device_type) {
+    case SK_EGL_DEVICE_HW:
+        if (swrast || !render_node)
+            return false;
+        break;
+    case SK_EGL_DEVICE_SW:
+        if (!swrast)
+            return false;
+        break;
+    default:
+        if (!swrast && !render_node)
+            return false;
+        break;
+    }
+
+    if (!egl->params.device_name)
+        return true;
+
+    const char *names[3] = {};
+    if (render_node)
+        names[0] = egl->QueryDeviceStringEXT(dev, EGL_DRM_RENDER_NODE_FILE_EXT);
+    if (strstr(exts, "EGL_EXT_device_drm"))
+        names[1] = egl->QueryDeviceStringEXT(dev, EGL_DRM_DEVICE_FILE_EXT);
+    if (strstr(exts, "EGL_EXT_device_query_name"))
+        names[2] = egl->QueryDeviceStringEXT(dev, EGL_RENDERER_EXT);
+
+    for (uint32_t i = 0; i < ARRAY_SIZE(names); i++) {
+        if (names[i] && strstr(names[i], egl->params.device_name))
+            return true;
+    }
+
+    return false;
+}
+
+static inline void
+sk_egl_init_device(struct sk_egl *egl, const char *client_exts)
+{
+    egl->dev = EGL_NO_DEVICE_EXT;
+
+    if (!strstr(client_exts, "EGL_EXT_device_enumeration") ||
         !strstr(client_exts, "EGL_EXT_device_query") ||
-        !strstr(client_exts, "EGL_EXT_platform_device"))
-        sk_die("no EGL platform device support");
+        !strstr(client_exts, "EGL_EXT_platform_device") || !egl->QueryDevicesEXT ||
+        !egl->QueryDeviceStringEXT)
+        return;
 
     EGLDeviceEXT devs[16];
     EGLint count;
     if (!egl->QueryDevicesEXT(ARRAY_SIZE(devs), devs, &count))
         sk_die("failed to query devices");
 
-    egl->dev = EGL_NO_DEVICE_EXT;
     for (int i = 0; i < count; i++) {
-        const char *exts = egl->QueryDeviceStringEXT(devs[i], EGL_EXTENSIONS);
-
-        /* EGL_EXT_device_drm_render_node */
-        if (!strstr(exts, "EGL_EXT_device_drm_render_node"))
-            continue;
-
-        const bool swrast = strstr(exts, "software");
-        if (!swrast || true) {
+        if (sk_egl_match_device(egl, devs[i])) {
             egl->dev = devs[i];
             break;
         }
     }
-    if (egl->dev == EGL_NO_DEVICE_EXT)
-        sk_die("failed to find a hw rendernode device");
+}
+
+static inline void
+sk_egl_init_display(struct sk_egl *egl)
+{
+    const char *client_exts = egl->QueryString(EGL_NO_DISPLAY, EGL_EXTENSIONS);
+    if (!client_exts)
+        sk_die("no EGL client extensions");
 
-    egl->dpy = egl->GetPlatformDisplay(EGL_PLATFORM_DEVICE_EXT, egl->dev, NULL);
+    sk_egl_init_device(egl, client_exts);
+    if (egl->dev != EGL_NO_DEVICE_EXT) {
+        egl->dpy = egl->GetPlatformDisplay(EGL_PLATFORM_DEVICE_EXT, egl->dev, NULL);
+    } else {
+        /* a named device must not be silently replaced by the default one */
+        if (egl->params.device_name)
+            sk_die("failed to find device %s", egl->params.device_name);
+        if (!strstr(client_exts, "EGL_MESA_platform_surfaceless"))
+            sk_die("no EGL platform device or surfaceless support");
+
+        sk_log("no matching EGL device; falling back to the surfaceless platform");
+        egl->dpy = egl->GetPlatformDisplay(EGL_PLATFORM_SURFACELESS_MESA, EGL_DEFAULT_DISPLAY,
+                                           NULL);
+    }
     if (egl->dpy == EGL_NO_DISPLAY)
         sk_die("failed to get platform display");
 
@@ -112,10 +216,17 @@ sk_egl_init_display(struct sk_egl *egl)
     const char *dpy_exts = egl->QueryString(egl->dpy, EGL_EXTENSIONS);
     if (!strstr(dpy_exts, "EGL_KHR_no_config_context"))
         sk_die("missing EGL_KHR_no_config_context");
+    if (!strstr(dpy_exts, "EGL_KHR_surfaceless_context"))
+        sk_die("missing EGL_KHR_surfaceless_context");
 }
 
-static inline void
-sk_egl_init_context(struct sk_egl *egl)
+/*
+ * Creates a context on the shared display.  Contexts for other threads can
+ * be created this way and made current with sk_egl_make_current on those
+ * threads.
+ */
+static inline EGLContext
+sk_egl_create_context(struct sk_egl *egl, EGLContext share)
 {
     if (egl->QueryAPI() != EGL_OPENGL_ES_API)
         sk_die("current api is not GLES");
@@ -124,20 +235,55 @@ sk_egl_init_context(struct sk_egl *egl)
         EGL_CONTEXT_MAJOR_VERSION, 3, EGL_CONTEXT_MINOR_VERSION, 2, EGL_NONE,
     };
 
-    EGLContext ctx = egl->CreateContext(egl->dpy, EGL_NO_CONFIG_KHR, EGL_NO_CONTEXT, ctx_attrs);
+    EGLContext ctx = egl->CreateContext(egl->dpy, EGL_NO_CONFIG_KHR, share, ctx_attrs);
     if (ctx == EGL_NO_CONTEXT)
         sk_die("failed to create a context");
 
+    return ctx;
+}
+
+static inline void
+sk_egl_make_current(struct sk_egl *egl, EGLContext ctx)
+{
     if (!egl->MakeCurrent(egl->dpy, EGL_NO_SURFACE, EGL_NO_SURFACE, ctx))
         sk_die("failed to make context current");
+}
+
+static inline void
+sk_egl_destroy_context(struct sk_egl *egl, EGLContext ctx)
+{
+    egl->DestroyContext(egl->dpy, ctx);
+}
+
+static inline void
+sk_egl_init_context(struct sk_egl *egl)
+{
+    egl->ctx = sk_egl_create_context(egl, EGL_NO_CONTEXT);
+    sk_egl_make_current(egl, egl->ctx);
 
-    egl->ctx = ctx;
+    /* for waiting on the fences ganesh returns as signal semaphores */
+    egl->ClientWaitSync = (PFNGLCLIENTWAITSYNCPROC)egl->GetProcAddress("glClientWaitSync");
+    egl->DeleteSync = (PFNGLDELETESYNCPROC)egl->GetProcAddress("glDeleteSync");
+    if (!egl->ClientWaitSync || !egl->DeleteSync)
+        sk_die("failed to find GL sync functions");
+}
+
+/* waits for and deletes a fence from the current context */
+static inline void
+sk_egl_wait_sync(struct sk_egl *egl, GLsync sync)
+{
+    const GLenum result = egl->ClientWaitSync(sync, GL_SYNC_FLUSH_COMMANDS_BIT, UINT64_MAX);
+    if (result != GL_ALREADY_SIGNALED && result != GL_CONDITION_SATISFIED)
+        sk_die("failed to wait for fence");
+    egl->DeleteSync(sync);
 }
 
 static inline void
-sk_egl_init(struct sk_egl *egl)
+sk_egl_init(struct sk_egl *egl, const struct sk_egl_init_params *params)
 {
     memset(egl, 0, sizeof(*egl));
+    if (params)
+        egl->params = *params;
 
     sk_egl_init_library(egl);
     sk_egl_init_display(egl);
@@ -148,12 +294,12 @@ static inline void
 sk_egl_cleanup(struct sk_egl *egl)
 {
     egl->MakeCurrent(egl->dpy, EGL_NO_SURFACE, EGL_NO_SURFACE, EGL_NO_CONTEXT);
-    egl->DestroyContext(egl->dpy, egl->ctx);
+    sk_egl_destroy_context(egl, egl->ctx);
 
     egl->Terminate(egl->dpy);
     egl->ReleaseThread();
 
-    dlclose(egl->handle);
+    /* egl->handle is owned by sk_egl_init_library */
 }
 
 #endif /* SKUTIL_EGL_H */
@@ -0,0 +1,901 @@
+/*
+ * Copyright 2023 Google LLC
+ * SPDX-License-Identifier: MIT
+ */
+
+#ifndef SKUTIL_SCENE_H
+#define SKUTIL_SCENE_H
+
+#include "include/core/SkColorFilter.h"
+#include "include/core/SkFont.h"
+#include "include/core/SkFontMetrics.h"
+#include "include/core/SkM44.h"
+#include "include/core/SkPath.h"
+#include "include/core/SkTextBlob.h"
+#include "include/core/SkTypeface.h"
+#include "include/effects/SkColorMatrix.h"
+#include "include/effects/SkGradientShader.h"
+#include "include/effects/SkImageFilters.h"
+#include "include/effects/SkRuntimeEffect.h"
+#include "skutil.h"
+
+#include <unordered_map>
+
+enum sk_scene_type {
+    SK_SCENE_CIRCLE,
+    SK_SCENE_TEXT,
+    SK_SCENE_TEXT_NOCACHE,
+    SK_SCENE_PATH,
+    SK_SCENE_PATH_VOLATILE,
+    SK_SCENE_FILTER,
+    SK_SCENE_FILTER_CACHED,
+    SK_SCENE_SKSL,
+};
+
+struct sk_text_blob {
+    sk_sp<SkTextBlob> blob;
+    uint32_t glyph_count;
+};
+
+/* the filtered result of a card, valid while its content generation is unchanged */
+struct sk_filter_card {
+    uint32_t generation;
+    sk_sp<SkImage> img;
+};
+
+struct sk_scene {
+    enum sk_scene_type type;
+    uint32_t width;
+    uint32_t height;
+
+    struct {
+        sk_sp<SkTypeface> typeface;
+        std::vector<std::string> paragraphs;
+
+        /* keyed by text, typeface, size and wrap width */
+        std::unordered_map<std::string, struct sk_text_blob> blobs;
+        uint64_t hit_count;
+        uint64_t miss_count;
+        uint64_t glyph_count;
+    } text;
+
+    struct {
+        uint32_t count;
+        std::vector<SkPath> paths;
+        std::vector<SkPaint> paints;
+        uint64_t path_count;
+    } path;
+
+    struct {
+        uint32_t count;
+        std::vector<struct sk_filter_card> cards;
+        uint64_t layer_count;
+        uint64_t hit_count;
+        uint64_t miss_count;
+    } filter;
+
+    struct {
+        std::vector<sk_sp<SkRuntimeEffect>> effects;
+        sk_sp<SkColorFilter> grade;
+        sk_sp<SkShader> image;
+        uint64_t compile_ns;
+        uint64_t pixel_count;
+    } sksl;
+
+    /* the animated element of sequence mode */
+    struct {
+        SkIRect prev;
+        uint64_t damaged_pixels;
+    } anim;
+};
+
+/* fractions of the surface damaged per frame in sequence mode */
+static const float sk_scene_anim_damages[] = { 0.01f, 0.1f, 0.5f };
+
+static const struct {
+    const char *name;
+    enum sk_scene_type type;
+} sk_scene_names[] = {
+    { "circle", SK_SCENE_CIRCLE },
+    { "text", SK_SCENE_TEXT },
+    { "text-nocache", SK_SCENE_TEXT_NOCACHE },
+    { "path", SK_SCENE_PATH },
+    { "path-volatile", SK_SCENE_PATH_VOLATILE },
+    { "filter", SK_SCENE_FILTER },
+    { "filter-cached", SK_SCENE_FILTER_CACHED },
+    { "sksl", SK_SCENE_SKSL },
+};
+
+/* every effect declares u_size and u_time; u_image is an optional child */
+static const char *const sk_scene_sksl_effects[] = {
+    /* plasma */
+    "uniform float2 u_size;"
+    "uniform float u_time;"
+    "half4 main(float2 p) {"
+    "    float2 uv = p / u_size;"
+    "    float v = sin(uv.x * 10 + u_time) + sin(uv.y * 10 + u_time * 1.3) +"
+    "              sin((uv.x + uv.y) * 10 + u_time * 0.7);"
+    "    return half4(half3(0.5 + 0.5 * sin(v * 3.14 + float3(0, 2, 4))), 1);"
+    "}",
+    /* rings */
+    "uniform float2 u_size;"
+    "uniform float u_time;"
+    "half4 main(float2 p) {"
+    "    float d = length(p - u_size * 0.5) / length(u_size);"
+    "    float r = smoothstep(0.4, 0.6, fract(d * 12 - u_time));"
+    "    return half4(mix(half3(0.1, 0.2, 0.5), half3(1, 0.9, 0.6), half(r)), 1);"
+    "}",
+    /* fbm value noise */
+    "uniform float2 u_size;"
+    "uniform float u_time;"
+    "float vhash(float2 p) { return fract(sin(dot(p, float2(127.1, 311.7))) * 43758.5453); }"
+    "float vnoise(float2 p) {"
+    "    float2 i = floor(p);"
+    "    float2 f = fract(p);"
+    "    float2 u = f * f * (3 - 2 * f);"
+    "    return mix(mix(vhash(i), vhash(i + float2(1, 0)), u.x),"
+    "               mix(vhash(i + float2(0, 1)), vhash(i + float2(1, 1)), u.x), u.y);"
+    "}"
+    "half4 main(float2 p) {"
+    "    float2 uv = p / u_size * 8 + u_time * 0.2;"
+    "    float v = 0;"
+    "    float a = 0.5;"
+    "    for (int i = 0; i < 5; i++) {"
+    "        v += a * vnoise(uv);"
+    "        uv *= 2;"
+    "        a *= 0.5;"
+    "    }"
+    "    return half4(half3(v), 1);"
+    "}",
+    /* rotating checkerboard */
+    "uniform float2 u_size;"
+    "uniform float u_time;"
+    "half4 main(float2 p) {"
+    "    float s = sin(u_time * 0.3);"
+    "    float c = cos(u_time * 0.3);"
+    "    float2 q = float2x2(c, -s, s, c) * (p - u_size * 0.5) / 16;"
+    "    float v = mod(floor(q.x) + floor(q.y), 2);"
+    "    return half4(half3(0.2 + 0.6 * v), 1);"
+    "}",
+    /* ripple over a child shader */
+    "uniform shader u_image;"
+    "uniform float2 u_size;"
+    "uniform float u_time;"
+    "half4 main(float2 p) {"
+    "    float2 d = p - u_size * 0.5;"
+    "    float len = length(d);"
+    "    float2 offset = d / max(len, 1) * sin(len * 0.2 - u_time * 4) * 4;"
+    "    return u_image.eval(p + offset);"
+    "}",
+    /* soft vignette over a gradient */
+    "uniform float2 u_size;"
+    "uniform float u_time;"
+    "half4 main(float2 p) {"
+    "    float2 uv = p / u_size;"
+    "    float v = 1 - smoothstep(0.3, 0.8, distance(uv, float2(0.5)));"
+    "    half3 c = mix(half3(0.9, 0.3, 0.2), half3(0.2, 0.4, 0.9), half(uv.y));"
+    "    return half4(c * half(0.4 + 0.6 * v * (0.9 + 0.1 * sin(u_time))), 1);"
+    "}",
+};
+
+/* lifts shadows; applied to every other tile */
+static const char sk_scene_sksl_grade[] =
+    "half4 main(half4 c) {"
+    "    return half4(pow(c.rgb, half3(0.8)), c.a);"
+    "}";
+
+/* blur sigmas of the cards, cycled */
+static const float sk_scene_filter_sigmas[] = { 2.0f, 8.0f, 32.0f };
+
+static inline enum sk_scene_type
+sk_scene_parse_type(const char *name)
+{
+    for (uint32_t i = 0; i < ARRAY_SIZE(sk_scene_names); i++) {
+        if (!strcmp(sk_scene_names[i].name, name))
+            return sk_scene_names[i].type;
+    }
+
+    std::string names;
+    for (uint32_t i = 0; i < ARRAY_SIZE(sk_scene_names); i++)
+        names += std::string(" ") + sk_scene_names[i].name;
+    sk_die("unknown scene %s; valid scenes are:%s", name, names.c_str());
+}
+
+static inline const char *
+sk_scene_get_name(enum sk_scene_type type)
+{
+    for (uint32_t i = 0; i < ARRAY_SIZE(sk_scene_names); i++) {
+        if (sk_scene_names[i].type == type)
+            return sk_scene_names[i].name;
+    }
+    return "unknown";
+}
+
+static inline void
+sk_scene_init_text(struct sk *sk, struct sk_scene *scene)
+{
+    static const char *const words[] = {
+        "lorem",  "ipsum",  "dolor",  "sit",     "amet",         "consectetur", "adipiscing",
+        "elit",   "sed",    "do",     "eiusmod", "tempor",       "incididunt",  "ut",
+        "labore", "et",     "dolore", "magna",   "aliqua",       "enim",        "ad",
+        "minim",  "veniam", "quis",   "nostrud", "exercitation", "ullamco",     "laboris",
+    };
+
+    scene->text.typeface = sk_get_font_mgr(sk)->legacyMakeTypeface(NULL, SkFontStyle());
+    if (!scene->text.typeface)
+        sk_die("failed to create the default typeface");
+
+    /* deterministic paragraphs of 20 to 80 words */
+    uint32_t seed = 1;
+    for (uint32_t i = 0; i < 16; i++) {
+        std::string para;
+        const uint32_t word_count = 20 + i * 37 % 61;
+        for (uint32_t j = 0; j < word_count; j++) {
+            seed = seed * 1103515245 + 12345;
+            if (j)
+                para += ' ';
+            para += words[(seed >> 16) % ARRAY_SIZE(words)];
+        }
+        scene->text.paragraphs.push_back(para);
+    }
+}
+
+/* returns a pseudo-random float in [0, 1) */
+static inline float
+sk_scene_rand(uint32_t *seed)
+{
+    *seed = *seed * 1103515245 + 12345;
+    return (float)((*seed >> 8) & 0xffff) / 65536.0f;
+}
+
+/* generates one of cubic, self-intersecting, stroked and hairline paths */
+static inline void
+sk_scene_make_path(struct sk_scene *scene, uint32_t seed, SkPath *path, SkPaint *paint)
+{
+    const uint32_t kind = seed % 4;
+    const float size = 8.0f + 40.0f * sk_scene_rand(&seed);
+    const float cx = scene->width * sk_scene_rand(&seed);
+    const float cy = scene->height * sk_scene_rand(&seed);
+
+    path->reset();
+    *paint = SkPaint();
+    paint->setAntiAlias(true);
+    paint->setColor(SkColorSetARGB(0xc0, 0xff * sk_scene_rand(&seed),
+                                   0xff * sk_scene_rand(&seed), 0xff * sk_scene_rand(&seed)));
+
+    switch (kind) {
+    case 0: {
+        /* closed blob of cubics */
+        const int segment_count = 3 + (int)(5.0f * sk_scene_rand(&seed));
+        path->moveTo(cx + size, cy);
+        for (int i = 1; i <= segment_count; i++) {
+            const float a0 = 2.0f * M_PI * (i - 0.66f) / segment_count;
+            const float a1 = 2.0f * M_PI * (i - 0.33f) / segment_count;
+            const float a2 = 2.0f * M_PI * i / segment_count;
+            const float r0 = size * (0.5f + sk_scene_rand(&seed));
+            const float r1 = size * (0.5f + sk_scene_rand(&seed));
+            path->cubicTo(cx + r0 * cosf(a0), cy + r0 * sinf(a0), cx + r1 * cosf(a1),
+                          cy + r1 * sinf(a1), cx + size * cosf(a2), cy + size * sinf(a2));
+        }
+        path->close();
+        break;
+    }
+    case 1: {
+        /* self-intersecting star polygon */
+        const int point_count = 5 + 2 * (int)(4.0f * sk_scene_rand(&seed));
+        const int step = point_count / 2;
+        for (int i = 0; i < point_count; i++) {
+            const float a = 2.0f * M_PI * (i * step % point_count) / point_count;
+            if (i)
+                path->lineTo(cx + size * cosf(a), cy + size * sinf(a));
+            else
+                path->moveTo(cx + size * cosf(a), cy + size * sinf(a));
+        }
+        path->close();
+        path->setFillType(sk_scene_rand(&seed) < 0.5f ? SkPathFillType::kEvenOdd
+                                                      : SkPathFillType::kWinding);
+        break;
+    }
+    case 2:
+    case 3:
+        /* open cubic curve, stroked or hairline */
+        path->moveTo(cx - size, cy);
+        path->cubicTo(cx - size * sk_scene_rand(&seed), cy - size,
+                      cx + size * sk_scene_rand(&seed), cy + size, cx + size, cy);
+        path->cubicTo(cx + size, cy + size * sk_scene_rand(&seed), cx - size,
+                      cy - size * sk_scene_rand(&seed), cx - size * 0.5f, cy + size * 0.5f);
+        paint->setStyle(SkPaint::kStroke_Style);
+        if (kind == 2) {
+            paint->setStrokeWidth(1.0f + 7.0f * sk_scene_rand(&seed));
+            paint->setStrokeJoin(SkPaint::kRound_Join);
+            paint->setStrokeCap(SkPaint::kRound_Cap);
+        } else {
+            paint->setStrokeWidth(0.0f);
+        }
+        break;
+    }
+}
+
+static inline void
+sk_scene_init_path(struct sk *sk, struct sk_scene *scene)
+{
+    scene->path.count = 2000;
+    scene->path.paths.resize(scene->path.count);
+    scene->path.paints.resize(scene->path.count);
+
+    /* non-volatile paths are generated once and keep their generation ids */
+    if (scene->type == SK_SCENE_PATH) {
+        for (uint32_t i = 0; i < scene->path.count; i++)
+            sk_scene_make_path(scene, i, &scene->path.paths[i], &scene->path.paints[i]);
+    }
+}
+
+static inline void
+sk_scene_init_filter(struct sk *sk, struct sk_scene *scene)
+{
+    scene->filter.count = 12;
+    scene->filter.cards.resize(scene->filter.count);
+}
+
+static inline void
+sk_scene_init_sksl(struct sk *sk, struct sk_scene *scene)
+{
+    /* compiling sksl to the effect ir is the precompile step */
+    const uint64_t begin = sk_now_ns();
+    for (uint32_t i = 0; i < ARRAY_SIZE(sk_scene_sksl_effects); i++) {
+        SkRuntimeEffect::Result res =
+            SkRuntimeEffect::MakeForShader(SkString(sk_scene_sksl_effects[i]));
+        if (!res.effect)
+            sk_die("failed to compile effect %u: %s", i, res.errorText.c_str());
+        scene->sksl.effects.push_back(res.effect);
+    }
+
+    SkRuntimeEffect::Result res =
+        SkRuntimeEffect::MakeForColorFilter(SkString(sk_scene_sksl_grade));
+    if (!res.effect)
+        sk_die("failed to compile color filter: %s", res.errorText.c_str());
+    scene->sksl.grade = res.effect->makeColorFilter(SkData::MakeEmpty());
+    scene->sksl.compile_ns = sk_now_ns() - begin;
+
+    const SkPoint pts[2] = { { 0.0f, 0.0f }, { 64.0f, 64.0f } };
+    const SkColor colors[2] = { SK_ColorMAGENTA, SK_ColorCYAN };
+    scene->sksl.image = SkGradientShader::MakeLinear(pts, colors, NULL, ARRAY_SIZE(colors),
+                                                     SkTileMode::kMirror);
+}
+
+static inline void
+sk_scene_init(struct sk *sk,
+              struct sk_scene *scene,
+              enum sk_scene_type type,
+              uint32_t width,
+              uint32_t height)
+{
+    scene->type = type;
+    scene->width = width;
+    scene->height = height;
+
+    switch (type) {
+    case SK_SCENE_TEXT:
+    case SK_SCENE_TEXT_NOCACHE:
+        sk_scene_init_text(sk, scene);
+        break;
+    case SK_SCENE_PATH:
+    case SK_SCENE_PATH_VOLATILE:
+        sk_scene_init_path(sk, scene);
+        break;
+    case SK_SCENE_FILTER:
+    case SK_SCENE_FILTER_CACHED:
+        sk_scene_init_filter(sk, scene);
+        break;
+    case SK_SCENE_SKSL:
+        sk_scene_init_sksl(sk, scene);
+        break;
+    default:
+        break;
+    }
+}
+
+static inline void
+sk_scene_cleanup(struct sk *sk, struct sk_scene *scene)
+{
+    scene->text.blobs.clear();
+    scene->text.paragraphs.clear();
+    scene->text.typeface.reset();
+    scene->path.paths.clear();
+    scene->path.paints.clear();
+    scene->filter.cards.clear();
+    scene->sksl.effects.clear();
+    scene->sksl.grade.reset();
+    scene->sksl.image.reset();
+}
+
+/* wraps text at word boundaries into one run per line */
+static inline struct sk_text_blob
+sk_scene_layout_text(const std::string &text, const SkFont &font, float width)
+{
+    SkFontMetrics metrics;
+    const float line_height = font.getMetrics(&metrics);
+
+    SkTextBlobBuilder builder;
+    uint32_t glyph_count = 0;
+    float y = -metrics.fAscent;
+
+    size_t begin = 0;
+    while (begin < text.size()) {
+        size_t end = begin;
+        while (end < text.size()) {
+            size_t next = text.find(' ', end + 1);
+            if (next == std::string::npos)
+                next = text.size();
+
+            const float w = font.measureText(text.data() + begin, next - begin,
+                                             SkTextEncoding::kUTF8);
+            if (w > width && end > begin)
+                break;
+            end = next;
+        }
+
+        const int count =
+            font.countText(text.data() + begin, end - begin, SkTextEncoding::kUTF8);
+        const SkTextBlobBuilder::RunBuffer &run = builder.allocRun(font, count, 0, y);
+        font.textToGlyphs(text.data() + begin, end - begin, SkTextEncoding::kUTF8, run.glyphs,
+                          count);
+
+        glyph_count += count;
+        y += line_height;
+        begin = end + 1;
+    }
+
+    return { builder.make(), glyph_count };
+}
+
+static inline struct sk_text_blob
+sk_scene_get_text_blob(struct sk_scene *scene, const std::string &text, const SkFont &font)
+{
+    /* wrap within a 10-pixel margin on each side, but never at a negative width */
+    const float width = std::max((float)scene->width - 20.0f, 1.0f);
+    if (scene->type == SK_SCENE_TEXT_NOCACHE)
+        return sk_scene_layout_text(text, font, width);
+
+    char prefix[64];
+    snprintf(prefix, sizeof(prefix), "%u:%g:%g:", font.getTypeface()->uniqueID(),
+             font.getSize(), width);
+    const std::string key = prefix + text;
+
+    auto iter = scene->text.blobs.find(key);
+    if (iter != scene->text.blobs.end()) {
+        scene->text.hit_count++;
+        return iter->second;
+    }
+
+    scene->text.miss_count++;
+    const struct sk_text_blob blob = sk_scene_layout_text(text, font, width);
+    scene->text.blobs.emplace(key, blob);
+    return blob;
+}
+
+static inline void
+sk_scene_draw_text(struct sk *sk, struct sk_scene *scene, SkCanvas *canvas)
+{
+    static const float sizes[] = { 12.0f, 16.0f, 24.0f };
+
+    canvas->clear(SK_ColorWHITE);
+
+    SkPaint paint;
+    paint.setColor(SK_ColorBLACK);
+    paint.setAntiAlias(true);
+
+    float y = 10.0f;
+    for (uint32_t i = 0; i < scene->text.paragraphs.size() && y < scene->height; i++) {
+        SkFont font(scene->text.typeface, sizes[i % ARRAY_SIZE(sizes)]);
+        font.setEdging(SkFont::Edging::kAntiAlias);
+
+        const struct sk_text_blob blob =
+            sk_scene_get_text_blob(scene, scene->text.paragraphs[i], font);
+        if (!blob.blob)
+            continue;
+
+        canvas->drawTextBlob(blob.blob, 10.0f, y, paint);
+        scene->text.glyph_count += blob.glyph_count;
+        y += blob.blob->bounds().height() + 10.0f;
+    }
+}
+
+static inline void
+sk_scene_draw_circle(struct sk *sk, struct sk_scene *scene, SkCanvas *canvas)
+{
+    canvas->clear(SK_ColorWHITE);
+
+    SkPaint paint;
+    paint.setColor(SK_ColorRED);
+    paint.setAntiAlias(true);
+    canvas->drawCircle(scene->width / 2, scene->height / 2, 30, paint);
+}
+
+static inline void
+sk_scene_draw_path(struct sk *sk, struct sk_scene *scene, SkCanvas *canvas, uint32_t frame)
+{
+    canvas->clear(SK_ColorWHITE);
+
+    for (uint32_t i = 0; i < scene->path.count; i++) {
+        SkPath &path = scene->path.paths[i];
+        SkPaint &paint = scene->path.paints[i];
+
+        /* volatile paths change every frame and should not be cached by Skia */
+        if (scene->type == SK_SCENE_PATH_VOLATILE) {
+            sk_scene_make_path(scene, i + frame * scene->path.count, &path, &paint);
+            path.setIsVolatile(true);
+        }
+
+        canvas->drawPath(path, paint);
+    }
+
+    scene->path.path_count += scene->path.count;
+}
+
+/* the cards are laid out in a 4x3 grid */
+static inline SkRect
+sk_scene_get_filter_card_rect(struct sk_scene *scene, uint32_t card)
+{
+    const float cell_width = scene->width / 4.0f;
+    const float cell_height = scene->height / 3.0f;
+    const SkRect cell = SkRect::MakeXYWH(card % 4 * cell_width, card / 4 % 3 * cell_height,
+                                         cell_width, cell_height);
+    return cell.makeInset(cell_width * 0.15f, cell_height * 0.15f);
+}
+
+/* the card and its shadow */
+static inline SkIRect
+sk_scene_get_filter_card_bounds(struct sk_scene *scene, uint32_t card)
+{
+    const float sigma = sk_scene_filter_sigmas[card % ARRAY_SIZE(sk_scene_filter_sigmas)];
+    const SkRect rect = sk_scene_get_filter_card_rect(scene, card);
+    return rect.makeOutset(sigma * 3.0f, sigma * 3.5f).roundOut();
+}
+
+/* a card with a drop shadow, and a blurred and desaturated icon in a nested layer */
+static inline void
+sk_scene_draw_filter_card(struct sk_scene *scene,
+                          SkCanvas *canvas,
+                          uint32_t card,
+                          uint32_t generation)
+{
+    const float sigma = sk_scene_filter_sigmas[card % ARRAY_SIZE(sk_scene_filter_sigmas)];
+    const SkRect rect = sk_scene_get_filter_card_rect(scene, card);
+
+    SkPaint shadow;
+    shadow.setImageFilter(SkImageFilters::DropShadow(0.0f, sigma / 2.0f, sigma, sigma,
+                                                     SkColorSetARGB(0x80, 0, 0, 0), NULL));
+    canvas->saveLayer(&rect, &shadow);
+
+    SkPaint paint;
+    paint.setAntiAlias(true);
+    paint.setColor(SkColorSetRGB(0x40 + card * 16, 0x80, 0xff - card * 16));
+    canvas->drawRoundRect(rect, 12.0f, 12.0f, paint);
+
+    SkColorMatrix matrix;
+    matrix.setSaturation(0.2f);
+    SkPaint icon;
+    icon.setImageFilter(SkImageFilters::Blur(sigma / 4.0f, sigma / 4.0f, NULL));
+    icon.setColorFilter(SkColorFilters::Matrix(matrix));
+    canvas->saveLayer(&rect, &icon);
+
+    /* the icon moves when the generation changes */
+    const float t = 0.25f + 0.5f * (generation * 37 % 100) / 100.0f;
+    paint.setColor(SkColorSetRGB(0xff, 0xc0, 0x20));
+    canvas->drawCircle(rect.left() + rect.width() * t, rect.centerY(), rect.height() / 4.0f,
+                       paint);
+
+    canvas->restore();
+    canvas->restore();
+
+    scene->filter.layer_count += 2;
+}
+
+/* draws the cached filtered card, re-rendering it when its generation changed */
+static inline bool
+sk_scene_draw_filter_cached(struct sk_scene *scene,
+                            SkCanvas *canvas,
+                            uint32_t card,
+                            uint32_t generation)
+{
+    struct sk_filter_card *cached = &scene->filter.cards[card];
+    const SkIRect bounds = sk_scene_get_filter_card_bounds(scene, card);
+
+    if (!cached->img || cached->generation != generation) {
+        /* recording canvases cannot make surfaces and draw uncached */
+        sk_sp<SkSurface> surf =
+            canvas->makeSurface(canvas->imageInfo().makeDimensions(bounds.size()));
+        if (!surf)
+            return false;
+
+        SkCanvas *offscreen = surf->getCanvas();
+        offscreen->clear(SK_ColorTRANSPARENT);
+        offscreen->translate(-bounds.x(), -bounds.y());
+        sk_scene_draw_filter_card(scene, offscreen, card, generation);
+
+        cached->img = surf->makeImageSnapshot();
+        cached->generation = generation;
+        scene->filter.miss_count++;
+    } else {
+        scene->filter.hit_count++;
+    }
+
+    canvas->drawImage(cached->img, bounds.x(), bounds.y());
+    return true;
+}
+
+static inline void
+sk_scene_draw_filter(struct sk *sk, struct sk_scene *scene, SkCanvas *canvas, uint32_t frame)
+{
+    canvas->clear(SkColorSetRGB(0xee, 0xee, 0xf2));
+
+    for (uint32_t i = 0; i < scene->filter.count; i++) {
+        /* each card changes every 16 frames, staggered */
+        const uint32_t generation = (frame + i * 5) / 16;
+        if (scene->type == SK_SCENE_FILTER_CACHED &&
+            sk_scene_draw_filter_cached(scene, canvas, i, generation))
+            continue;
+
+        sk_scene_draw_filter_card(scene, canvas, i, generation);
+    }
+}
+
+static inline void
+sk_scene_draw_sksl_tile(struct sk_scene *scene,
+                        SkCanvas *canvas,
+                        uint32_t effect,
+                        const SkRect &rect,
+                        uint32_t frame)
+{
+    SkRuntimeShaderBuilder builder(scene->sksl.effects[effect]);
+    builder.uniform("u_size") = SkV2{ rect.width(), rect.height() };
+    builder.uniform("u_time") = frame / 60.0f;
+    if (builder.effect()->findChild("u_image"))
+        builder.child("u_image") = scene->sksl.image;
+
+    const SkMatrix local = SkMatrix::Translate(rect.left(), rect.top());
+    SkPaint paint;
+    paint.setShader(builder.makeShader(&local));
+    if (effect % 2)
+        paint.setColorFilter(scene->sksl.grade);
+    canvas->drawRect(rect, paint);
+
+    scene->sksl.pixel_count += (uint64_t)(rect.width() * rect.height());
+}
+
+/* one tile per effect in a 3x2 grid */
+static inline void
+sk_scene_draw_sksl(struct sk *sk, struct sk_scene *scene, SkCanvas *canvas, uint32_t frame)
+{
+    const float tile_width = scene->width / 3.0f;
+    const float tile_height = scene->height / 2.0f;
+    for (uint32_t i = 0; i < scene->sksl.effects.size(); i++) {
+        const SkRect rect =
+            SkRect::MakeXYWH(i % 3 * tile_width, i / 3 * tile_height, tile_width, tile_height);
+        sk_scene_draw_sksl_tile(scene, canvas, i, rect, frame);
+    }
+}
+
+static inline void
+sk_scene_draw(struct sk *sk, struct sk_scene *scene, SkCanvas *canvas, uint32_t frame)
+{
+    switch (scene->type) {
+    case SK_SCENE_CIRCLE:
+        sk_scene_draw_circle(sk, scene, canvas);
+        break;
+    case SK_SCENE_TEXT:
+    case SK_SCENE_TEXT_NOCACHE:
+        sk_scene_draw_text(sk, scene, canvas);
+        break;
+    case SK_SCENE_PATH:
+    case SK_SCENE_PATH_VOLATILE:
+        sk_scene_draw_path(sk, scene, canvas, frame);
+        break;
+    case SK_SCENE_FILTER:
+    case SK_SCENE_FILTER_CACHED:
+        sk_scene_draw_filter(sk, scene, canvas, frame);
+        break;
+    case SK_SCENE_SKSL:
+        sk_scene_draw_sksl(sk, scene, canvas, frame);
+        break;
+    }
+}
+
+/*
+ * Draws what the scene needs into a small offscreen surface, so that shader
+ * programs and gpu pipelines are built before the timed loop.
+ */
+static inline void
+sk_scene_warmup(struct sk *sk, struct sk_scene *scene, SkCanvas *canvas)
+{
+    if (scene->type != SK_SCENE_SKSL)
+        return;
+
+    sk_sp<SkSurface> surf = canvas->makeSurface(canvas->imageInfo().makeWH(64, 64));
+    if (!surf)
+        return;
+
+    const uint64_t pixel_count = scene->sksl.pixel_count;
+    for (uint32_t i = 0; i < scene->sksl.effects.size(); i++)
+        sk_scene_draw_sksl_tile(scene, surf->getCanvas(), i, SkRect::MakeWH(64, 64), 0);
+    scene->sksl.pixel_count = pixel_count;
+
+    /* ganesh builds pipelines when the ops execute */
+    GrRecordingContext *rctx = canvas->recordingContext();
+    GrDirectContext *ctx = rctx ? rctx->asDirectContext() : NULL;
+    if (ctx)
+        ctx->flushAndSubmit(surf.get(), GrSyncCpu::kYes);
+}
+
+/*
+ * renders a fresh scene of the same type and size on a raster surface and returns the
+ * steady-state ns/frame; the gpu scene and its caches are left alone
+ */
+static inline double
+sk_scene_time_raster(struct sk *sk, const struct sk_scene *scene, uint32_t frame_count)
+{
+    struct sk_scene raster = {};
+    sk_scene_init(sk, &raster, scene->type, scene->width, scene->height);
+    sk_sp<SkSurface> surf = sk_create_surface_raster(sk, scene->width, scene->height);
+    SkCanvas *canvas = surf->getCanvas();
+
+    /* the first frame builds the raster pipelines */
+    sk_scene_draw(sk, &raster, canvas, 0);
+
+    const uint64_t begin = sk_now_ns();
+    for (uint32_t i = 0; i < frame_count; i++)
+        sk_scene_draw(sk, &raster, canvas, i);
+    const uint64_t end = sk_now_ns();
+
+    surf.reset();
+    sk_scene_cleanup(sk, &raster);
+
+    return (double)(end - begin) / frame_count;
+}
+
+/* compares the first frame, which pays for shader compilation, to the rest */
+static inline void
+sk_scene_report_first_frame(struct sk *sk,
+                            struct sk_scene *scene,
+                            const char *backend,
+                            uint32_t frame_count,
+                            uint64_t first_ns,
+                            uint64_t elapsed_ns)
+{
+    if (frame_count < 2)
+        return;
+
+    const double steady_ns = (double)(elapsed_ns - first_ns) / (frame_count - 1);
+    sk_log("%s/%s: first frame %.3f ms, steady state %.3f ms/frame, %.1fx hitch", backend,
+           sk_scene_get_name(scene->type), first_ns / 1e6, steady_ns / 1e6,
+           first_ns / steady_ns);
+}
+
+/* the element covers about damage of the surface and moves a few pixels every frame */
+static inline SkIRect
+sk_scene_get_anim_rect(struct sk_scene *scene, float damage, uint32_t frame)
+{
+    const int width = std::max(1, (int)(scene->width * sqrtf(damage)));
+    const int height = std::max(1, (int)(scene->height * sqrtf(damage)));
+
+    /* bounce between the left and right edges */
+    const int range = scene->width - width;
+    int x = range ? (int)(frame * 4 % (2 * range)) : 0;
+    if (x > range)
+        x = 2 * range - x;
+
+    return SkIRect::MakeXYWH(x, (scene->height - height) / 2, width, height);
+}
+
+static inline void
+sk_scene_reset_anim(struct sk_scene *scene)
+{
+    scene->anim.prev = SkIRect::MakeEmpty();
+    scene->anim.damaged_pixels = 0;
+}
+
+/*
+ * Draws a frame of the sequence: the static scene with an element animated
+ * over it.  With partial set, the canvas must retain the previous frame and
+ * only the union of the old and new element bounds is redrawn.
+ */
+static inline void
+sk_scene_draw_anim(struct sk *sk,
+                   struct sk_scene *scene,
+                   SkCanvas *canvas,
+                   uint32_t frame,
+                   float damage,
+                   bool partial)
+{
+    const SkIRect rect = sk_scene_get_anim_rect(scene, damage, frame);
+
+    SkIRect dirty = SkIRect::MakeWH(scene->width, scene->height);
+    if (partial && !scene->anim.prev.isEmpty()) {
+        dirty = rect;
+        dirty.join(scene->anim.prev);
+    }
+    scene->anim.prev = rect;
+    scene->anim.damaged_pixels += (uint64_t)dirty.width() * dirty.height();
+
+    canvas->save();
+    canvas->clipIRect(dirty);
+
+    sk_scene_draw(sk, scene, canvas, 0);
+
+    SkPaint paint;
+    paint.setColor(SkColorSetARGB(0xff, frame * 7 & 0xff, 0x80, (0xff - frame * 3) & 0xff));
+    paint.setAntiAlias(true);
+    canvas->drawRoundRect(SkRect::Make(rect), 8.0f, 8.0f, paint);
+
+    canvas->restore();
+}
+
+/*
+ * compares a partially redrawn sequence against redrawing every frame in full, in time and in
+ * the pixels of the final frames
+ */
+static inline void
+sk_scene_report_anim(struct sk *sk,
+                     struct sk_scene *scene,
+                     const char *backend,
+                     float damage,
+                     uint32_t frame_count,
+                     uint64_t full_ns,
+                     uint64_t partial_ns,
+                     const SkPixmap &full,
+                     const SkPixmap &partial)
+{
+    const double redrawn =
+        (double)scene->anim.damaged_pixels / frame_count / scene->width / scene->height;
+    const struct sk_compare_params params = {};
+    const struct sk_compare_result res = sk_compare_pixmaps(sk, full, partial, &params, NULL);
+    sk_log("%s/%s: %2.0f%% damage: full %.3f ms/frame, partial %.3f ms/frame "
+           "(%.1f%% redrawn), %.2fx, %" PRIu64 " pixels differ from full",
+           backend, sk_scene_get_name(scene->type), damage * 100.0f,
+           full_ns / 1e6 / frame_count, partial_ns / 1e6 / frame_count, redrawn * 100.0,
+           (double)full_ns / partial_ns, res.diff_count);
+}
+
+static inline void
+sk_scene_report(struct sk *sk,
+                struct sk_scene *scene,
+                const char *backend,
+                uint32_t frame_count,
+                uint64_t elapsed_ns)
+{
+    const double sec = (double)elapsed_ns / 1e9;
+    sk_log("%s/%s: %u frames, %.3f ms/frame", backend, sk_scene_get_name(scene->type),
+           frame_count, sec * 1e3 / frame_count);
+
+    switch (scene->type) {
+    case SK_SCENE_TEXT:
+    case SK_SCENE_TEXT_NOCACHE:
+        sk_log("%s/%s: %.0f glyphs/s, blob cache %" PRIu64 "/%" PRIu64 " hits", backend,
+               sk_scene_get_name(scene->type), scene->text.glyph_count / sec,
+               scene->text.hit_count, scene->text.hit_count + scene->text.miss_count);
+        sk_log("font cache: %zu/%zu bytes, %d strikes", SkGraphics::GetFontCacheUsed(),
+               SkGraphics::GetFontCacheLimit(), SkGraphics::GetFontCacheCountUsed());
+        break;
+    case SK_SCENE_PATH:
+    case SK_SCENE_PATH_VOLATILE:
+        sk_log("%s/%s: %.0f paths/s", backend, sk_scene_get_name(scene->type),
+               scene->path.path_count / sec);
+        break;
+    case SK_SCENE_FILTER:
+    case SK_SCENE_FILTER_CACHED:
+        sk_log("%s/%s: %.1f layers/frame, filter cache %" PRIu64 "/%" PRIu64 " hits", backend,
+               sk_scene_get_name(scene->type), (double)scene->filter.layer_count / frame_count,
+               scene->filter.hit_count, scene->filter.hit_count + scene->filter.miss_count);
+        break;
+    case SK_SCENE_SKSL:
+        sk_log("%s/%s: %zu effects compiled in %.3f ms, %.1f Mpixels/s", backend,
+               sk_scene_get_name(scene->type), scene->sksl.effects.size() + 1,
+               scene->sksl.compile_ns / 1e6, scene->sksl.pixel_count / sec / 1e6);
+        break;
+    default:
+        break;
+    }
+}
+
+#endif /* SKUTIL_SCENE_H */
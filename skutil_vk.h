@@ -6,11 +6,15 @@
 #ifndef SKUTIL_VK_H
 #define SKUTIL_VK_H
 
+#include "include/gpu/MutableTextureState.h"
+#include "include/gpu/ganesh/vk/GrVkBackendSurface.h"
 #include "include/gpu/vk/GrVkBackendContext.h"
+#include "include/gpu/vk/GrVkTypes.h"
 #include "include/gpu/vk/VulkanExtensions.h"
 #include "skutil.h"
 
 #include <dlfcn.h>
+#include <mutex>
 #include <vulkan/vulkan.h>
 
 struct sk_vk {
@@ -25,6 +29,8 @@ struct sk_vk {
     PFN_vkEnumeratePhysicalDevices EnumeratePhysicalDevices;
     PFN_vkGetPhysicalDeviceFeatures2 GetPhysicalDeviceFeatures2;
     PFN_vkGetPhysicalDeviceQueueFamilyProperties2 GetPhysicalDeviceQueueFamilyProperties2;
+    PFN_vkGetPhysicalDeviceMemoryProperties GetPhysicalDeviceMemoryProperties;
+    PFN_vkEnumerateDeviceExtensionProperties EnumerateDeviceExtensionProperties;
     PFN_vkCreateDevice CreateDevice;
 
     VkPhysicalDevice physical_dev;
@@ -37,16 +43,100 @@ struct sk_vk {
     PFN_vkGetDeviceProcAddr GetDeviceProcAddr;
     PFN_vkDestroyDevice DestroyDevice;
     PFN_vkGetDeviceQueue GetDeviceQueue;
+    PFN_vkCreateImage CreateImage;
+    PFN_vkDestroyImage DestroyImage;
+    PFN_vkGetImageMemoryRequirements GetImageMemoryRequirements;
+    PFN_vkAllocateMemory AllocateMemory;
+    PFN_vkFreeMemory FreeMemory;
+    PFN_vkBindImageMemory BindImageMemory;
+    PFN_vkGetMemoryFdKHR GetMemoryFdKHR;
+    PFN_vkCreateSemaphore CreateSemaphore;
+    PFN_vkGetSemaphoreFdKHR GetSemaphoreFdKHR;
+    PFN_vkImportSemaphoreFdKHR ImportSemaphoreFdKHR;
+    PFN_vkDestroySemaphore DestroySemaphore;
+    PFN_vkWaitSemaphores WaitSemaphores;
+    PFN_vkQueueSubmit QueueSubmit;
 
     VkQueue queue;
     uint32_t queue_family_index;
 
+    /* VK_KHR_external_memory_fd and VK_EXT_external_memory_dma_buf */
+    bool external_memory_fd;
+    bool external_memory_dma_buf;
+    /* VK_KHR_external_semaphore_fd */
+    bool external_semaphore_fd;
+
     skgpu::VulkanExtensions exts;
     skgpu::VulkanGetProc get_proc;
+
+    /* wrap the procs of SK_VK_TRACE_PROCS for skia; set by SK_VK_TRACE */
+    bool trace;
+};
+
+/* the procs skia gets through sk_vk_make_backend_context that are counted and timed */
+#define SK_VK_TRACE_PROCS(X)                                                                 \
+    X(ALLOCATE_MEMORY, AllocateMemory)                                                       \
+    X(FREE_MEMORY, FreeMemory)                                                               \
+    X(CREATE_IMAGE, CreateImage)                                                             \
+    X(CREATE_BUFFER, CreateBuffer)                                                           \
+    X(CREATE_GRAPHICS_PIPELINES, CreateGraphicsPipelines)                                    \
+    X(CREATE_COMPUTE_PIPELINES, CreateComputePipelines)                                      \
+    X(ALLOCATE_DESCRIPTOR_SETS, AllocateDescriptorSets)                                      \
+    X(CMD_PIPELINE_BARRIER, CmdPipelineBarrier)                                              \
+    X(QUEUE_SUBMIT, QueueSubmit)                                                             \
+    X(WAIT_FOR_FENCES, WaitForFences)
+
+enum sk_vk_trace_proc {
+#define X(e, name) SK_VK_TRACE_##e,
+    SK_VK_TRACE_PROCS(X)
+#undef X
+    SK_VK_TRACE_COUNT,
+};
+
+static const char *const sk_vk_trace_names[SK_VK_TRACE_COUNT] = {
+#define X(e, name) "vk" #name,
+    SK_VK_TRACE_PROCS(X)
+#undef X
+};
+
+struct sk_vk_trace_stats {
+    uint64_t count[SK_VK_TRACE_COUNT];
+    uint64_t ns[SK_VK_TRACE_COUNT];
+};
+
+/* accumulates per-frame deltas of the trace counters */
+struct sk_vk_trace_frames {
+    struct sk_vk_trace_stats prev;
+    struct sk_vk_trace_stats first;
+    struct sk_vk_trace_stats steady;
+    uint32_t frame_count;
+    /* steady frames with at least one call */
+    uint32_t active_frames[SK_VK_TRACE_COUNT];
+};
+
+/* the wrappers are plain function pointers and have no other place for state */
+static struct {
+    bool enabled;
+    PFN_vkVoidFunction procs[SK_VK_TRACE_COUNT];
+    std::atomic<uint64_t> count[SK_VK_TRACE_COUNT];
+    std::atomic<uint64_t> ns[SK_VK_TRACE_COUNT];
+} sk_vk_trace;
+
+/* an image whose memory can be exported to or imported from another process */
+struct sk_vk_image {
+    uint32_t width;
+    uint32_t height;
+    VkFormat format;
+    VkImageUsageFlags usage;
+
+    VkImage image;
+    VkDeviceMemory mem;
+    VkDeviceSize size;
+    uint32_t mem_type;
 };
 
 static inline void
-sk_vk_init_library(struct sk_vk *vk)
+sk_vk_load_library(struct sk_vk *vk)
 {
     const char libvulkan_name[] = "libvulkan.so.1";
     vk->handle = dlopen(libvulkan_name, RTLD_LOCAL | RTLD_LAZY);
@@ -64,6 +154,20 @@ sk_vk_init_library(struct sk_vk *vk)
 #undef GPA
 }
 
+static inline void
+sk_vk_init_library(struct sk_vk *vk)
+{
+    /* load once and keep the library and the global procs for the process lifetime */
+    static struct sk_vk lib;
+    static std::once_flag once;
+    std::call_once(once, [] { sk_vk_load_library(&lib); });
+
+    vk->handle = lib.handle;
+    vk->GetInstanceProcAddr = lib.GetInstanceProcAddr;
+    vk->EnumerateInstanceVersion = lib.EnumerateInstanceVersion;
+    vk->CreateInstance = lib.CreateInstance;
+}
+
 static inline void
 sk_vk_init_instance(struct sk_vk *vk)
 {
@@ -87,6 +191,8 @@ sk_vk_init_instance(struct sk_vk *vk)
     GPA(EnumeratePhysicalDevices);
     GPA(GetPhysicalDeviceFeatures2);
     GPA(GetPhysicalDeviceQueueFamilyProperties2);
+    GPA(GetPhysicalDeviceMemoryProperties);
+    GPA(EnumerateDeviceExtensionProperties);
     GPA(CreateDevice);
 #undef GPA
 }
@@ -120,6 +226,31 @@ sk_vk_init_device(struct sk_vk *vk)
     if (!(queue_props.queueFamilyProperties.queueFlags & VK_QUEUE_GRAPHICS_BIT))
         sk_die("queue family 0 does not support graphics");
 
+    /* enable external memory and semaphores when supported; it costs nothing otherwise */
+    uint32_t ext_count;
+    vk->EnumerateDeviceExtensionProperties(vk->physical_dev, NULL, &ext_count, NULL);
+    std::vector<VkExtensionProperties> ext_props(ext_count);
+    vk->EnumerateDeviceExtensionProperties(vk->physical_dev, NULL, &ext_count, ext_props.data());
+
+    std::vector<const char *> exts;
+    for (const VkExtensionProperties &props : ext_props) {
+        if (!strcmp(props.extensionName, VK_KHR_EXTERNAL_MEMORY_FD_EXTENSION_NAME))
+            vk->external_memory_fd = true;
+        else if (!strcmp(props.extensionName, VK_EXT_EXTERNAL_MEMORY_DMA_BUF_EXTENSION_NAME))
+            vk->external_memory_dma_buf = true;
+        else if (!strcmp(props.extensionName, VK_KHR_EXTERNAL_SEMAPHORE_FD_EXTENSION_NAME))
+            vk->external_semaphore_fd = true;
+    }
+    if (vk->external_memory_fd) {
+        exts.push_back(VK_KHR_EXTERNAL_MEMORY_FD_EXTENSION_NAME);
+        if (vk->external_memory_dma_buf)
+            exts.push_back(VK_EXT_EXTERNAL_MEMORY_DMA_BUF_EXTENSION_NAME);
+    } else {
+        vk->external_memory_dma_buf = false;
+    }
+    if (vk->external_semaphore_fd)
+        exts.push_back(VK_KHR_EXTERNAL_SEMAPHORE_FD_EXTENSION_NAME);
+
     const float queue_priority = 1.0f;
     const VkDeviceQueueCreateInfo queue_info = {
         .sType = VK_STRUCTURE_TYPE_DEVICE_QUEUE_CREATE_INFO,
@@ -131,6 +262,8 @@ sk_vk_init_device(struct sk_vk *vk)
         .pNext = &vk->features,
         .queueCreateInfoCount = 1,
         .pQueueCreateInfos = &queue_info,
+        .enabledExtensionCount = (uint32_t)exts.size(),
+        .ppEnabledExtensionNames = exts.data(),
     };
     VkResult result = vk->CreateDevice(vk->physical_dev, &dev_info, NULL, &vk->dev);
     if (result != VK_SUCCESS)
@@ -142,6 +275,22 @@ sk_vk_init_device(struct sk_vk *vk)
 #define GPA(name) vk->name = (PFN_vk##name)vk->GetDeviceProcAddr(vk->dev, "vk" #name)
     GPA(DestroyDevice);
     GPA(GetDeviceQueue);
+    GPA(CreateImage);
+    GPA(DestroyImage);
+    GPA(GetImageMemoryRequirements);
+    GPA(AllocateMemory);
+    GPA(FreeMemory);
+    GPA(BindImageMemory);
+    if (vk->external_memory_fd)
+        GPA(GetMemoryFdKHR);
+    GPA(CreateSemaphore);
+    if (vk->external_semaphore_fd) {
+        GPA(GetSemaphoreFdKHR);
+        GPA(ImportSemaphoreFdKHR);
+    }
+    GPA(DestroySemaphore);
+    GPA(WaitSemaphores);
+    GPA(QueueSubmit);
 #undef GPA
 
     vk->queue_family_index = 0;
@@ -151,6 +300,9 @@ sk_vk_init_device(struct sk_vk *vk)
         return device ? vk->GetDeviceProcAddr(device, proc_name)
                       : vk->GetInstanceProcAddr(instance, proc_name);
     };
+
+    vk->exts.init(vk->get_proc, vk->instance, vk->physical_dev, 0, NULL, exts.size(),
+                  exts.data());
 }
 
 static inline void
@@ -158,6 +310,10 @@ sk_vk_init(struct sk_vk *vk)
 {
     *vk = {};
 
+    const char *trace = getenv("SK_VK_TRACE");
+    if (trace)
+        vk->trace = atoi(trace);
+
     sk_vk_init_library(vk);
     sk_vk_init_instance(vk);
     sk_vk_init_physical_device(vk);
@@ -170,7 +326,111 @@ sk_vk_cleanup(struct sk_vk *vk)
     vk->DestroyDevice(vk->dev, NULL);
     vk->DestroyInstance(vk->instance, NULL);
 
-    dlclose(vk->handle);
+    /* vk->handle is owned by sk_vk_init_library */
+}
+
+template <enum sk_vk_trace_proc P, typename Ret, typename... Args>
+static VKAPI_ATTR Ret VKAPI_CALL
+sk_vk_trace_call(Args... args)
+{
+    /* records on return, which also covers void procs */
+    struct sk_vk_trace_scope {
+        uint64_t begin;
+        ~sk_vk_trace_scope()
+        {
+            sk_vk_trace.count[P].fetch_add(1, std::memory_order_relaxed);
+            sk_vk_trace.ns[P].fetch_add(sk_now_ns() - begin, std::memory_order_relaxed);
+        }
+    } scope = { sk_now_ns() };
+
+    return ((Ret(VKAPI_PTR *)(Args...))sk_vk_trace.procs[P])(args...);
+}
+
+template <enum sk_vk_trace_proc P, typename Ret, typename... Args>
+static inline PFN_vkVoidFunction
+sk_vk_trace_wrap(Ret(VKAPI_PTR *)(Args...))
+{
+    return (PFN_vkVoidFunction)sk_vk_trace_call<P, Ret, Args...>;
+}
+
+/* returns the wrapper of proc_name and remembers proc, or returns proc */
+static inline PFN_vkVoidFunction
+sk_vk_trace_get_proc(const char *proc_name, PFN_vkVoidFunction proc)
+{
+    if (!proc)
+        return proc;
+
+#define X(e, name)                                                                           \
+    if (!strcmp(proc_name, "vk" #name)) {                                                    \
+        sk_vk_trace.procs[SK_VK_TRACE_##e] = proc;                                           \
+        return sk_vk_trace_wrap<SK_VK_TRACE_##e>((PFN_vk##name)NULL);                        \
+    }
+    SK_VK_TRACE_PROCS(X)
+#undef X
+
+    return proc;
+}
+
+static inline void
+sk_vk_trace_snapshot(struct sk_vk_trace_stats *stats)
+{
+    for (int i = 0; i < SK_VK_TRACE_COUNT; i++) {
+        stats->count[i] = sk_vk_trace.count[i].load(std::memory_order_relaxed);
+        stats->ns[i] = sk_vk_trace.ns[i].load(std::memory_order_relaxed);
+    }
+}
+
+static inline void
+sk_vk_trace_frames_init(struct sk_vk_trace_frames *frames)
+{
+    *frames = {};
+    sk_vk_trace_snapshot(&frames->prev);
+}
+
+/* called at the end of every frame; the first frame is kept apart */
+static inline void
+sk_vk_trace_frames_add(struct sk_vk_trace_frames *frames)
+{
+    if (!sk_vk_trace.enabled)
+        return;
+
+    struct sk_vk_trace_stats cur;
+    sk_vk_trace_snapshot(&cur);
+
+    struct sk_vk_trace_stats *dst = frames->frame_count ? &frames->steady : &frames->first;
+    for (int i = 0; i < SK_VK_TRACE_COUNT; i++) {
+        const uint64_t count = cur.count[i] - frames->prev.count[i];
+        dst->count[i] += count;
+        dst->ns[i] += cur.ns[i] - frames->prev.ns[i];
+        if (frames->frame_count && count)
+            frames->active_frames[i]++;
+    }
+
+    frames->prev = cur;
+    frames->frame_count++;
+}
+
+static inline void
+sk_vk_trace_frames_report(struct sk *sk,
+                          const char *name,
+                          const struct sk_vk_trace_frames *frames)
+{
+    if (!sk_vk_trace.enabled || !frames->frame_count)
+        return;
+
+    const uint32_t steady_count = frames->frame_count - 1;
+    sk_log("%s: vulkan calls, first frame and per steady frame over %u frames:", name,
+           steady_count);
+    for (int i = 0; i < SK_VK_TRACE_COUNT; i++) {
+        if (!frames->first.count[i] && !frames->steady.count[i])
+            continue;
+
+        const double per_frame = steady_count ? 1.0 / steady_count : 0.0;
+        sk_log("  %-26s %6" PRIu64 " calls %9.3f ms | %8.2f calls %9.3f ms/frame, in %u frames",
+               sk_vk_trace_names[i], frames->first.count[i], frames->first.ns[i] / 1e6,
+               frames->steady.count[i] * per_frame, frames->steady.ns[i] / 1e6 * per_frame,
+               frames->active_frames[i]);
+    }
 }
 
 static inline GrVkBackendContext
@@ -187,7 +447,283 @@ sk_vk_make_backend_context(struct sk_vk *vk)
     ctx.fDeviceFeatures2 = &vk->features;
     ctx.fGetProc = vk->get_proc;
 
+    if (vk->trace) {
+        sk_vk_trace.enabled = true;
+        ctx.fGetProc = [vk](const char *proc_name, VkInstance instance, VkDevice device) {
+            return sk_vk_trace_get_proc(proc_name, vk->get_proc(proc_name, instance, device));
+        };
+    }
+
     return ctx;
 }
 
+static inline uint32_t
+sk_vk_find_memory_type(struct sk_vk *vk, uint32_t type_bits)
+{
+    VkPhysicalDeviceMemoryProperties props;
+    vk->GetPhysicalDeviceMemoryProperties(vk->physical_dev, &props);
+
+    for (uint32_t i = 0; i < props.memoryTypeCount; i++) {
+        if ((type_bits & (1u << i)) &&
+            (props.memoryTypes[i].propertyFlags & VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT))
+            return i;
+    }
+    for (uint32_t i = 0; i < props.memoryTypeCount; i++) {
+        if (type_bits & (1u << i))
+            return i;
+    }
+
+    sk_die("no compatible memory type");
+}
+
+/*
+ * Creates a color image backed by opaque-fd memory.  When import_fd is -1, the
+ * memory is allocated for export.  Otherwise, import_fd is imported and owned
+ * by the image, and img->size and img->mem_type must match the exporter's.
+ */
+static inline void
+sk_vk_create_external_image(struct sk_vk *vk, int import_fd, struct sk_vk_image *img)
+{
+    if (!vk->external_memory_fd)
+        sk_die("no VK_KHR_external_memory_fd support");
+
+    const VkExternalMemoryHandleTypeFlagBits handle_type =
+        VK_EXTERNAL_MEMORY_HANDLE_TYPE_OPAQUE_FD_BIT;
+
+    const VkExternalMemoryImageCreateInfo external_info = {
+        .sType = VK_STRUCTURE_TYPE_EXTERNAL_MEMORY_IMAGE_CREATE_INFO,
+        .handleTypes = (VkExternalMemoryHandleTypeFlags)handle_type,
+    };
+    const VkImageCreateInfo img_info = {
+        .sType = VK_STRUCTURE_TYPE_IMAGE_CREATE_INFO,
+        .pNext = &external_info,
+        .imageType = VK_IMAGE_TYPE_2D,
+        .format = img->format,
+        .extent = { img->width, img->height, 1 },
+        .mipLevels = 1,
+        .arrayLayers = 1,
+        .samples = VK_SAMPLE_COUNT_1_BIT,
+        .tiling = VK_IMAGE_TILING_OPTIMAL,
+        .usage = img->usage,
+        .sharingMode = VK_SHARING_MODE_EXCLUSIVE,
+        .initialLayout = VK_IMAGE_LAYOUT_UNDEFINED,
+    };
+    if (vk->CreateImage(vk->dev, &img_info, NULL, &img->image) != VK_SUCCESS)
+        sk_die("failed to create image");
+
+    VkMemoryRequirements reqs;
+    vk->GetImageMemoryRequirements(vk->dev, img->image, &reqs);
+
+    const VkMemoryDedicatedAllocateInfo dedicated_info = {
+        .sType = VK_STRUCTURE_TYPE_MEMORY_DEDICATED_ALLOCATE_INFO,
+        .image = img->image,
+    };
+    const VkExportMemoryAllocateInfo export_info = {
+        .sType = VK_STRUCTURE_TYPE_EXPORT_MEMORY_ALLOCATE_INFO,
+        .pNext = &dedicated_info,
+        .handleTypes = (VkExternalMemoryHandleTypeFlags)handle_type,
+    };
+    const VkImportMemoryFdInfoKHR import_info = {
+        .sType = VK_STRUCTURE_TYPE_IMPORT_MEMORY_FD_INFO_KHR,
+        .pNext = &dedicated_info,
+        .handleType = handle_type,
+        .fd = import_fd,
+    };
+
+    if (import_fd < 0) {
+        img->size = reqs.size;
+        img->mem_type = sk_vk_find_memory_type(vk, reqs.memoryTypeBits);
+    } else if (img->size < reqs.size || !(reqs.memoryTypeBits & (1u << img->mem_type))) {
+        sk_die("imported memory is incompatible with the image");
+    }
+
+    const VkMemoryAllocateInfo alloc_info = {
+        .sType = VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO,
+        .pNext = import_fd < 0 ? (const void *)&export_info : (const void *)&import_info,
+        .allocationSize = img->size,
+        .memoryTypeIndex = img->mem_type,
+    };
+    if (vk->AllocateMemory(vk->dev, &alloc_info, NULL, &img->mem) != VK_SUCCESS)
+        sk_die("failed to allocate memory");
+
+    if (vk->BindImageMemory(vk->dev, img->image, img->mem, 0) != VK_SUCCESS)
+        sk_die("failed to bind memory");
+}
+
+static inline void
+sk_vk_destroy_external_image(struct sk_vk *vk, struct sk_vk_image *img)
+{
+    vk->DestroyImage(vk->dev, img->image, NULL);
+    vk->FreeMemory(vk->dev, img->mem, NULL);
+}
+
+/* returns a new fd referencing the image memory; the caller owns it */
+static inline int
+sk_vk_export_image_fd(struct sk_vk *vk, const struct sk_vk_image *img)
+{
+    const VkMemoryGetFdInfoKHR fd_info = {
+        .sType = VK_STRUCTURE_TYPE_MEMORY_GET_FD_INFO_KHR,
+        .memory = img->mem,
+        .handleType = VK_EXTERNAL_MEMORY_HANDLE_TYPE_OPAQUE_FD_BIT,
+    };
+
+    int fd;
+    if (vk->GetMemoryFdKHR(vk->dev, &fd_info, &fd) != VK_SUCCESS)
+        sk_die("failed to export memory");
+    return fd;
+}
+
+static inline GrBackendTexture
+sk_vk_make_backend_texture(struct sk_vk *vk,
+                           const struct sk_vk_image *img,
+                           VkImageLayout layout,
+                           uint32_t queue_family_index)
+{
+    GrVkImageInfo info;
+    info.fImage = img->image;
+    info.fAlloc.fMemory = img->mem;
+    info.fAlloc.fOffset = 0;
+    info.fAlloc.fSize = img->size;
+    info.fImageTiling = VK_IMAGE_TILING_OPTIMAL;
+    info.fImageLayout = layout;
+    info.fFormat = img->format;
+    info.fImageUsageFlags = img->usage;
+    info.fSampleCount = 1;
+    info.fLevelCount = 1;
+    info.fCurrentQueueFamily = queue_family_index;
+
+    return GrBackendTextures::MakeVk(img->width, img->height, info);
+}
+
+static inline VkSemaphore
+sk_vk_create_semaphore(struct sk_vk *vk, bool timeline)
+{
+    if (timeline && !vk->vulkan_12_features.timelineSemaphore)
+        sk_die("timeline semaphores are not supported");
+
+    const VkSemaphoreTypeCreateInfo type_info = {
+        .sType = VK_STRUCTURE_TYPE_SEMAPHORE_TYPE_CREATE_INFO,
+        .semaphoreType = timeline ? VK_SEMAPHORE_TYPE_TIMELINE : VK_SEMAPHORE_TYPE_BINARY,
+        .initialValue = 0,
+    };
+    const VkSemaphoreCreateInfo sem_info = {
+        .sType = VK_STRUCTURE_TYPE_SEMAPHORE_CREATE_INFO,
+        .pNext = &type_info,
+    };
+
+    VkSemaphore sem;
+    if (vk->CreateSemaphore(vk->dev, &sem_info, NULL, &sem) != VK_SUCCESS)
+        sk_die("failed to create semaphore");
+    return sem;
+}
+
+static inline void
+sk_vk_destroy_semaphore(struct sk_vk *vk, VkSemaphore sem)
+{
+    vk->DestroySemaphore(vk->dev, sem, NULL);
+}
+
+/* creates a binary semaphore whose pending signal can be exported as a sync fd */
+static inline VkSemaphore
+sk_vk_create_external_semaphore(struct sk_vk *vk)
+{
+    if (!vk->external_semaphore_fd)
+        sk_die("no VK_KHR_external_semaphore_fd support");
+
+    const VkExportSemaphoreCreateInfo export_info = {
+        .sType = VK_STRUCTURE_TYPE_EXPORT_SEMAPHORE_CREATE_INFO,
+        .handleTypes = VK_EXTERNAL_SEMAPHORE_HANDLE_TYPE_SYNC_FD_BIT,
+    };
+    const VkSemaphoreCreateInfo sem_info = {
+        .sType = VK_STRUCTURE_TYPE_SEMAPHORE_CREATE_INFO,
+        .pNext = &export_info,
+    };
+
+    VkSemaphore sem;
+    if (vk->CreateSemaphore(vk->dev, &sem_info, NULL, &sem) != VK_SUCCESS)
+        sk_die("failed to create external semaphore");
+    return sem;
+}
+
+/*
+ * Returns a sync fd for the pending signal of sem and unsignals sem, so it can
+ * be signalled again.  The fd is -1 when the signal has already completed.
+ */
+static inline int
+sk_vk_export_semaphore_fd(struct sk_vk *vk, VkSemaphore sem)
+{
+    const VkSemaphoreGetFdInfoKHR fd_info = {
+        .sType = VK_STRUCTURE_TYPE_SEMAPHORE_GET_FD_INFO_KHR,
+        .semaphore = sem,
+        .handleType = VK_EXTERNAL_SEMAPHORE_HANDLE_TYPE_SYNC_FD_BIT,
+    };
+
+    int fd;
+    if (vk->GetSemaphoreFdKHR(vk->dev, &fd_info, &fd) != VK_SUCCESS)
+        sk_die("failed to export semaphore");
+    return fd;
+}
+
+/* the next wait on sem waits for the sync fd, which is consumed */
+static inline void
+sk_vk_import_semaphore_fd(struct sk_vk *vk, VkSemaphore sem, int fd)
+{
+    if (!vk->external_semaphore_fd)
+        sk_die("no VK_KHR_external_semaphore_fd support");
+
+    const VkImportSemaphoreFdInfoKHR fd_info = {
+        .sType = VK_STRUCTURE_TYPE_IMPORT_SEMAPHORE_FD_INFO_KHR,
+        .semaphore = sem,
+        .flags = VK_SEMAPHORE_IMPORT_TEMPORARY_BIT,
+        .handleType = VK_EXTERNAL_SEMAPHORE_HANDLE_TYPE_SYNC_FD_BIT,
+        .fd = fd,
+    };
+    if (vk->ImportSemaphoreFdKHR(vk->dev, &fd_info) != VK_SUCCESS)
+        sk_die("failed to import semaphore");
+}
+
+/*
+ * Ganesh can only signal binary semaphores.  This submits an empty batch that
+ * waits for the binary semaphore and advances the timeline semaphore to value.
+ */
+static inline void
+sk_vk_signal_timeline(struct sk_vk *vk, VkSemaphore binary, VkSemaphore timeline, uint64_t value)
+{
+    const uint64_t wait_value = 0;
+    const VkTimelineSemaphoreSubmitInfo timeline_info = {
+        .sType = VK_STRUCTURE_TYPE_TIMELINE_SEMAPHORE_SUBMIT_INFO,
+        .waitSemaphoreValueCount = 1,
+        .pWaitSemaphoreValues = &wait_value,
+        .signalSemaphoreValueCount = 1,
+        .pSignalSemaphoreValues = &value,
+    };
+    const VkPipelineStageFlags wait_stage = VK_PIPELINE_STAGE_ALL_COMMANDS_BIT;
+    const VkSubmitInfo submit_info = {
+        .sType = VK_STRUCTURE_TYPE_SUBMIT_INFO,
+        .pNext = &timeline_info,
+        .waitSemaphoreCount = 1,
+        .pWaitSemaphores = &binary,
+        .pWaitDstStageMask = &wait_stage,
+        .signalSemaphoreCount = 1,
+        .pSignalSemaphores = &timeline,
+    };
+
+    if (vk->QueueSubmit(vk->queue, 1, &submit_info, VK_NULL_HANDLE) != VK_SUCCESS)
+        sk_die("failed to submit timeline signal");
+}
+
+static inline void
+sk_vk_wait_timeline(struct sk_vk *vk, VkSemaphore timeline, uint64_t value)
+{
+    const VkSemaphoreWaitInfo wait_info = {
+        .sType = VK_STRUCTURE_TYPE_SEMAPHORE_WAIT_INFO,
+        .semaphoreCount = 1,
+        .pSemaphores = &timeline,
+        .pValues = &value,
+    };
+
+    if (vk->WaitSemaphores(vk->dev, &wait_info, UINT64_MAX) != VK_SUCCESS)
+        sk_die("failed to wait for timeline semaphore");
+}
+
 #endif /* SKUTIL_VK_H */
@@ -0,0 +1,185 @@
+/*
+ * Copyright 2023 Google LLC
+ * SPDX-License-Identifier: MIT
+ */
+
+#include "skutil.h"
+#include "skutil_scene.h"
+#include "skutil_vk.h"
+
+struct soak_ganesh_vk_test {
+    uint32_t width;
+    uint32_t height;
+    enum sk_scene_type scene_type;
+    uint32_t frame_count;
+    uint32_t dump_interval;
+    size_t resource_cache_limit;
+    enum sk_purge_policy purge_policy;
+    uint32_t purge_idle_ms;
+
+    struct sk sk;
+    struct sk_vk vk;
+    sk_sp<GrDirectContext> ctx;
+    sk_sp<SkSurface> surf;
+    struct sk_scene scene;
+
+    FILE *csv;
+};
+
+static void
+soak_ganesh_vk_test_init(struct soak_ganesh_vk_test *test)
+{
+    struct sk *sk = &test->sk;
+    struct sk_vk *vk = &test->vk;
+
+    const struct sk_init_params params = {
+        .thread_count = sk_get_cpu_count(),
+        .warm_init = true,
+        .resource_cache_limit = test->resource_cache_limit,
+        .purge_policy = test->purge_policy,
+        .purge_idle_ms = test->purge_idle_ms,
+    };
+    sk_init(sk, &params);
+    sk_vk_init(vk);
+
+    const GrVkBackendContext backend = sk_vk_make_backend_context(vk);
+    test->ctx = sk_create_context_ganesh_vk(sk, backend);
+    test->surf = sk_create_surface_ganesh(sk, test->ctx, test->width, test->height);
+    sk_scene_init(sk, &test->scene, test->scene_type, test->width, test->height);
+
+    test->csv = fopen("soak.csv", "w");
+    if (!test->csv)
+        sk_die("failed to create soak.csv");
+    fprintf(test->csv, "frame,frame_ms,resource_count,resource_bytes,purgeable_bytes\n");
+}
+
+static void
+soak_ganesh_vk_test_cleanup(struct soak_ganesh_vk_test *test)
+{
+    struct sk *sk = &test->sk;
+    struct sk_vk *vk = &test->vk;
+
+    fclose(test->csv);
+
+    sk_scene_cleanup(sk, &test->scene);
+    test->surf.reset();
+    test->ctx.reset();
+    sk_vk_cleanup(vk);
+    sk_cleanup(sk);
+}
+
+static void
+soak_ganesh_vk_test_draw_frame(struct soak_ganesh_vk_test *test, uint32_t frame)
+{
+    struct sk *sk = &test->sk;
+
+    /* offscreen layers of varying sizes churn the scratch resources */
+    const uint32_t layer_width = test->width / 4 + (frame * 37 % 16) * test->width / 20;
+    const uint32_t layer_height = test->height / 4 + (frame * 53 % 16) * test->height / 20;
+    sk_sp<SkSurface> layer = sk_create_surface_ganesh(sk, test->ctx, layer_width, layer_height);
+    sk_scene_draw(sk, &test->scene, layer->getCanvas(), frame);
+
+    SkCanvas *canvas = test->surf->getCanvas();
+    canvas->clear(SK_ColorWHITE);
+    canvas->drawImage(layer->makeImageSnapshot(), 0, 0);
+
+    test->ctx->flushAndSubmit(test->surf.get(), GrSyncCpu::kYes);
+    sk_purge_context_ganesh(sk, test->ctx.get());
+}
+
+static void
+soak_ganesh_vk_test_draw(struct soak_ganesh_vk_test *test)
+{
+    struct sk *sk = &test->sk;
+
+    const uint64_t begin = sk_now_ns();
+    for (uint32_t i = 0; i < test->frame_count; i++) {
+        const uint64_t frame_begin = sk_now_ns();
+        soak_ganesh_vk_test_draw_frame(test, i);
+        const uint64_t frame_end = sk_now_ns();
+        sk_report_first_pixel(sk);
+
+        int count;
+        size_t bytes;
+        test->ctx->getResourceCacheUsage(&count, &bytes);
+        fprintf(test->csv, "%u,%.3f,%d,%zu,%zu\n", i, (frame_end - frame_begin) / 1e6, count,
+                bytes, test->ctx->getResourceCachePurgeableBytes());
+
+        if (test->dump_interval && (i + 1) % test->dump_interval == 0) {
+            sk_log("frame %u:", i + 1);
+            sk_report_context_ganesh(sk, test->ctx.get());
+        }
+    }
+    const uint64_t end = sk_now_ns();
+
+    sk_scene_report(sk, &test->scene, "ganesh-vk", test->frame_count, end - begin);
+
+    sk_dump_surface(sk, test->surf, "rt.png");
+}
+
+static enum sk_purge_policy
+soak_ganesh_vk_test_parse_purge_policy(const char *name)
+{
+    if (!strcmp(name, "none"))
+        return SK_PURGE_NONE;
+    else if (!strcmp(name, "idle"))
+        return SK_PURGE_IDLE;
+    else if (!strcmp(name, "scratch"))
+        return SK_PURGE_SCRATCH;
+    else if (!strcmp(name, "all"))
+        return SK_PURGE_ALL;
+    sk_die("unknown purge policy %s", name);
+}
+
+int
+main(int argc, const char **argv)
+{
+    struct soak_ganesh_vk_test test = {
+        .width = 1024,
+        .height = 1024,
+        .scene_type = SK_SCENE_PATH_VOLATILE,
+        .frame_count = 10000,
+        .dump_interval = 1000,
+        .resource_cache_limit = 0,
+        .purge_policy = SK_PURGE_NONE,
+        .purge_idle_ms = 1000,
+    };
+
+    int opt;
+    while ((opt = getopt(argc, (char *const *)argv, "s:n:d:b:P:i:")) != -1) {
+        switch (opt) {
+        case 's':
+            test.scene_type = sk_scene_parse_type(optarg);
+            break;
+        case 'n':
+            test.frame_count = atoi(optarg);
+            break;
+        case 'd':
+            test.dump_interval = atoi(optarg);
+            break;
+        case 'b':
+            test.resource_cache_limit = strtoull(optarg, NULL, 0);
+            break;
+        case 'P':
+            test.purge_policy = soak_ganesh_vk_test_parse_purge_policy(optarg);
+            break;
+        case 'i':
+            test.purge_idle_ms = atoi(optarg);
+            break;
+        default:
+            sk_die("usage: %s [-s <scene>] [-n <frame-count>] [-d <dump-interval>] "
+                   "[-b <budget-bytes>] [-P none|idle|scratch|all] [-i <idle-ms>]",
+                   argv[0]);
+        }
+    }
+    if (!test.frame_count)
+        sk_die("frame count must be positive");
+
+    soak_ganesh_vk_test_init(&test);
+    sk_alloc_set_phase(SK_ALLOC_PHASE_DRAW);
+    soak_ganesh_vk_test_draw(&test);
+    sk_alloc_set_phase(SK_ALLOC_PHASE_CLEANUP);
+    soak_ganesh_vk_test_cleanup(&test);
+
+    return 0;
+}